@@ -6,236 +6,310 @@
  */
 
 #include "postgres.h"
-#include <stdio.h>
 
+#include "access/htup.h"
 #include "access/par_tupack.h"
-#include "libpq/pqformat.h"
-#include "utils/lsyscache.h"
-
-//void dump_stringinfo(StringInfoData sid) {
-//	int i;
-////	printf("sid: <");
-//	for (i = 0; i < sid.len; i++) {
-//		printf(" %02X", ((unsigned char*)sid.data)[i]);
-//	}
-////	printf(">\n");
-//}
-
-struct varlena * shove_bytes(unsigned char *stuff, int len) {
-	struct varlena *result;
-
-	result = (struct varlena *) palloc(VARHDRSZ + len);
-	SET_VARSIZE(result, VARHDRSZ + len);
-	memmove(VARDATA(result), stuff, len); 
-	return(result);
-}
-
-//void printbytes(char *bytes, int len) {
-//	int i;
-//	for (i = 0; i < len; i++) {
-//		print("%2X ", bytes[i]);
-//	}
-//	print("\n");
-//}
+#include "access/tupmacs.h"
+#include "access/tuptoaster.h"
 
 /*
- * In the implementation of the next routines we assume the following:
- *
- * A) if a type is "byVal" then all the information is stored in the
- * Datum itself (i.e. no pointers involved!). In this case the
- * length of the type is always greater than zero and not more than
- * "sizeof(Datum)"
- *
- * B) if a type is not "byVal" and it has a fixed length (typlen > 0),
- * then the "Datum" always contains a pointer to a stream of bytes.
- * The number of significant bytes are always equal to the typlen.
- *
- * C) if a type is not "byVal" and has typlen == -1,
- * then the "Datum" always points to a "struct varlena".
- * This varlena structure has information about the actual length of this
- * particular instance of the type and about its value.
+ * A packed tuple looks much like the data part of a heap tuple:
  *
- * D) if a type is not "byVal" and has typlen == -2,
- * then the "Datum" always points to a null-terminated C string.
+ *	bits8	the null bitmap, BITMAPLEN(natts) bytes, a set bit means
+ *		that the attribute is not null (as in t_bits)
+ *	then for each attribute that is not null, aligned by its attalign
+ *	relative to the beginning of the packed tuple:
+ *	...	a "byVal" value, attlen bytes of the Datum
+ *	...	a fixed length value, attlen bytes the Datum points to
+ *	...	a varlena, with a short header if it fits (not aligned then)
+ *	...	a C string, with its terminating zero
  *
- * Note that we do not treat "toasted" datums specially; therefore what
- * will be copied or compared is the compressed data or toast reference.
+ * The values are copied as they are in memory, so all the nodes must
+ * have the same byte order and alignment. The external ("toasted")
+ * varlenas are fetched before packing, because the other node cannot
+ * read our toast tables, but the compressed ones are sent compressed.
  */
 
 /*
- * Tuple packing routine
+ * Builds the layout of the tuples with the descriptor.
+ * The layout lives in the current memory context.
  */
-StringInfoData par_tupack(TupleTableSlot *slot)
+ParTupleLayout *par_tuplayout(TupleDesc typeinfo)
 {
-	TupleDesc typeinfo = slot->tts_tupleDescriptor;
-	StringInfoData buf;
+	ParTupleLayout *layout;
 	int natts = typeinfo->natts;
 	int i;
 
-	/* Fill the type info arrays */
-	int16 *typlen = (int *)palloc(natts * sizeof(int16));
-	bool *typbyval = (bool *)palloc(natts * sizeof(bool));
+	layout = (ParTupleLayout *)palloc(sizeof(ParTupleLayout));
+	layout->natts = natts;
+	layout->attlen = (int16 *)palloc(natts * sizeof(int16));
+	layout->attbyval = (bool *)palloc(natts * sizeof(bool));
+	layout->attalign = (char *)palloc(natts * sizeof(char));
+	layout->attpackable = (bool *)palloc(natts * sizeof(bool));
+	layout->values = (Datum *)palloc(natts * sizeof(Datum));
+	layout->buffer = NULL;
+	layout->buflen = 0;
+	layout->cxt = CurrentMemoryContext;
+
 	for (i = 0; i < natts; i++)
 	{
-		Oid typid = typeinfo->attrs[i]->atttypid;
-		get_typlenbyval(typid, typlen + i, typbyval + i);
+		Form_pg_attribute att = typeinfo->attrs[i];
+
+		layout->attlen[i] = att->attlen;
+		layout->attbyval[i] = att->attbyval;
+		layout->attalign[i] = att->attalign;
+		layout->attpackable[i] = (att->attlen == -1 && att->attstorage != 'p');
 	}
+	return layout;
+}
+
+void par_free_tuplayout(ParTupleLayout *layout)
+{
+	pfree(layout->attlen);
+	pfree(layout->attbyval);
+	pfree(layout->attalign);
+	pfree(layout->attpackable);
+	pfree(layout->values);
+	if (layout->buffer != NULL)
+		pfree(layout->buffer);
+	pfree(layout);
+}
+
+/*
+ * Tuple packing routine. Replaces the contents of the buffer
+ * with the packed tuple.
+ */
+void par_tupack(ParTupleLayout *layout, TupleTableSlot *slot, StringInfo buf)
+{
+	int natts = layout->natts;
+	Datum *values = layout->values;
+	bool *isnull;
+	bits8 *bits;
+	char *data;
+	long len, off;
+	int i;
+
+	Assert(!TupIsNull(slot));
 
 	/* Make sure the tuple is fully deconstructed */
 	slot_getallattrs(slot);
+	if (slot->tts_tupleDescriptor->natts != natts)
+		elog(ERROR, "par_tupack: the tuple has %d attributes instead of %d",
+			 slot->tts_tupleDescriptor->natts, natts);
+	isnull = slot->tts_isnull;
 
-	initStringInfo(&buf);
-	resetStringInfo(&buf);
-
-	if (TupIsNull(slot))
+	/* Fetch the external values and find out the size */
+	len = BITMAPLEN(natts);
+	for (i = 0; i < natts; i++)
 	{
-		pq_sendint(&buf, 0, 2);
+		Datum val;
+
+		if (isnull[i])
+			continue;
+
+		val = slot->tts_values[i];
+		if (layout->attlen[i] == -1)
+		{
+			if (VARATT_IS_EXTERNAL(DatumGetPointer(val)))
+				val = PointerGetDatum(heap_tuple_fetch_attr((struct varlena *)DatumGetPointer(val)));
+			if (layout->attpackable[i] && VARATT_CAN_MAKE_SHORT(DatumGetPointer(val)))
+			{
+				/* will get a short header, no alignment */
+				values[i] = val;
+				len += VARATT_CONVERTED_SHORT_SIZE(DatumGetPointer(val));
+				continue;
+			}
+		}
+		values[i] = val;
+		len = att_align_datum(len, layout->attalign[i], layout->attlen[i], val);
+		len = att_addlength_datum(len, layout->attlen[i], val);
 	}
-	else
+
+	/* The bitmap and the padding have to be zeroes */
+	resetStringInfo(buf);
+	enlargeStringInfo(buf, len);
+	data = buf->data;
+	memset(data, 0, len);
+	bits = (bits8 *)data;
+
+	off = BITMAPLEN(natts);
+	for (i = 0; i < natts; i++)
 	{
-		pq_sendint(&buf, natts, 2);
+		Datum val = values[i];
+		int16 attlen = layout->attlen[i];
 
-		/*
-		 * send the attributes of this tuple
-		 */
-		for (i = 0; i < natts; ++i)
+		if (isnull[i])
+			continue;
+		bits[i >> 3] |= 1 << (i & 7);
+
+		if (layout->attbyval[i])
+		{
+			// Datum is the actual value
+			off = att_align_nominal(off, layout->attalign[i]);
+			store_att_byval(data + off, val, attlen);
+			off += attlen;
+		}
+		else if (attlen == -1)
 		{
-			Datum origattr = slot->tts_values[i];
-			Datum attr;
-			bytea *outputbytes;
+			// Varlena!
+			Pointer p = DatumGetPointer(val);
+			Size size;
 
-			if (slot->tts_isnull[i])
+			if (VARATT_IS_SHORT(p))
 			{
-				pq_sendint(&buf, -1, 4);
-				continue;
+				size = VARSIZE_SHORT(p);
+				memcpy(data + off, p, size);
 			}
-
-			if (typbyval[i]) {
-				// Datum is the actual value
-				pq_sendint(&buf, 4, 4);
-				pq_sendint(&buf, origattr, 4);
-			} else {
-				if (typlen[i] > 0) {
-					// Datum is the pointer, typlen is the length
-					pq_sendint(&buf, typlen[i], 4);
-//					if (typlen[i] > 1000) {
-//						printf("WTF1, i = %d, len = %d\n", i, typlen[i]);
-//						continue;
-//					}
-					//printf("Send attr[%d]: Datum is pointer, typlen is the lenth\n", i);
-					//printf("blkid ==== %u\n", ItemPointerGetBlockNumber((ItemPointer)DatumGetPointer(origattr)));
-					//printbytes(DatumGetPointer(origattr), typlen[i]);
-					pq_sendbytes(&buf, origattr, typlen[i]);
-				} else if (typlen[i] == -1) {
-					// Varlena!
-					attr = PointerGetDatum(PG_DETOAST_DATUM(origattr));
-					pq_sendint(&buf, VARSIZE_ANY(attr), 4);
-//					if (VARSIZE_ANY(attr) > 1000) {
-//						printf("WTF2\n");
-//						continue;
-//					}
-					//printf("Send attr[%d]: Varlena!\n", i);
-					pq_sendbytes(&buf, VARDATA_ANY(attr), VARSIZE_ANY(attr));
-					/* Clean up detoasted copy, if any */
-					if (DatumGetPointer(attr) != DatumGetPointer(origattr))
-						pfree(DatumGetPointer(attr));
-				} else if (typlen[i] == -2) {
-					// C string
-					int len = strlen(origattr);
-					pq_sendint(&buf, len, 4);
-//					if (len > 1000) {
-//						printf("WTF3\n");
-//						continue;
-//					}
-					pq_sendbytes(&buf, origattr, len);
-				}
+			else if (layout->attpackable[i] && VARATT_CAN_MAKE_SHORT(p))
+			{
+				size = VARATT_CONVERTED_SHORT_SIZE(p);
+				SET_VARSIZE_SHORT(data + off, size);
+				memcpy(data + off + 1, VARDATA(p), size - 1);
+			}
+			else
+			{
+				off = att_align_nominal(off, layout->attalign[i]);
+				size = VARSIZE(p);
+				memcpy(data + off, p, size);
 			}
+			off += size;
+
+			/* Clean up the fetched copy, if any */
+			if (p != DatumGetPointer(slot->tts_values[i]))
+				pfree(p);
 		}
-	}
+		else if (attlen == -2)
+		{
+			// C string
+			Size size = strlen(DatumGetCString(val)) + 1;
 
-	pfree(typlen);
-	pfree(typbyval);
+			memcpy(data + off, DatumGetPointer(val), size);
+			off += size;
+		}
+		else
+		{
+			// Datum is the pointer, attlen is the length
+			off = att_align_nominal(off, layout->attalign[i]);
+			memcpy(data + off, DatumGetPointer(val), attlen);
+			off += attlen;
+		}
+	}
+	Assert(off == len);
 
-	//dump_stringinfo(buf);
-	return buf;
+	buf->len = len;
+	buf->data[len] = '\0';
 }
 
 /*
- * Tuple unpacking routine
+ * Replaces the contents of the buffer with the tuple as a MinimalTuple,
+ * for a node on the same host, which stores it into its slot as it is
+ * instead of unpacking it. The external varlenas are fetched here too.
  */
-void par_tunpack(StringInfoData buf, TupleTableSlot *slot)
+void par_tupack_minimal(ParTupleLayout *layout, TupleTableSlot *slot, StringInfo buf)
 {
+	MinimalTuple tuple;
+	bool hasexternal = false;
 	int i;
-	int natts;
-	TupleDesc typeinfo;
 
-	ExecClearTuple(slot);
-	slot->tts_shouldFree = true;
-
-	//dump_stringinfo(buf);
-	buf.cursor = 0;
+	Assert(!TupIsNull(slot));
 
-	typeinfo = slot->tts_tupleDescriptor;
-	natts = typeinfo->natts;
+	if (slot->tts_mintuple != NULL)
+		hasexternal = (slot->tts_mintuple->t_infomask & HEAP_HASEXTERNAL) != 0;
+	else if (slot->tts_tuple != NULL)
+		hasexternal = HeapTupleHasExternal(slot->tts_tuple);
+	else
+	{
+		/* A virtual tuple, its values have to be looked at */
+		for (i = 0; i < layout->natts; i++)
+		{
+			if (layout->attlen[i] == -1 && !slot->tts_isnull[i]
+				&& VARATT_IS_EXTERNAL(DatumGetPointer(slot->tts_values[i])))
+			{
+				hasexternal = true;
+				break;
+			}
+		}
+	}
 
-	/* Fill the type info arrays */
-	int16 *typlen = (int *)palloc(natts * sizeof(int16));
-	bool *typbyval = (bool *)palloc(natts * sizeof(bool));
-	for (i = 0; i < natts; i++)
+	if (!hasexternal)
+		tuple = ExecCopySlotMinimalTuple(slot);
+	else
 	{
-		Oid typid = typeinfo->attrs[i]->atttypid;
-		get_typlenbyval(typid, typlen + i, typbyval + i);
+		Datum *values = layout->values;
+
+		slot_getallattrs(slot);
+		for (i = 0; i < layout->natts; i++)
+		{
+			values[i] = slot->tts_values[i];
+			if (layout->attlen[i] == -1 && !slot->tts_isnull[i]
+				&& VARATT_IS_EXTERNAL(DatumGetPointer(values[i])))
+				values[i] = PointerGetDatum(heap_tuple_fetch_attr((struct varlena *)DatumGetPointer(values[i])));
+		}
+		tuple = heap_form_minimal_tuple(slot->tts_tupleDescriptor, values, slot->tts_isnull);
+		for (i = 0; i < layout->natts; i++)
+		{
+			if (values[i] != slot->tts_values[i])
+				pfree(DatumGetPointer(values[i]));
+		}
 	}
 
-	slot->tts_tuple = NULL;
+	resetStringInfo(buf);
+	appendBinaryStringInfo(buf, (char *) tuple, tuple->t_len);
+	pfree(tuple);
+}
+
+/*
+ * Tuple unpacking routine. The tuple is stored into the slot as
+ * a virtual one, with the datums pointing into the layout's buffer,
+ * so it stays valid until the next tuple is unpacked.
+ */
+void par_tunpack(ParTupleLayout *layout, const char *data, int len, TupleTableSlot *slot)
+{
+	int natts = layout->natts;
+	Datum *values = slot->tts_values;
+	bool *isnull = slot->tts_isnull;
+	bits8 *bits;
+	char *tup;
+	long off;
+	int i;
+
+	ExecClearTuple(slot);
 
-	if (pq_getmsgint(&buf, 2) == 0)
+	/* The datums must be aligned, so the tuple is copied to a MAXALIGNed place */
+	if (len > layout->buflen)
 	{
-		slot->tts_isempty = 1;
+		if (layout->buffer != NULL)
+			pfree(layout->buffer);
+		layout->buffer = (char *)MemoryContextAlloc(layout->cxt, len);
+		layout->buflen = len;
 	}
-	else
+	tup = layout->buffer;
+	memcpy(tup, data, len);
+	bits = (bits8 *)tup;
+
+	off = BITMAPLEN(natts);
+	for (i = 0; i < natts; i++)
 	{
-		slot->tts_isempty = 0;
-		/*
-		 * recv the attributes of this tuple
-		 */
-		for (i = 0; i < natts; ++i)
+		int16 attlen = layout->attlen[i];
+
+		if (!(bits[i >> 3] & (1 << (i & 7))))
 		{
-//			printf("unpacking attr%d\n", i);
-			int len = pq_getmsgint(&buf, 4);
-			if (len == -1)
-			{
-				slot->tts_isnull[i] = 1;
-//				printf("tunpack: attr%d is null!\n", i);
-				continue;
-			}
-			slot->tts_isnull[i] = 0;
-			if (typbyval[i]) {
-				// Datum should be the actual value
-				//printf("Recv attr[%d]: Datum is the actual value\n", i);
-				slot->tts_values[i] = pq_getmsgint(&buf, 4);
-			} else {
-				if (typlen[i] > 0) {
-					// Datum should be the pointer, typlen should be the length
-					slot->tts_values[i] = palloc(typlen[i]);
-					//printf("Recv attr[%d]: Datum is pointer, typlen is the lenth = %d\n", i, typlen[i]);
-					pq_copymsgbytes(&buf, slot->tts_values[i], typlen[i]);
-					//slot->tts_values[i] = PointerGetDatum(pq_getmsgbytes(&buf, typlen[i]));
-					//printbytes(slot->tts_values[i], typlen[i]);
-				} else if (typlen[i] == -1) {
-					// Varlena!
-					//printf("Recv attr[%d]: Varlena!\n", i);
-					slot->tts_values[i] = shove_bytes(pq_getmsgbytes(&buf, len), len);
-				} else if (typlen[i] == -2) {
-					// C string
-					slot->tts_values[i] = palloc(len + 1);
-					pq_copymsgbytes(&buf, slot->tts_values[i], len);
-				}
-			}
+			values[i] = (Datum) 0;
+			isnull[i] = true;
+			continue;
 		}
-		ExecMaterializeSlot(slot);
+		isnull[i] = false;
+
+		if (attlen == -1)
+			off = att_align_pointer(off, layout->attalign[i], -1, tup + off);
+		else if (attlen > 0)
+			off = att_align_nominal(off, layout->attalign[i]);
+		values[i] = fetch_att(tup + off, layout->attbyval[i], attlen);
+		off = att_addlength_pointer(off, attlen, tup + off);
 	}
 
-	pfree(typlen);
-	pfree(typbyval);
+	if (off != len)
+		elog(ERROR, "par_tunpack: a packed tuple of %d bytes has %ld bytes of data", len, off);
+
+	ExecStoreVirtualTuple(slot);
 }
@@ -183,6 +183,22 @@ static relopt_real realRelOpts[] =
 	{{NULL}}
 };
 
+/*
+ * PargreSQL: the fragmentation method has to be one of the known ones,
+ * the bounds are checked against the type of 'fragattr' when used.
+ */
+static void
+validate_fragmethod(char *value)
+{
+	if (value == NULL || strcmp(value, "hash") == 0
+		|| strcmp(value, "range") == 0 || strcmp(value, "list") == 0)
+		return;
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid value for \"fragmethod\" option: \"%s\"", value),
+			 errhint("Valid values are \"hash\", \"range\" and \"list\".")));
+}
+
 static relopt_string stringRelOpts[] =
 {
 	{
@@ -192,6 +208,20 @@ static relopt_string stringRelOpts[] =
 			RELOPT_KIND_HEAP | RELOPT_KIND_TOAST
 		}, /*def.len*/4, /*def.isnull*/FALSE, /*validator*/NULL, "NULL"
 	},
+	{
+		/*gen*/{
+			"fragmethod",
+			"How the rows are spread over the nodes: hash, range or list",
+			RELOPT_KIND_HEAP | RELOPT_KIND_TOAST
+		}, /*def.len*/0, /*def.isnull*/TRUE, /*validator*/validate_fragmethod, ""
+	},
+	{
+		/*gen*/{
+			"fragbounds",
+			"The lower bounds of the ranges, or the lists of values, of the nodes",
+			RELOPT_KIND_HEAP | RELOPT_KIND_TOAST
+		}, /*def.len*/0, /*def.isnull*/TRUE, /*validator*/NULL, ""
+	},
 	/* list terminator */
 	{{NULL}}
 };
@@ -1106,7 +1136,9 @@ default_reloptions(Datum reloptions, bool validate, relopt_kind kind)
 		offsetof(StdRdOptions, autovacuum) +offsetof(AutoVacOpts, vacuum_scale_factor)},
 		{"autovacuum_analyze_scale_factor", RELOPT_TYPE_REAL,
 		offsetof(StdRdOptions, autovacuum) +offsetof(AutoVacOpts, analyze_scale_factor)},
-		{"fragattr", RELOPT_TYPE_STRING, offsetof(StdRdOptions, fragattr)}
+		{"fragattr", RELOPT_TYPE_STRING, offsetof(StdRdOptions, fragattr)},
+		{"fragmethod", RELOPT_TYPE_STRING, offsetof(StdRdOptions, fragmethod)},
+		{"fragbounds", RELOPT_TYPE_STRING, offsetof(StdRdOptions, fragbounds)}
 	};
 
 	options = parseRelOptions(reloptions, validate, kind, &numoptions);
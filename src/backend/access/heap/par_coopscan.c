@@ -0,0 +1,408 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_coopscan.c
+ *	  Cooperative sequential scans of PargreSQL.
+ *
+ * The ranks that share a fragment (see par_coopscan.h) run the same
+ * plans, so the n-th cooperative scan of the m-th client command is the
+ * same scan on all of them. The first rank that starts it sets up a
+ * dispenser in shared memory, and every rank then takes the blocks from
+ * the dispenser, PAR_COOPSCAN_CHUNK at a time, until there are none left.
+ *
+ * Several client sessions may work with the fragment at once. The ranks
+ * of a session tell their dispensers from the others by the PID of the
+ * backend of the leader, which the leader sends them at the first
+ * cooperative scan of the session. A dispenser of another relation means
+ * that the ranks do not run the same plans.
+ *
+ * A rank remembers the chunks it has taken. When its scan is rescanned,
+ * it takes all the chunks that are still left and reads its chunks over
+ * again, so that every rescan returns the same tuples and every block
+ * still belongs to exactly one rank.
+ *
+ * A dispenser is freed when all the ranks of the fragment are done with
+ * it. If some rank never gets to the scan, the dispenser stays until a
+ * later command of the session needs the space, or the session ends.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <arpa/inet.h>
+
+#include "access/par_coopscan.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/rel.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+#define PAR_COOPSCAN_SLOTS	64
+#define PAR_COOPSCAN_CHUNK	16		/* blocks taken at once */
+
+/* GUC variable */
+int			par_scan_workers = 1;
+
+typedef struct ParCoopScanSlot
+{
+	int			fragment;		/* the fragment, or -1 if the slot is free */
+	int32		session;
+	uint32		command;
+	int			scanno;
+	Oid			relid;
+	BlockNumber nblocks;
+	BlockNumber next;			/* the next block to hand out */
+	int			done;			/* the number of ranks done with the dispenser */
+} ParCoopScanSlot;
+
+typedef struct ParCoopScanShmemStruct
+{
+	slock_t		mutex;
+	ParCoopScanSlot slots[PAR_COOPSCAN_SLOTS];
+} ParCoopScanShmemStruct;
+
+static ParCoopScanShmemStruct *coopScans = NULL;
+
+/* the session, the client command and the number of cooperative scans started in it */
+static int32 session = 0;
+static uint32 command = 0;
+static int	scans = 0;
+
+static void coopscan_wait(_pargresql_request_t *request);
+static void coopscan_join_session(void);
+static void coopscan_end_session(int code, Datum arg);
+static int	coopscan_attach(ParCoopScanState *coop, BlockNumber nblocks);
+static BlockNumber coopscan_claim(ParCoopScanState *coop);
+static void coopscan_detach(ParCoopScanState *coop);
+
+
+Size
+ParCoopScanShmemSize(void)
+{
+	return sizeof(ParCoopScanShmemStruct);
+}
+
+void
+ParCoopScanShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	coopScans = (ParCoopScanShmemStruct *)
+		ShmemInitStruct("PargreSQL Cooperative Scans", ParCoopScanShmemSize(), &found);
+
+	if (!IsUnderPostmaster)
+	{
+		Assert(!found);
+
+		SpinLockInit(&coopScans->mutex);
+		for (i = 0; i < PAR_COOPSCAN_SLOTS; i++)
+			coopScans->slots[i].fragment = -1;
+	}
+	else
+		Assert(found);
+}
+
+/*
+ * Waits until the message has been sent or received.
+ */
+static void
+coopscan_wait(_pargresql_request_t *request)
+{
+	int			flag;
+
+	for (;;)
+	{
+		_pargresql_Test(request, &flag); // FIXME: INIS naming
+		if (flag)
+			return;
+		_pargresql_Wait(100); // FIXME: INIS naming
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Learns the session of the ranks of the fragment: the leader sends the
+ * PID of its backend to the other ranks.
+ */
+static void
+coopscan_join_session(void)
+{
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			leader = rank - rank % par_scan_workers;
+	_pargresql_request_t requests[64];
+	uint32		buf;
+	int			i;
+
+	if (rank == leader)
+	{
+		buf = htonl((uint32) MyProcPid);
+		for (i = 1; i < par_scan_workers; i++)
+			_pargresql_ISend(leader + i, PAR_COOPSCAN_PORT, sizeof(buf), &buf, &requests[i]); // FIXME: INIS naming
+		for (i = 1; i < par_scan_workers; i++)
+			coopscan_wait(&requests[i]);
+		session = MyProcPid;
+	}
+	else
+	{
+		_pargresql_IRecv(leader, PAR_COOPSCAN_PORT, sizeof(buf), &buf, &requests[0]); // FIXME: INIS naming
+		coopscan_wait(&requests[0]);
+		session = (int32) ntohl(buf);
+	}
+
+	on_shmem_exit(coopscan_end_session, (Datum) 0);
+}
+
+/*
+ * Frees the dispensers of the session that some rank has never got to.
+ */
+static void
+coopscan_end_session(int code, Datum arg)
+{
+	int			fragment = _pargresql_GetNode() / par_scan_workers; // FIXME: INIS naming
+	int			i;
+
+	SpinLockAcquire(&coopScans->mutex);
+	for (i = 0; i < PAR_COOPSCAN_SLOTS; i++)
+	{
+		if (coopScans->slots[i].fragment == fragment
+			&& coopScans->slots[i].session == session)
+			coopScans->slots[i].fragment = -1;
+	}
+	SpinLockRelease(&coopScans->mutex);
+}
+
+/*
+ * Called at the start of every client command. The ranks of a fragment
+ * get the same commands, so they count them the same way.
+ */
+void
+par_coopscan_new_command(void)
+{
+	command++;
+	scans = 0;
+}
+
+/*
+ * Makes the scan share its blocks with the other ranks of the fragment.
+ * Has to be called right after heap_beginscan.
+ */
+void
+par_coopscan_begin(HeapScanDesc scan)
+{
+	ParCoopScanState *coop;
+
+	if (!scan->rs_pageatatime)
+		elog(ERROR, "cooperative scans need a page-at-a-time scan");
+	if (!_pargresql_IsOpen()) // FIXME: INIS naming
+		elog(ERROR, "cooperative scans need the PargreSQL communicator");
+
+	/*
+	 * Only the sessions that scan cooperatively wait for the leader, and
+	 * the ranks of a fragment run the same plans, so they all get here
+	 */
+	if (session == 0)
+		coopscan_join_session();
+
+	coop = (ParCoopScanState *) palloc0(sizeof(ParCoopScanState));
+	coop->slot = -1;
+	coop->fragment = _pargresql_GetNode() / par_scan_workers; // FIXME: INIS naming
+	coop->session = session;
+	coop->command = command;
+	coop->scanno = scans++;
+	coop->relid = RelationGetRelid(scan->rs_rd);
+	coop->maxchunks = 16;
+	coop->chunks = (BlockNumber *) palloc(coop->maxchunks * sizeof(BlockNumber));
+	coop->next = coop->end = 0;
+
+	/* The blocks are handed out in order, synchronizing would not help */
+	scan->rs_allow_sync = false;
+	scan->rs_syncscan = false;
+	scan->rs_startblock = 0;
+	scan->rs_coop = coop;
+}
+
+/*
+ * Finds the dispenser of the scan, or sets it up. Returns the slot.
+ */
+static int
+coopscan_attach(ParCoopScanState *coop, BlockNumber nblocks)
+{
+	int			fragment = coop->fragment;
+	int			empty = -1,
+				oldest = -1,
+				i;
+	volatile ParCoopScanSlot *slot;
+
+	SpinLockAcquire(&coopScans->mutex);
+	for (i = 0; i < PAR_COOPSCAN_SLOTS; i++)
+	{
+		slot = &coopScans->slots[i];
+		if (slot->fragment == fragment && slot->session == coop->session
+			&& slot->command == coop->command && slot->scanno == coop->scanno)
+		{
+			if (slot->relid != coop->relid)
+			{
+				Oid			relid = slot->relid;
+
+				SpinLockRelease(&coopScans->mutex);
+				elog(ERROR, "cooperative scan %d scans relation %u here, but relation %u on another rank",
+					 coop->scanno, coop->relid, relid);
+			}
+			coop->nblocks = slot->nblocks;
+			SpinLockRelease(&coopScans->mutex);
+			return i;
+		}
+		if (slot->fragment == -1)
+			empty = i;
+		else if (slot->fragment == fragment && slot->session == coop->session
+				 && slot->command != coop->command
+				 && (oldest < 0 || coopScans->slots[oldest].command > slot->command))
+			oldest = i;		/* left over by a command some rank never scanned */
+	}
+
+	if (empty < 0)
+		empty = oldest;
+	if (empty < 0)
+	{
+		SpinLockRelease(&coopScans->mutex);
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("too many cooperative scans at once")));
+	}
+
+	slot = &coopScans->slots[empty];
+	slot->fragment = fragment;
+	slot->session = coop->session;
+	slot->command = coop->command;
+	slot->scanno = coop->scanno;
+	slot->relid = coop->relid;
+	slot->nblocks = nblocks;
+	slot->next = 0;
+	slot->done = 0;
+	coop->nblocks = nblocks;
+	SpinLockRelease(&coopScans->mutex);
+	return empty;
+}
+
+/*
+ * Takes the next chunk from the dispenser. Returns its first block,
+ * or InvalidBlockNumber if the dispenser is empty.
+ */
+static BlockNumber
+coopscan_claim(ParCoopScanState *coop)
+{
+	volatile ParCoopScanSlot *slot = &coopScans->slots[coop->slot];
+	BlockNumber start;
+
+	SpinLockAcquire(&coopScans->mutex);
+	start = slot->next;
+	if (start < slot->nblocks)
+		slot->next = start + PAR_COOPSCAN_CHUNK;
+	SpinLockRelease(&coopScans->mutex);
+
+	if (start >= coop->nblocks)
+	{
+		coop->claimed = true;
+		coop->replay = coop->nchunks;	/* nothing to read again yet */
+		coopscan_detach(coop);
+		return InvalidBlockNumber;
+	}
+
+	if (coop->nchunks == coop->maxchunks)
+	{
+		coop->maxchunks *= 2;
+		coop->chunks = (BlockNumber *) repalloc(coop->chunks,
+									coop->maxchunks * sizeof(BlockNumber));
+	}
+	coop->chunks[coop->nchunks++] = start;
+	return start;
+}
+
+/*
+ * Tells the dispenser this rank will not take anything else from it.
+ */
+static void
+coopscan_detach(ParCoopScanState *coop)
+{
+	volatile ParCoopScanSlot *slot;
+
+	if (coop->slot < 0)
+		return;
+
+	slot = &coopScans->slots[coop->slot];
+	SpinLockAcquire(&coopScans->mutex);
+	if (slot->fragment == coop->fragment && slot->session == coop->session
+		&& slot->command == coop->command && slot->scanno == coop->scanno
+		&& ++slot->done >= par_scan_workers)
+		slot->fragment = -1;
+	SpinLockRelease(&coopScans->mutex);
+	coop->slot = -1;
+}
+
+/*
+ * Returns the next block of this rank, or InvalidBlockNumber at the end.
+ */
+BlockNumber
+par_coopscan_next(HeapScanDesc scan)
+{
+	ParCoopScanState *coop = scan->rs_coop;
+	BlockNumber start;
+
+	if (coop->next < coop->end)
+		return coop->next++;
+
+	if (coop->claimed)
+	{
+		/* Reading the chunks of this rank over again */
+		if (coop->replay >= coop->nchunks)
+			return InvalidBlockNumber;
+		start = coop->chunks[coop->replay++];
+	}
+	else
+	{
+		if (coop->slot < 0)
+			coop->slot = coopscan_attach(coop, scan->rs_nblocks);
+		start = coopscan_claim(coop);
+		if (start == InvalidBlockNumber)
+			return InvalidBlockNumber;
+	}
+
+	coop->next = start + 1;
+	coop->end = Min(start + PAR_COOPSCAN_CHUNK, coop->nblocks);
+	return start;
+}
+
+/*
+ * Makes the scan return the same blocks again.
+ */
+void
+par_coopscan_rescan(HeapScanDesc scan)
+{
+	ParCoopScanState *coop = scan->rs_coop;
+
+	if (!coop->claimed)
+	{
+		/* The blocks nobody has taken yet are ours, or nobody would read them */
+		if (coop->slot < 0)
+			coop->slot = coopscan_attach(coop, scan->rs_nblocks);
+		while (coopscan_claim(coop) != InvalidBlockNumber)
+			;
+	}
+	coop->replay = 0;
+	coop->next = coop->end = 0;
+}
+
+void
+par_coopscan_end(HeapScanDesc scan)
+{
+	ParCoopScanState *coop = scan->rs_coop;
+
+	/* A scan stopped early leaves the rest of the blocks to the others */
+	coopscan_detach(coop);
+	pfree(coop->chunks);
+	pfree(coop);
+	scan->rs_coop = NULL;
+}
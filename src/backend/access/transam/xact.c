@@ -35,6 +35,7 @@
 #include "executor/spi.h"
 #include "libpq/be-fsstubs.h"
 #include "miscadmin.h"
+#include "par_parallelizer/par_fragment.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/fd.h"
@@ -1602,6 +1603,12 @@ CommitTransaction(void)
 	 */
 	PreCommit_on_commit_actions();
 
+	/*
+	 * PargreSQL: the buckets moved between the nodes have to commit on all
+	 * of them, so only COMMIT PREPARED may commit them
+	 */
+	par_rebalance_pre_commit();
+
 	/* close large objects before lower-level cleanup */
 	AtEOXact_LargeObject(true);
 
@@ -27,11 +27,18 @@
 #include "commands/copy.h"
 #include "commands/trigger.h"
 #include "executor/executor.h"
+#include "executor/par_nodeGather.h"
+#include "executor/par_nodeScatter.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/planmain.h"
 #include "optimizer/planner.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+#include "par_parallelizer/par_fragment.h"
+#include "par_parallelizer/par_parallelizer.h"
 #include "parser/parse_relation.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/fd.h"
@@ -239,6 +246,34 @@ if (1) \
 
 static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 
+/*
+ * PargreSQL: the rows of a fragmented relation are routed to the nodes
+ * they belong to through an exchange, so that the input is parsed only
+ * once, on node 0, and every node inserts its own rows. Node 0 reads the
+ * file, or the STDIN of its client. The client of a parallel session
+ * sends the data to node 0 only, and an empty stream to the other nodes
+ * (see par_PQputCopyData), which they have to read to the end.
+ */
+#define PAR_COPY_PORT 0			/* the COPY is the only exchange of its statement */
+#define PAR_COPY_READER 0		/* the node that reads the file or STDIN */
+
+typedef struct CopyRouter
+{
+	ScatterState *scatter;		/* sends the rows away */
+	GatherState *gather;		/* receives the rows of this node */
+	bool		gathered;		/* true if all the other nodes are done */
+} CopyRouter;
+
+/* the state CopyInsertTuple needs */
+typedef struct CopyInsertState
+{
+	EState	   *estate;
+	TupleTableSlot *slot;
+	CommandId	mycid;
+	int			hi_options;
+	BulkInsertState bistate;
+} CopyInsertState;
+
 
 /* non-export function prototypes */
 static void DoCopyTo(CopyState cstate);
@@ -246,6 +281,10 @@ static void CopyTo(CopyState cstate);
 static void CopyOneRowTo(CopyState cstate, Oid tupleOid,
 			 Datum *values, bool *nulls);
 static void CopyFrom(CopyState cstate);
+static void CopyInsertTuple(CopyState cstate, CopyInsertState *ins, HeapTuple tuple);
+static CopyRouter *CopyStartRouter(CopyState cstate, EState *estate, AttrNumber fragatno);
+static void CopyExchange(CopyState cstate, CopyRouter *router, CopyInsertState *ins, bool finish);
+static void CopyEndRouter(CopyRouter *router);
 static bool CopyReadLine(CopyState cstate);
 static bool CopyReadLineText(CopyState cstate);
 static int CopyReadAttributesText(CopyState cstate, int maxfields,
@@ -277,6 +316,7 @@ static void CopySendInt32(CopyState cstate, int32 val);
 static bool CopyGetInt32(CopyState cstate, int32 *val);
 static void CopySendInt16(CopyState cstate, int16 val);
 static bool CopyGetInt16(CopyState cstate, int16 *val);
+static void CopyDrainInput(CopyState cstate);
 
 
 /*
@@ -582,6 +622,24 @@ CopyGetData(CopyState cstate, void *databuf, int minread, int maxread)
 }
 
 
+/*
+ * PargreSQL: reads the STDIN of a node other than PAR_COPY_READER to the
+ * end. The client sends all the data to PAR_COPY_READER, so the stream
+ * has to be empty.
+ */
+static void
+CopyDrainInput(CopyState cstate)
+{
+	char		c;
+
+	if (CopyGetData(cstate, &c, 1, 1) > 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY data for fragmented relation \"%s\" must be sent to node %d only",
+						RelationGetRelationName(cstate->rel), PAR_COPY_READER),
+				 errhint("Use par_PQputCopyData, which routes the data that way.")));
+}
+
 /*
  * These functions do apply some data conversion
  */
@@ -1634,6 +1692,173 @@ limit_printout_length(const char *str)
 	return res;
 }
 
+/*
+ * Fires the triggers, checks the constraints and inserts the tuple
+ * with its index entries.
+ */
+static void
+CopyInsertTuple(CopyState cstate, CopyInsertState *ins, HeapTuple tuple)
+{
+	EState	   *estate = ins->estate;
+	ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
+
+	/* BEFORE ROW INSERT Triggers */
+	if (resultRelInfo->ri_TrigDesc &&
+		resultRelInfo->ri_TrigDesc->n_before_row[TRIGGER_EVENT_INSERT] > 0)
+	{
+		HeapTuple	newtuple;
+
+		newtuple = ExecBRInsertTriggers(estate, resultRelInfo, tuple);
+
+		if (newtuple == NULL)		/* "do nothing" */
+			return;
+		else if (newtuple != tuple) /* modified by Trigger(s) */
+		{
+			heap_freetuple(tuple);
+			tuple = newtuple;
+		}
+	}
+
+	/* Place tuple in tuple slot */
+	ExecStoreTuple(tuple, ins->slot, InvalidBuffer, false);
+
+	/* Check the constraints of the tuple */
+	if (cstate->rel->rd_att->constr)
+		ExecConstraints(resultRelInfo, ins->slot, estate);
+
+	/* OK, store the tuple and create index entries for it */
+	heap_insert(cstate->rel, tuple, ins->mycid, ins->hi_options, ins->bistate);
+
+	if (resultRelInfo->ri_NumIndices > 0)
+		ExecInsertIndexTuples(ins->slot, &(tuple->t_self), estate, false);
+
+	/* AFTER ROW INSERT Triggers */
+	ExecARInsertTriggers(estate, resultRelInfo, tuple);
+
+	/*
+	 * We count only tuples not suppressed by a BEFORE INSERT trigger;
+	 * this is the same definition used by execMain.c for counting
+	 * tuples inserted by an INSERT command.
+	 */
+	cstate->processed++;
+}
+
+/*
+ * PargreSQL: sets up the exchange that routes the rows by the hash, or
+ * by the ranges or lists, of the fragmentation attribute, the same way
+ * the INSERT filter does.
+ */
+static CopyRouter *
+CopyStartRouter(CopyState cstate, EState *estate, AttrNumber fragatno)
+{
+	TupleDesc	tupDesc = RelationGetDescr(cstate->rel);
+	CopyRouter *router;
+	Plan	   *rows;
+	Scatter    *scatter;
+	Gather	   *gather;
+	AttrNumber *fragcol;
+	Oid		   *fragfunc;
+	List	   *tlist = NIL;
+	int			i;
+
+	/* The exchange tuples look like the rows of the relation */
+	for (i = 0; i < tupDesc->natts; i++)
+	{
+		Form_pg_attribute att = tupDesc->attrs[i];
+		Expr	   *expr;
+
+		if (att->attisdropped)
+			expr = (Expr *) makeNullConst(INT4OID, -1);	/* always NULL */
+		else
+			expr = (Expr *) makeVar(1, att->attnum, att->atttypid,
+									att->atttypmod, 0);
+		tlist = lappend(tlist, makeTargetEntry(expr, att->attnum, NULL, false));
+	}
+	rows = (Plan *) makeNode(Result);
+	rows->targetlist = tlist;
+
+	fragcol = (AttrNumber *) palloc(sizeof(AttrNumber));
+	fragcol[0] = fragatno;
+	fragfunc = (Oid *) palloc(sizeof(Oid));
+	fragfunc[0] = get_type_hash_function(tupDesc->attrs[fragatno - 1]->atttypid);
+	scatter = make_scatter(rows, PAR_COPY_PORT, 1, fragcol, fragfunc);
+	scatter->toFragments = true;
+	scatter->fragScheme = get_relid_fragscheme(RelationGetRelid(cstate->rel));
+	gather = make_gather(rows, PAR_COPY_PORT);
+
+	estate->es_tupleTable =
+		ExecCreateTupleTable(ExecCountSlotsNode((Plan *) scatter) +
+							 ExecCountSlotsNode((Plan *) gather));
+
+	router = (CopyRouter *) palloc(sizeof(CopyRouter));
+	router->scatter = (ScatterState *) ExecInitNode((Plan *) scatter, estate, 0);
+	router->gather = (GatherState *) ExecInitNode((Plan *) gather, estate, 0);
+	router->gathered = false;
+	return router;
+}
+
+/*
+ * PargreSQL: inserts the rows that have come from the other nodes, and
+ * keeps sending the rows of the Scatter until it has sent them all.
+ * With 'finish', also waits for the other nodes to send all their rows.
+ */
+static void
+CopyExchange(CopyState cstate, CopyRouter *router, CopyInsertState *ins,
+			 bool finish)
+{
+	for (;;)
+	{
+		bool		moved = false;
+		TupleTableSlot *slot;
+
+		while (!router->gathered)
+		{
+			slot = ExecProcNode((PlanState *) router->gather);
+			if (!TupIsNull(slot))
+			{
+				MemoryContext oldcontext;
+				HeapTuple	tuple;
+
+				ResetPerTupleExprContext(ins->estate);
+				oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(ins->estate));
+				tuple = ExecCopySlotTuple(slot);
+				MemoryContextSwitchTo(oldcontext);
+				CopyInsertTuple(cstate, ins, tuple);
+			}
+			else if (router->gather->status == PAR_OK)
+				router->gathered = true;	/* all the EOFs are in */
+			else if (router->gather->status == PAR_WAIT)
+				break;
+			moved = true;
+		}
+
+		if (router->scatter->isSending)
+		{
+			ExecProcNode((PlanState *) router->scatter);
+			if (!router->scatter->isSending)
+				moved = true;
+		}
+
+		if (!router->scatter->isSending && (!finish || router->gathered))
+			return;
+
+		if (!moved)
+		{
+			/* Everything waits for the messages */
+			_pargresql_Wait(100); // FIXME: INIS naming
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+}
+
+static void
+CopyEndRouter(CopyRouter *router)
+{
+	ExecEndNode((PlanState *) router->scatter);
+	ExecEndNode((PlanState *) router->gather);
+	pfree(router);
+}
+
 /*
  * Copy FROM file to relation.
  */
@@ -1672,6 +1897,11 @@ CopyFrom(CopyState cstate)
 	CommandId	mycid = GetCurrentCommandId(true);
 	int			hi_options = 0; /* start with default heap_insert options */
 	BulkInsertState bistate;
+	CopyInsertState ins;
+	CopyRouter *router = NULL;
+	AttrNumber	fragatno;
+	bool		noinput = false;	/* true if another node reads the input */
+	int			me = _pargresql_GetNode(); // FIXME: INIS naming
 
 	Assert(cstate->rel);
 
@@ -1729,14 +1959,37 @@ CopyFrom(CopyState cstate)
 			hi_options |= HEAP_INSERT_SKIP_WAL;
 	}
 
+	/* PargreSQL: route the rows of a fragmented relation to their nodes */
+	fragatno = get_relid_fragatno(RelationGetRelid(cstate->rel));
+	if (fragatno > 0 && _pargresql_GetNodesCount() > 1) // FIXME: INIS naming
+	{
+		if (cstate->oids)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY FROM WITH OIDS is not supported for fragmented relation \"%s\"",
+							RelationGetRelationName(cstate->rel))));
+		noinput = (me != PAR_COPY_READER);
+		if (noinput && pipe && whereToSendOutput == DestRemote &&
+			PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY FROM STDIN of fragmented relation \"%s\" requires protocol 3",
+							RelationGetRelationName(cstate->rel))));
+	}
+	else
+		fragatno = InvalidAttrNumber;
+
 	if (pipe)
 	{
 		if (whereToSendOutput == DestRemote)
 			ReceiveCopyBegin(cstate);
 		else
 			cstate->copy_file = stdin;
+		/* PargreSQL: the data goes to PAR_COPY_READER only */
+		if (noinput)
+			CopyDrainInput(cstate);
 	}
-	else
+	else if (!noinput)
 	{
 		struct stat st;
 
@@ -1840,7 +2093,7 @@ CopyFrom(CopyState cstate)
 	 */
 	ExecBSInsertTriggers(estate, resultRelInfo);
 
-	if (!cstate->binary)
+	if (!cstate->binary || noinput)
 		file_has_oids = cstate->oids;	/* must rely on user to tell us... */
 	else
 	{
@@ -1905,6 +2158,17 @@ CopyFrom(CopyState cstate)
 
 	bistate = GetBulkInsertState();
 
+	ins.estate = estate;
+	ins.slot = slot;
+	ins.mycid = mycid;
+	ins.hi_options = hi_options;
+	ins.bistate = bistate;
+
+	if (AttributeNumberIsValid(fragatno))
+		router = CopyStartRouter(cstate, estate, fragatno);
+	if (noinput)
+		done = true;
+
 	/* Set up callback to identify error line number */
 	errcontext.callback = copy_in_error_callback;
 	errcontext.arg = (void *) cstate;
@@ -1912,7 +2176,7 @@ CopyFrom(CopyState cstate)
 	error_context_stack = &errcontext;
 
 	/* on input just throw the header line away */
-	if (cstate->header_line)
+	if (cstate->header_line && !noinput)
 	{
 		cstate->cur_lineno++;
 		done = CopyReadLine(cstate);
@@ -1920,7 +2184,6 @@ CopyFrom(CopyState cstate)
 
 	while (!done)
 	{
-		bool		skip_tuple;
 		Oid			loaded_oid = InvalidOid;
 
 		CHECK_FOR_INTERRUPTS();
@@ -2098,50 +2361,34 @@ CopyFrom(CopyState cstate)
 		/* Triggers and stuff need to be invoked in query context. */
 		MemoryContextSwitchTo(oldcontext);
 
-		skip_tuple = false;
-
-		/* BEFORE ROW INSERT Triggers */
-		if (resultRelInfo->ri_TrigDesc &&
-		  resultRelInfo->ri_TrigDesc->n_before_row[TRIGGER_EVENT_INSERT] > 0)
+		if (router != NULL)
 		{
-			HeapTuple	newtuple;
-
-			newtuple = ExecBRInsertTriggers(estate, resultRelInfo, tuple);
+			/* PargreSQL: the row may belong to another node */
+			int			dst;
 
-			if (newtuple == NULL)		/* "do nothing" */
-				skip_tuple = true;
-			else if (newtuple != tuple) /* modified by Trigger(s) */
+			ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+			dst = scatter_route(router->scatter, slot);
+			if (dst != me)
 			{
-				heap_freetuple(tuple);
-				tuple = newtuple;
+				router->scatter->upstreamTuple = slot;
+				router->scatter->upstreamDst = dst;
+				ExecProcNode((PlanState *) router->scatter);
 			}
+			else
+				CopyInsertTuple(cstate, &ins, tuple);
+			CopyExchange(cstate, router, &ins, false);
 		}
+		else
+			CopyInsertTuple(cstate, &ins, tuple);
+	}
 
-		if (!skip_tuple)
-		{
-			/* Place tuple in tuple slot */
-			ExecStoreTuple(tuple, slot, InvalidBuffer, false);
-
-			/* Check the constraints of the tuple */
-			if (cstate->rel->rd_att->constr)
-				ExecConstraints(resultRelInfo, slot, estate);
-
-			/* OK, store the tuple and create index entries for it */
-			heap_insert(cstate->rel, tuple, mycid, hi_options, bistate);
-
-			if (resultRelInfo->ri_NumIndices > 0)
-				ExecInsertIndexTuples(slot, &(tuple->t_self), estate, false);
-
-			/* AFTER ROW INSERT Triggers */
-			ExecARInsertTriggers(estate, resultRelInfo, tuple);
-
-			/*
-			 * We count only tuples not suppressed by a BEFORE INSERT trigger;
-			 * this is the same definition used by execMain.c for counting
-			 * tuples inserted by an INSERT command.
-			 */
-			cstate->processed++;
-		}
+	if (router != NULL)
+	{
+		/* Tell the others there will be no more rows, and get the rest */
+		router->scatter->upstreamTuple = NULL;
+		ExecProcNode((PlanState *) router->scatter);
+		CopyExchange(cstate, router, &ins, true);
+		CopyEndRouter(router);
 	}
 
 	/* Done, clean up */
@@ -2170,9 +2417,12 @@ CopyFrom(CopyState cstate)
 
 	ExecCloseIndices(resultRelInfo);
 
+	if (estate->es_tupleTable != NULL)
+		ExecDropTupleTable(estate->es_tupleTable, true);
+
 	FreeExecutorState(estate);
 
-	if (!pipe)
+	if (!pipe && !noinput)
 	{
 		if (FreeFile(cstate->copy_file))
 			ereport(ERROR,
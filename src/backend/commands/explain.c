@@ -20,6 +20,7 @@
 #include "commands/prepare.h"
 #include "commands/trigger.h"
 #include "executor/instrument.h"
+#include "executor/par_instrument.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
 #include "optimizer/var.h"
@@ -31,6 +32,7 @@
 #include "utils/lsyscache.h"
 #include "utils/tuplesort.h"
 #include "utils/snapmgr.h"
+#include "par_parallelizer/par_fragment.h"
 
 
 /* Hook for plugins to get control in ExplainOneQuery() */
@@ -48,6 +50,7 @@ typedef struct ExplainState
 	/* other states */
 	PlannedStmt *pstmt;			/* top of plan */
 	List	   *rtable;			/* range table */
+	ParClusterInstr *cluster;	/* instrumentation of all the PargreSQL nodes */
 } ExplainState;
 
 static void ExplainOneQuery(Query *query, ExplainStmt *stmt,
@@ -56,6 +59,8 @@ static void ExplainOneQuery(Query *query, ExplainStmt *stmt,
 static void report_triggers(ResultRelInfo *rInfo, bool show_relname,
 				StringInfo buf);
 static double elapsed_time(instr_time *starttime);
+static void explain_print_plan(StringInfo str, QueryDesc *queryDesc,
+				   bool analyze, bool verbose, ParClusterInstr *cluster);
 static void explain_outNode(StringInfo str,
 				Plan *plan, PlanState *planstate,
 				Plan *outer_plan,
@@ -67,11 +72,20 @@ static void show_scan_qual(List *qual, const char *qlabel,
 			   StringInfo str, int indent, ExplainState *es);
 static void show_upper_qual(List *qual, const char *qlabel, Plan *plan,
 				StringInfo str, int indent, ExplainState *es);
-static void show_sort_keys(Plan *sortplan, int nkeys, AttrNumber *keycols,
+static void show_sort_keys(Plan *sortplan, Plan *outer_plan,
+			   int nkeys, AttrNumber *keycols,
 			   const char *qlabel,
 			   StringInfo str, int indent, ExplainState *es);
 static void show_sort_info(SortState *sortstate,
 			   StringInfo str, int indent, ExplainState *es);
+static void show_merge_info(MergeState *mergestate,
+				StringInfo str, int indent, ExplainState *es);
+static void show_scatter_info(ScatterState *scatterstate,
+				  StringInfo str, int indent, ExplainState *es);
+static void show_gather_info(GatherState *gatherstate,
+				 StringInfo str, int indent, ExplainState *es);
+static void show_cluster_info(PlanState *planstate,
+				  StringInfo str, int indent, ExplainState *es);
 static const char *explain_get_index_name(Oid indexId);
 
 
@@ -227,6 +241,7 @@ ExplainOnePlan(PlannedStmt *plannedstmt, ExplainStmt *stmt,
 	double		totaltime = 0;
 	StringInfoData buf;
 	int			eflags;
+	ParClusterInstr *cluster = NULL;
 
 	/*
 	 * Use a snapshot with an updated command ID to ensure this query sees
@@ -265,9 +280,18 @@ ExplainOnePlan(PlannedStmt *plannedstmt, ExplainStmt *stmt,
 		totaltime += elapsed_time(&starttime);
 	}
 
+	/*
+	 * PargreSQL: every node explains the same plan, node 0 shows them all.
+	 * The collection waits for every node, so it is done here, on the path
+	 * every node takes, and not in ExplainPrintPlan, which auto_explain
+	 * calls on some of the nodes only.
+	 */
+	if (stmt->analyze && _pargresql_GetNodesCount() > 1)	/* FIXME: INIS naming */
+		cluster = par_instr_collect(queryDesc->planstate);
+
 	/* Create textual dump of plan tree */
 	initStringInfo(&buf);
-	ExplainPrintPlan(&buf, queryDesc, stmt->analyze, stmt->verbose);
+	explain_print_plan(&buf, queryDesc, stmt->analyze, stmt->verbose, cluster);
 
 	/*
 	 * If we ran the command, run any AFTER triggers it queued.  (Note this
@@ -341,6 +365,18 @@ ExplainOnePlan(PlannedStmt *plannedstmt, ExplainStmt *stmt,
 void
 ExplainPrintPlan(StringInfo str, QueryDesc *queryDesc,
 				 bool analyze, bool verbose)
+{
+	explain_print_plan(str, queryDesc, analyze, verbose, NULL);
+}
+
+/*
+ * explain_print_plan -
+ *	  the same as ExplainPrintPlan, with the instrumentation of all the
+ *	  PargreSQL nodes if 'cluster' is given
+ */
+static void
+explain_print_plan(StringInfo str, QueryDesc *queryDesc,
+				   bool analyze, bool verbose, ParClusterInstr *cluster)
 {
 	ExplainState es;
 
@@ -351,6 +387,7 @@ ExplainPrintPlan(StringInfo str, QueryDesc *queryDesc,
 	es.printAnalyze = analyze;
 	es.pstmt = queryDesc->plannedstmt;
 	es.rtable = queryDesc->plannedstmt->rtable;
+	es.cluster = cluster;
 
 	explain_outNode(str,
 					queryDesc->plannedstmt->planTree, queryDesc->planstate,
@@ -651,6 +688,24 @@ explain_outNode(StringInfo str,
 		case T_Hash:
 			pname = "Hash";
 			break;
+		case T_Split:
+			pname = "Split";
+			break;
+		case T_Merge:
+			if (((Merge *) plan)->numCols > 0)
+				pname = "Ordered Merge";
+			else
+				pname = "Merge";
+			break;
+		case T_Scatter:
+			if (((Scatter *) plan)->broadcast)
+				pname = "Broadcast Scatter";
+			else
+				pname = "Scatter";
+			break;
+		case T_Gather:
+			pname = "Gather";
+			break;
 		default:
 			pname = "???";
 			break;
@@ -786,6 +841,16 @@ explain_outNode(StringInfo str,
 									 quote_identifier(rte->eref->aliasname));
 			}
 			break;
+		case T_Merge:
+			appendStringInfo(str, " on port %d",
+							 ((Gather *) outerPlan(plan))->port);
+			break;
+		case T_Scatter:
+			appendStringInfo(str, " on port %d", ((Scatter *) plan)->port);
+			break;
+		case T_Gather:
+			appendStringInfo(str, " on port %d", ((Gather *) plan)->port);
+			break;
 		default:
 			break;
 	}
@@ -815,6 +880,9 @@ explain_outNode(StringInfo str,
 		appendStringInfo(str, " (never executed)");
 	appendStringInfoChar(str, '\n');
 
+	if (es->cluster)
+		show_cluster_info(planstate, str, indent, es);
+
 	/* target list */
 	if (es->printTList)
 		show_plan_tlist(plan, str, indent, es);
@@ -926,7 +994,7 @@ explain_outNode(StringInfo str,
 							str, indent, es);
 			break;
 		case T_Sort:
-			show_sort_keys(plan,
+			show_sort_keys(plan, NULL,
 						   ((Sort *) plan)->numCols,
 						   ((Sort *) plan)->sortColIdx,
 						   "Sort Key",
@@ -934,6 +1002,30 @@ explain_outNode(StringInfo str,
 			show_sort_info((SortState *) planstate,
 						   str, indent, es);
 			break;
+		case T_Merge:
+			/* the keys refer to the output of the Split */
+			show_sort_keys(plan, innerPlan(plan),
+						   ((Merge *) plan)->numCols,
+						   ((Merge *) plan)->sortColIdx,
+						   "Merge Key",
+						   str, indent, es);
+			show_merge_info((MergeState *) planstate,
+							str, indent, es);
+			break;
+		case T_Scatter:
+			/* the keys refer to the input of the Split, our outer_plan */
+			show_sort_keys(plan, outer_plan,
+						   ((Scatter *) plan)->numCols,
+						   ((Scatter *) plan)->fragColIdx,
+						   "Hash Key",
+						   str, indent, es);
+			show_scatter_info((ScatterState *) planstate,
+							  str, indent, es);
+			break;
+		case T_Gather:
+			show_gather_info((GatherState *) planstate,
+							 str, indent, es);
+			break;
 		case T_Result:
 			show_upper_qual((List *) ((Result *) plan)->resconstantqual,
 							"One-Time Filter", plan,
@@ -1249,7 +1341,8 @@ show_upper_qual(List *qual, const char *qlabel, Plan *plan,
  * Show the sort keys for a Sort node.
  */
 static void
-show_sort_keys(Plan *sortplan, int nkeys, AttrNumber *keycols,
+show_sort_keys(Plan *sortplan, Plan *outer_plan,
+			   int nkeys, AttrNumber *keycols,
 			   const char *qlabel,
 			   StringInfo str, int indent, ExplainState *es)
 {
@@ -1268,7 +1361,7 @@ show_sort_keys(Plan *sortplan, int nkeys, AttrNumber *keycols,
 
 	/* Set up deparsing context */
 	context = deparse_context_for_plan((Node *) sortplan,
-									   NULL,
+									   (Node *) outer_plan,
 									   es->rtable,
 									   es->pstmt->subplans);
 	useprefix = list_length(es->rtable) > 1;
@@ -1315,6 +1408,185 @@ show_sort_info(SortState *sortstate,
 	}
 }
 
+/*
+ * If it's EXPLAIN ANALYZE, show how long a PargreSQL Merge has waited
+ * for the messages of its exchange
+ */
+static void
+show_merge_info(MergeState *mergestate,
+				StringInfo str, int indent, ExplainState *es)
+{
+	int			i;
+
+	if (!es->printAnalyze || mergestate->waits == 0)
+		return;
+
+	for (i = 0; i < indent; i++)
+		appendStringInfo(str, "  ");
+	appendStringInfo(str, "  Blocked: %.3f ms in %ld waits\n",
+					 1000.0 * mergestate->waittime, mergestate->waits);
+}
+
+/*
+ * Show where a PargreSQL Scatter sends the tuples, and, if it's EXPLAIN
+ * ANALYZE, how many of them have gone to every node
+ */
+static void
+show_scatter_info(ScatterState *scatterstate,
+				  StringInfo str, int indent, ExplainState *es)
+{
+	Scatter    *scatter = (Scatter *) scatterstate->ps.plan;
+	int			size = _pargresql_GetNodesCount(); /* FIXME: INIS naming */
+	int			rank = _pargresql_GetNode(); /* FIXME: INIS naming */
+	int			dst;
+	int			i;
+
+	for (i = 0; i < indent; i++)
+		appendStringInfo(str, "  ");
+	appendStringInfo(str, "  Distribution: ");
+	if (scatter->broadcast)
+		appendStringInfo(str, "every node");
+	else if (scatter->numCols == 0)
+		appendStringInfo(str, "node 0");
+	else if (scatter->fragScheme != NULL)
+		appendStringInfo(str, "fragments by %s",
+						 scatter->fragScheme->method == PAR_FRAG_RANGE ?
+						 "range" : "list");
+	else if (scatter->toFragments)
+		appendStringInfo(str, "fragments by hash");
+	else
+		appendStringInfo(str, "hash");
+	if (scatter->skew != PAR_SKEW_NONE)
+		appendStringInfo(str, ", %d hot keys %s", scatter->numHot,
+						 scatter->skew == PAR_SKEW_SPREAD ?
+						 "spread" : "broadcast");
+	if (scatter->cancelable)
+		appendStringInfo(str, ", cancelable");
+	if (scatter->joinFilter)
+		appendStringInfo(str, ", join filter");
+	appendStringInfoChar(str, '\n');
+
+	if (!es->printAnalyze)
+		return;
+
+	for (dst = 0; dst < size; dst++)
+	{
+		if (scatterstate->routed[dst] == 0 && scatterstate->sentframes[dst] == 0)
+			continue;
+		for (i = 0; i < indent; i++)
+			appendStringInfo(str, "  ");
+		if (dst == rank)
+			appendStringInfo(str, "  Kept: %ld tuples\n",
+							 scatterstate->routed[dst]);
+		else
+			appendStringInfo(str, "  Sent to node %d: %ld tuples, %ld messages, %ld bytes\n",
+							 dst, scatterstate->routed[dst],
+							 scatterstate->sentframes[dst],
+							 scatterstate->sentbytes[dst]);
+	}
+	if (scatterstate->hot > 0)
+	{
+		for (i = 0; i < indent; i++)
+			appendStringInfo(str, "  ");
+		appendStringInfo(str, "  Hot Key Tuples: %ld\n", scatterstate->hot);
+	}
+	if (scatter->joinFilter)
+	{
+		for (i = 0; i < indent; i++)
+			appendStringInfo(str, "  ");
+		appendStringInfo(str, "  Filtered Out: %ld tuples\n", scatterstate->filtered);
+	}
+}
+
+/*
+ * If it's EXPLAIN ANALYZE, show how many tuples a PargreSQL Gather has
+ * got from every node
+ */
+static void
+show_gather_info(GatherState *gatherstate,
+				 StringInfo str, int indent, ExplainState *es)
+{
+	int			size = _pargresql_GetNodesCount(); /* FIXME: INIS naming */
+	int			src;
+	int			i;
+
+	if (!es->printAnalyze)
+		return;
+
+	for (src = 0; src < size; src++)
+	{
+		if (gatherstate->recvframes[src] == 0)
+			continue;
+		for (i = 0; i < indent; i++)
+			appendStringInfo(str, "  ");
+		appendStringInfo(str, "  Received from node %d: %ld tuples, %ld messages, %ld bytes\n",
+						 src, gatherstate->recvtuples[src],
+						 gatherstate->recvframes[src],
+						 gatherstate->recvbytes[src]);
+	}
+}
+
+/*
+ * Show the spread of the actual rows and times of a plan node over the
+ * PargreSQL nodes, and the slowest node
+ */
+static void
+show_cluster_info(PlanState *planstate,
+				  StringInfo str, int indent, ExplainState *es)
+{
+	ParClusterInstr *cluster = es->cluster;
+	double		minrows = 0,
+				maxrows = 0,
+				sumrows = 0;
+	double		mintime = 0,
+				maxtime = 0,
+				sumtime = 0;
+	int			executed = 0;
+	int			slowest = -1;
+	int			node;
+	int			i;
+
+	for (node = 0; node < cluster->nnodes; node++)
+	{
+		ParInstrRecord *rec = par_instr_lookup(cluster, planstate, node);
+		double		rows,
+					time;
+
+		if (rec == NULL)
+			return;
+		if (rec->nloops <= 0)
+			continue;
+
+		rows = rec->ntuples / rec->nloops;
+		time = 1000.0 * rec->total / rec->nloops;
+		if (executed == 0 || rows < minrows)
+			minrows = rows;
+		if (executed == 0 || rows > maxrows)
+			maxrows = rows;
+		if (executed == 0 || time < mintime)
+			mintime = time;
+		if (executed == 0 || time > maxtime)
+		{
+			maxtime = time;
+			slowest = node;
+		}
+		sumrows += rows;
+		sumtime += time;
+		executed++;
+	}
+	if (executed == 0)
+		return;
+
+	for (i = 0; i < indent; i++)
+		appendStringInfo(str, "  ");
+	appendStringInfo(str, "  Nodes: rows=%.0f/%.0f/%.0f time=%.3f/%.3f/%.3f ms (min/avg/max), slowest %d",
+					 minrows, sumrows / executed, maxrows,
+					 mintime, sumtime / executed, maxtime, slowest);
+	if (executed < cluster->nnodes)
+		appendStringInfo(str, ", executed on %d of %d", executed, cluster->nnodes);
+	appendStringInfoChar(str, '\n');
+}
+
 /*
  * Fetch the name of an index in an EXPLAIN
  *
@@ -31,6 +31,7 @@
 #include "executor/instrument.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "executor/par_bloom.h"
 #include "miscadmin.h"
 #include "parser/parse_expr.h"
 #include "utils/dynahash.h"
@@ -123,9 +124,15 @@ MultiExecHash(HashState *node)
 				ExecHashTableInsert(hashtable, slot, hashvalue);
 			}
 			hashtable->totalTuples += 1;
+			if (node->bloom)
+				par_bloom_add(node->bloom, hashvalue);
 		}
 	}
 
+	/* PargreSQL: the other nodes may filter their tuples for us now */
+	if (node->bloom)
+		par_bloom_send(node->bloom, true);
+
 	/* must provide our own instrumentation support */
 	if (node->ps.instrument)
 		InstrStopNode(node->ps.instrument, hashtable->totalTuples);
@@ -162,6 +169,7 @@ ExecInitHash(Hash *node, EState *estate, int eflags)
 	hashstate->ps.state = estate;
 	hashstate->hashtable = NULL;
 	hashstate->hashkeys = NIL;	/* will be set by parent HashJoin */
+	hashstate->bloom = NULL;	/* so will this */
 
 	/*
 	 * Miscellaneous initialization
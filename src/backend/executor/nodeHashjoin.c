@@ -19,6 +19,7 @@
 #include "executor/hashjoin.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
+#include "executor/par_bloom.h"
 #include "utils/memutils.h"
 
 
@@ -132,6 +133,9 @@ ExecHashJoin(HashJoinState *node)
 			if (TupIsNull(node->hj_FirstOuterTupleSlot))
 			{
 				node->hj_OuterNotEmpty = false;
+				/* PargreSQL: nobody has to wait for our filter */
+				if (node->hj_Bloom)
+					par_bloom_send(node->hj_Bloom, false);
 				return NULL;
 			}
 			else
@@ -491,6 +495,27 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	hjstate->hj_MatchedOuter = false;
 	hjstate->hj_OuterNotEmpty = false;
 
+	/*
+	 * PargreSQL: filter the outer exchange by the hash tables of the nodes
+	 * it sends the tuples to, if the parallelizer has asked for it
+	 */
+	hjstate->hj_Bloom = NULL;
+	if (IsA(outerPlanState(hjstate), MergeState) &&
+		!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+	{
+		PlanState  *split = innerPlanState(outerPlanState(hjstate));
+		ScatterState *scatter = (ScatterState *) innerPlanState(split);
+		Scatter    *plan = (Scatter *) scatter->ps.plan;
+
+		if (plan->joinFilter)
+		{
+			hjstate->hj_Bloom = par_bloom_create(hjstate, plan->port,
+												 hashNode->plan.plan_rows);
+			((HashState *) innerPlanState(hjstate))->bloom = hjstate->hj_Bloom;
+			scatter->bloom = hjstate->hj_Bloom;
+		}
+	}
+
 	return hjstate;
 }
 
@@ -537,6 +562,10 @@ ExecEndHashJoin(HashJoinState *node)
 	 */
 	ExecEndNode(outerPlanState(node));
 	ExecEndNode(innerPlanState(node));
+
+	/* PargreSQL: the filters are exchanged even if nothing was joined */
+	if (node->hj_Bloom)
+		par_bloom_finish(node->hj_Bloom);
 }
 
 /*
@@ -886,6 +915,10 @@ ExecReScanHashJoin(HashJoinState *node, ExprContext *exprCtxt)
 			ExecHashTableDestroy(node->hj_HashTable);
 			node->hj_HashTable = NULL;
 
+			/* PargreSQL: and the filters of the old ones are no good */
+			if (node->hj_Bloom)
+				par_bloom_disable(node->hj_Bloom);
+
 			/*
 			 * if chgParam of subnode is not null then plan will be re-scanned
 			 * by first ExecProcNode.
@@ -25,6 +25,7 @@
 #include "postgres.h"
 
 #include "access/heapam.h"
+#include "access/par_coopscan.h"
 #include "access/relscan.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
@@ -156,6 +157,10 @@ InitScanRelation(SeqScanState *node, EState *estate)
 									 0,
 									 NULL);
 
+	/* PargreSQL: the other ranks of the fragment read the rest of it */
+	if (((SeqScan *) node->ps.plan)->cooperative)
+		par_coopscan_begin(currentScanDesc);
+
 	node->ss_currentRelation = currentRelation;
 	node->ss_currentScanDesc = currentScanDesc;
 
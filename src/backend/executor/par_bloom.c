@@ -0,0 +1,326 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_bloom.c
+ *	  The bloom filters of the PargreSQL hash joins (see par_bloom.h).
+ *
+ * A filter is PAR_BLOOM_HASHES bits per hash value out of nbits, which
+ * are taken from the hash value the hash join computes for the tuple,
+ * by double hashing. The message of a filter is its int32 size in bits
+ * followed by the bits, or just a zero size if there is no filter.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/par_bloom.h"
+#include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+#define PAR_BLOOM_HASHES	3
+#define PAR_BLOOM_HEADER	sizeof(int32)
+#define PAR_BLOOM_TIMEOUT	600		/* seconds to wait for the others at the end */
+
+/* GUC variable */
+bool		par_join_filters = true;
+
+static bool bloom_wait(_pargresql_request_t *request, int *pending,
+		   TimestampTz start);
+
+/*
+ * The i-th bit of the hash value in a filter of nbits bits.
+ */
+static inline uint32
+bloom_bit(uint32 hashvalue, int i, int nbits)
+{
+	uint32		step = ((hashvalue >> 16) | (hashvalue << 16)) | 1;
+
+	return (hashvalue + i * step) & (nbits - 1);
+}
+
+/*
+ * Sets up the filter of the hash join, with room for about 'rows' inner
+ * tuples, and starts listening to the filters of the other nodes.
+ */
+ParBloom *
+par_bloom_create(HashJoinState *hjstate, int port, double rows)
+{
+	ParBloom   *bloom;
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	ListCell   *lc;
+	int			i;
+
+	bloom = (ParBloom *) palloc0(sizeof(ParBloom));
+	bloom->port = PAR_BLOOM_PORT(port);
+
+	/* About 8 bits per value, which is a few per cent of false positives */
+	bloom->nbits = PAR_BLOOM_MINBITS;
+	while (bloom->nbits < PAR_BLOOM_MAXBITS && bloom->nbits < rows * 8)
+		bloom->nbits *= 2;
+	bloom->bits = (bits8 *) palloc0(bloom->nbits / 8);
+
+	/* The outer side is hashed the way the hash join does it */
+	bloom->outerkeys = hjstate->hj_OuterHashKeys;
+	bloom->numkeys = list_length(hjstate->hj_HashOperators);
+	bloom->hashfunctions = (FmgrInfo *) palloc(bloom->numkeys * sizeof(FmgrInfo));
+	bloom->hashStrict = (bool *) palloc(bloom->numkeys * sizeof(bool));
+	i = 0;
+	foreach(lc, hjstate->hj_HashOperators)
+	{
+		Oid			hashop = lfirst_oid(lc);
+		Oid			left_hashfn;
+		Oid			right_hashfn;
+
+		if (!get_op_hash_functions(hashop, &left_hashfn, &right_hashfn))
+			elog(ERROR, "could not find hash function for hash operator %u",
+				 hashop);
+		fmgr_info(left_hashfn, &bloom->hashfunctions[i]);
+		bloom->hashStrict[i] = op_strict(hashop);
+		i++;
+	}
+
+	bloom->sendreqs = (_pargresql_request_t *) palloc(size * sizeof(_pargresql_request_t));
+	bloom->sending = (int *) palloc0(size * sizeof(int));
+	bloom->bufs = (char **) palloc0(size * sizeof(char *));
+	bloom->recvreqs = (_pargresql_request_t *) palloc(size * sizeof(_pargresql_request_t));
+	bloom->receiving = (int *) palloc0(size * sizeof(int));
+	bloom->nodebits = (int *) palloc0(size * sizeof(int));
+	for (i = 0; i < size; i++)
+	{
+		if (i == rank)
+			continue;
+		bloom->bufs[i] = (char *) palloc(PAR_BLOOM_HEADER + PAR_BLOOM_MAXBITS / 8);
+		_pargresql_IRecv(i, bloom->port, PAR_BLOOM_HEADER + PAR_BLOOM_MAXBITS / 8,
+						 bloom->bufs[i], &bloom->recvreqs[i]); // FIXME: INIS naming
+		bloom->receiving[i] = 1;
+	}
+
+	return bloom;
+}
+
+/*
+ * Adds the hash value of an inner tuple to our filter.
+ */
+void
+par_bloom_add(ParBloom *bloom, uint32 hashvalue)
+{
+	int			i;
+
+	if (bloom->sent)
+		return;					/* rebuilt on a rescan, too late */
+	for (i = 0; i < PAR_BLOOM_HASHES; i++)
+	{
+		uint32		bit = bloom_bit(hashvalue, i, bloom->nbits);
+
+		bloom->bits[bit >> 3] |= 1 << (bit & 7);
+	}
+	bloom->added += 1;
+}
+
+/*
+ * Sends our filter to the other nodes, once. If the hash table has not
+ * been 'built', or the filter has too many values to filter anything
+ * out, they get an empty message and let everything through.
+ */
+void
+par_bloom_send(ParBloom *bloom, bool built)
+{
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	int32		nbits = bloom->nbits;
+	char	   *msg;
+	int			len;
+	int			i;
+
+	if (bloom->sent)
+		return;
+
+	if (!built || bloom->added * 2 > bloom->nbits)
+		nbits = 0;
+	len = PAR_BLOOM_HEADER + nbits / 8;
+	msg = (char *) palloc(len);
+	memcpy(msg, &nbits, PAR_BLOOM_HEADER);
+	memcpy(msg + PAR_BLOOM_HEADER, bloom->bits, nbits / 8);
+
+	elog(DEBUG5, "bloom(port=%d): sending a filter of %d bits with %.0f values",
+		 bloom->port, nbits, bloom->added);
+	for (i = 0; i < size; i++)
+	{
+		if (i == rank)
+			continue;
+		_pargresql_ISend(i, bloom->port, len, msg, &bloom->sendreqs[i]); // FIXME: INIS naming
+		bloom->sending[i] = 1;
+	}
+
+	// INIS has copied the message, and we do not filter our own tuples
+	pfree(msg);
+	pfree(bloom->bits);
+	bloom->bits = NULL;
+	bloom->sent = true;
+}
+
+/*
+ * Computes the hash value of the outer tuple the way the hash join does.
+ * Returns false if the tuple cannot match anything, because of a NULL.
+ */
+bool
+par_bloom_hash(ParBloom *bloom, ExprContext *econtext,
+			   TupleTableSlot *slot, uint32 *hashvalue)
+{
+	uint32		hashkey = 0;
+	ListCell   *hk;
+	int			i = 0;
+	MemoryContext oldContext;
+
+	ResetExprContext(econtext);
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	econtext->ecxt_outertuple = slot;
+
+	foreach(hk, bloom->outerkeys)
+	{
+		ExprState  *keyexpr = (ExprState *) lfirst(hk);
+		Datum		keyval;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		keyval = ExecEvalExpr(keyexpr, econtext, &isNull, NULL);
+		if (isNull)
+		{
+			if (bloom->hashStrict[i])
+			{
+				MemoryContextSwitchTo(oldContext);
+				return false;
+			}
+		}
+		else
+			hashkey ^= DatumGetUInt32(FunctionCall1(&bloom->hashfunctions[i], keyval));
+		i++;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	*hashvalue = hashkey;
+	return true;
+}
+
+/*
+ * Returns true if the hash table of the node surely has nothing with the
+ * hash value. Returns false if its filter has not come yet.
+ */
+bool
+par_bloom_rejects(ParBloom *bloom, int node, uint32 hashvalue)
+{
+	bits8	   *bits;
+	int			nbits;
+	int			i;
+
+	if (bloom->disabled)
+		return false;
+
+	if (bloom->receiving[node])
+	{
+		int			flag;
+
+		_pargresql_Test(&bloom->recvreqs[node], &flag); // FIXME: INIS naming
+		if (!flag)
+			return false;
+		bloom->receiving[node] = 0;
+		memcpy(&bloom->nodebits[node], bloom->bufs[node], PAR_BLOOM_HEADER);
+		elog(DEBUG5, "bloom(port=%d): got a filter of %d bits from node %d",
+			 bloom->port, bloom->nodebits[node], node);
+	}
+
+	nbits = bloom->nodebits[node];
+	if (nbits == 0)
+		return false;
+
+	bits = (bits8 *) (bloom->bufs[node] + PAR_BLOOM_HEADER);
+	for (i = 0; i < PAR_BLOOM_HASHES; i++)
+	{
+		uint32		bit = bloom_bit(hashvalue, i, nbits);
+
+		if (!(bits[bit >> 3] & (1 << (bit & 7))))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Stops the filtering, when the hash tables are built anew and the
+ * filters we have are out of date.
+ */
+void
+par_bloom_disable(ParBloom *bloom)
+{
+	bloom->disabled = true;
+}
+
+/*
+ * Waits for the message to complete, so that INIS gets its block back.
+ * A node that has failed never sends its filter, so the wait ends
+ * PAR_BLOOM_TIMEOUT seconds after 'start', and false is returned. The
+ * request given up on stays posted, as INIS cannot cancel it.
+ */
+static bool
+bloom_wait(_pargresql_request_t *request, int *pending, TimestampTz start)
+{
+	int			flag;
+
+	while (*pending)
+	{
+		_pargresql_Test(request, &flag); // FIXME: INIS naming
+		if (flag)
+			*pending = 0;
+		else if (TimestampDifferenceExceeds(start, GetCurrentTimestamp(),
+											PAR_BLOOM_TIMEOUT * 1000))
+			return false;
+		else
+		{
+			_pargresql_Wait(100); // FIXME: INIS naming
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	return true;
+}
+
+/*
+ * Sends our filter if it has not been sent yet, waits for all the
+ * messages, PAR_BLOOM_TIMEOUT seconds at most, and frees the filters.
+ */
+void
+par_bloom_finish(ParBloom *bloom)
+{
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	TimestampTz start;
+	int			i;
+
+	par_bloom_send(bloom, false);
+	start = GetCurrentTimestamp();
+	for (i = 0; i < size; i++)
+	{
+		if (i == rank)
+			continue;
+		if (!bloom_wait(&bloom->sendreqs[i], &bloom->sending[i], start)
+			|| !bloom_wait(&bloom->recvreqs[i], &bloom->receiving[i], start))
+			elog(WARNING, "bloom(port=%d): node %d has not exchanged the filters in %d seconds",
+				 bloom->port, i, PAR_BLOOM_TIMEOUT);
+		/* Test copies a message out, so the buffer is not written to any more */
+		pfree(bloom->bufs[i]);
+	}
+
+	pfree(bloom->sendreqs);
+	pfree(bloom->sending);
+	pfree(bloom->bufs);
+	pfree(bloom->recvreqs);
+	pfree(bloom->receiving);
+	pfree(bloom->nodebits);
+	pfree(bloom->hashfunctions);
+	pfree(bloom->hashStrict);
+	pfree(bloom);
+}
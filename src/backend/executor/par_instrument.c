@@ -0,0 +1,261 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_instrument.c
+ *	  The instrumentation of a plan on all the PargreSQL nodes.
+ *
+ * Every node first tells node 0 the number of its records, and node 0
+ * answers whether the trees are alike. Only then the records go to
+ * node 0 through INIS, PAR_INSTR_CHUNK of them per message, to
+ * PAR_INSTR_PORT.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/instrument.h"
+#include "executor/par_instrument.h"
+#include "executor/par_nodeMerge.h"
+#include "miscadmin.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+#define PAR_INSTR_CHUNK		(GATHER_BUFLEN / sizeof(ParInstrRecord))
+
+static void instr_drain(PlanState *planstate);
+static void instr_walk(PlanState *planstate, List **states);
+static void instr_wait(_pargresql_request_t *request);
+static bool instr_agree(int nstates);
+
+
+/*
+ * Runs the exchanges the plan has stopped reading to the end, the upper
+ * ones first. Until then, the other nodes may be unable to finish the
+ * plan and send their records.
+ */
+static void
+instr_drain(PlanState *planstate)
+{
+	List	   *states = NIL;
+	ListCell   *lc;
+
+	instr_walk(planstate, &states);
+	foreach(lc, states)
+	{
+		if (IsA(lfirst(lc), MergeState))
+			ExecMergeDrain((MergeState *) lfirst(lc));
+	}
+	list_free(states);
+}
+
+/*
+ * Lists the nodes of the plan state tree, parents before children.
+ * The bitmap scans below a BitmapHeapScan are left out: a scan excluded
+ * on some node is a Result without them there (see make_empty_scan).
+ */
+static void
+instr_walk(PlanState *planstate, List **states)
+{
+	ListCell   *lc;
+	int			i;
+
+	if (planstate == NULL)
+		return;
+
+	*states = lappend(*states, planstate);
+
+	foreach(lc, planstate->initPlan)
+		instr_walk(((SubPlanState *) lfirst(lc))->planstate, states);
+
+	if (!IsA(planstate, BitmapHeapScanState))
+		instr_walk(outerPlanState(planstate), states);
+	instr_walk(innerPlanState(planstate), states);
+
+	switch (nodeTag(planstate))
+	{
+		case T_AppendState:
+			for (i = 0; i < ((AppendState *) planstate)->as_nplans; i++)
+				instr_walk(((AppendState *) planstate)->appendplans[i], states);
+			break;
+		case T_BitmapAndState:
+			for (i = 0; i < ((BitmapAndState *) planstate)->nplans; i++)
+				instr_walk(((BitmapAndState *) planstate)->bitmapplans[i], states);
+			break;
+		case T_BitmapOrState:
+			for (i = 0; i < ((BitmapOrState *) planstate)->nplans; i++)
+				instr_walk(((BitmapOrState *) planstate)->bitmapplans[i], states);
+			break;
+		case T_SubqueryScanState:
+			instr_walk(((SubqueryScanState *) planstate)->subplan, states);
+			break;
+		default:
+			break;
+	}
+
+	foreach(lc, planstate->subPlan)
+		instr_walk(((SubPlanState *) lfirst(lc))->planstate, states);
+}
+
+/*
+ * Waits until the message has been sent or received.
+ */
+static void
+instr_wait(_pargresql_request_t *request)
+{
+	int			flag;
+
+	while (1)
+	{
+		_pargresql_Test(request, &flag); // FIXME: INIS naming
+		if (flag)
+			return;
+		_pargresql_Wait(100); // FIXME: INIS naming
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Checks that every node has as many records as node 0. Returns the
+ * same answer on all the nodes.
+ */
+static bool
+instr_agree(int nstates)
+{
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	_pargresql_request_t request;
+	int32		buf;
+	bool		agree = true;
+	int			src;
+
+	if (rank != 0)
+	{
+		buf = nstates;
+		_pargresql_ISend(0, PAR_INSTR_PORT, sizeof(buf), &buf, &request); // FIXME: INIS naming
+		instr_wait(&request);
+		_pargresql_IRecv(0, PAR_INSTR_PORT, sizeof(buf), &buf, &request); // FIXME: INIS naming
+		instr_wait(&request);
+		return buf != 0;
+	}
+
+	for (src = 1; src < size; src++)
+	{
+		_pargresql_IRecv(src, PAR_INSTR_PORT, sizeof(buf), &buf, &request); // FIXME: INIS naming
+		instr_wait(&request);
+		if (buf != nstates)
+		{
+			ereport(WARNING,
+					(errmsg("the plan of node %d has %d nodes, but the plan of node 0 has %d",
+							src, (int) buf, nstates),
+					 errdetail("The actual rows and times of the other nodes are not shown.")));
+			agree = false;
+		}
+	}
+	buf = agree;
+	for (src = 1; src < size; src++)
+	{
+		_pargresql_ISend(src, PAR_INSTR_PORT, sizeof(buf), &buf, &request); // FIXME: INIS naming
+		instr_wait(&request);
+	}
+	return agree;
+}
+
+/*
+ * Called by every node at the end of an EXPLAIN ANALYZE. Returns the
+ * records of all the nodes on node 0, and NULL on the others, or on all
+ * the nodes if their plans are not alike.
+ */
+ParClusterInstr *
+par_instr_collect(PlanState *planstate)
+{
+	int			rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int			size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	ParClusterInstr *cluster;
+	ParInstrRecord *mine;
+	_pargresql_request_t request;
+	List	   *states = NIL;
+	ListCell   *lc;
+	int			i,
+				src,
+				off,
+				n;
+
+	instr_drain(planstate);
+
+	cluster = (ParClusterInstr *) palloc(sizeof(ParClusterInstr));
+	instr_walk(planstate, &states);
+	cluster->nstates = list_length(states);
+	cluster->states = (PlanState **) palloc(cluster->nstates * sizeof(PlanState *));
+	cluster->nnodes = size;
+	cluster->records = (ParInstrRecord *)
+		palloc0(size * cluster->nstates * sizeof(ParInstrRecord));
+
+	mine = &cluster->records[rank * cluster->nstates];
+	i = 0;
+	foreach(lc, states)
+	{
+		PlanState  *ps = (PlanState *) lfirst(lc);
+
+		cluster->states[i] = ps;
+		if (ps->instrument)
+		{
+			/* the same cleanup explain_outNode does */
+			InstrEndLoop(ps->instrument);
+			mine[i].startup = ps->instrument->startup;
+			mine[i].total = ps->instrument->total;
+			mine[i].ntuples = ps->instrument->ntuples;
+			mine[i].nloops = ps->instrument->nloops;
+		}
+		i++;
+	}
+	list_free(states);
+
+	if (!instr_agree(cluster->nstates))
+	{
+		pfree(cluster->states);
+		pfree(cluster->records);
+		pfree(cluster);
+		return NULL;
+	}
+
+	for (off = 0; off < cluster->nstates; off += PAR_INSTR_CHUNK)
+	{
+		n = Min(PAR_INSTR_CHUNK, cluster->nstates - off);
+		if (rank != 0)
+		{
+			_pargresql_ISend(0, PAR_INSTR_PORT, n * sizeof(ParInstrRecord), &mine[off], &request); // FIXME: INIS naming
+			instr_wait(&request);
+			continue;
+		}
+		for (src = 1; src < size; src++)
+		{
+			_pargresql_IRecv(src, PAR_INSTR_PORT, n * sizeof(ParInstrRecord), // FIXME: INIS naming
+							 &cluster->records[src * cluster->nstates + off], &request);
+			instr_wait(&request);
+		}
+	}
+
+	if (rank != 0)
+	{
+		pfree(cluster->states);
+		pfree(cluster->records);
+		pfree(cluster);
+		return NULL;
+	}
+	return cluster;
+}
+
+/*
+ * Returns the record of the plan node on the PargreSQL node, or NULL
+ * if the plan node is not in the tree.
+ */
+ParInstrRecord *
+par_instr_lookup(ParClusterInstr *cluster, PlanState *planstate, int node)
+{
+	int			i;
+
+	for (i = 0; i < cluster->nstates; i++)
+	{
+		if (cluster->states[i] == planstate)
+			return &cluster->records[node * cluster->nstates + i];
+	}
+	return NULL;
+}
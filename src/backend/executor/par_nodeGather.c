@@ -12,8 +12,293 @@
 #include "access/par_tupack.h"
 #include "executor/executor.h"
 #include "executor/par_nodeGather.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
 #include "par_inis/_pargresql_library.h" // FIXME: INIS naming
 
+/*
+ * Posts a receive of the next frame from the node.
+ * The frames from the nodes on the same host are not
+ * received, they are read in place from the ring.
+ */
+static void
+gather_post(GatherState *node, int src)
+{
+	int port = ((Gather*)((PlanState*)node)->plan)->port;
+
+	node->remaining[src] = 0;
+	if (node->local[src])
+	{
+		return;
+	}
+	node->frames[src].data = (char*)node->bufs[src];
+	node->frames[src].len = GATHER_BUFLEN;
+	node->frames[src].maxlen = GATHER_BUFLEN;
+	node->frames[src].cursor = 0;
+	_pargresql_IRecv(src, port, GATHER_BUFLEN, node->bufs[src], &node->requests[src]); // FIXME: INIS naming
+}
+
+/*
+ * Checks whether a new frame has come from the node.
+ */
+static bool
+gather_test(GatherState *node, int src)
+{
+	int flag;
+	int port = ((Gather*)((PlanState*)node)->plan)->port;
+
+	if (node->local[src])
+	{
+		void *buf;
+		int len;
+		_pargresql_RingRecv(src, port, &buf, &len, &flag); // FIXME: INIS naming
+		if (flag)
+		{
+			node->frames[src].data = (char*)buf;
+			node->frames[src].len = len;
+			node->frames[src].maxlen = len;
+			node->frames[src].cursor = 0;
+		}
+	}
+	else
+	{
+		_pargresql_Test(&node->requests[src], &flag); // FIXME: INIS naming
+	}
+	return flag;
+}
+
+/*
+ * Gives the frame of the node back, and posts a receive
+ * of the next one.
+ */
+static void
+gather_release(GatherState *node, int src)
+{
+	int port = ((Gather*)((PlanState*)node)->plan)->port;
+
+	if (node->local[src])
+	{
+		_pargresql_RingDone(src, port); // FIXME: INIS naming
+	}
+	gather_post(node, src);
+}
+
+/*
+ * Gives back the ring frame the result slot points into, if any.
+ * Has to be done before the next tuple is got, and not earlier.
+ */
+static void
+gather_unhold(GatherState *node)
+{
+	int src = node->held;
+
+	if (src < 0)
+	{
+		return;
+	}
+	ExecClearTuple(((PlanState*)node)->ps_ResultTupleSlot);
+	node->held = -1;
+	gather_release(node, src);
+}
+
+/*
+ * Stores the MinimalTuple from a node on the same host into the result
+ * slot. With 'inplace', the tuple is not copied if it is aligned, so its
+ * frame has to stay in the ring while the slot holds it.
+ */
+static void
+gather_store_minimal(GatherState *node, int src, MinimalTuple tuple, int len, bool inplace)
+{
+	TupleTableSlot *slot = ((PlanState*)node)->ps_ResultTupleSlot;
+
+	if (len < (int) offsetof(MinimalTupleData, t_bits) || tuple->t_len != len)
+	{
+		elog(ERROR, "gather: a minimal tuple of %d bytes from node %d says it has %u", len, src, tuple->t_len);
+	}
+	if (inplace && (char *) tuple == (char *) MAXALIGN(tuple))
+	{
+		ExecStoreMinimalTuple(tuple, slot, false);
+	}
+	else
+	{
+		ExecStoreMinimalTuple(heap_copy_minimal_tuple(tuple), slot, true);
+	}
+}
+
+/*
+ * Tells the source of a cancelable exchange to stop, once.
+ */
+static void
+gather_stop(GatherState *node, int src)
+{
+	int port = ((Gather*)((PlanState*)node)->plan)->port;
+	char msg = 1;
+
+	if (!node->stopping || node->stopped[src])
+	{
+		return;
+	}
+	_pargresql_ISend(src, PAR_STOP_PORT(port), 1, &msg, &node->stopreqs[src]); // FIXME: INIS naming
+	node->stopped[src] = 1;
+}
+
+/*
+ * Unpacks the next tuple of the frame received from the node.
+ * When the frame is exhausted, the next one is requested.
+ */
+static TupleTableSlot *
+gather_unpack(GatherState *node, int src)
+{
+	StringInfo frame = &node->frames[src];
+	TupleTableSlot *slot = ((PlanState*)node)->ps_ResultTupleSlot;
+	int len;
+
+	if (node->local[src])
+	{
+		// A MinimalTuple at the next aligned offset, read in place
+		MinimalTuple tuple;
+
+		frame->cursor = MAXALIGN(frame->cursor);
+		if (frame->cursor + (int) sizeof(uint32) > frame->len)
+		{
+			elog(ERROR, "gather: the frame from node %d ends before its tuples", src);
+		}
+		tuple = (MinimalTuple) (frame->data + frame->cursor);
+		len = tuple->t_len;
+		gather_store_minimal(node, src, (MinimalTuple) pq_getmsgbytes(frame, len), len, true);
+	}
+	else
+	{
+		len = pq_getmsgint(frame, PAR_FRAME_TUPLE_HEADER);
+		par_tunpack(node->layout, pq_getmsgbytes(frame, len), len, slot);
+	}
+	node->recvtuples[src]++;
+
+	node->remaining[src]--;
+	if (node->remaining[src] == 0)
+	{
+		if (node->local[src])
+		{
+			node->held = src; // given back before the next tuple (see gather_unhold)
+		}
+		else
+		{
+			gather_release(node, src);
+		}
+	}
+	return slot;
+}
+
+/*
+ * Adds the piece of a large tuple in the frame received from the node
+ * to the tuple, and requests the next frame. Returns true if the tuple
+ * is complete, it is unpacked into the result slot then.
+ */
+static bool
+gather_piece(GatherState *node, int src)
+{
+	StringInfo frame = &node->frames[src];
+	StringInfo partial = &node->partial[src];
+	int total, piece;
+
+	total = pq_getmsgint(frame, PAR_FRAME_TUPLE_HEADER);
+	piece = pq_getmsgint(frame, PAR_FRAME_TUPLE_HEADER);
+	if (partial->data == NULL)
+	{
+		initStringInfo(partial);
+	}
+	appendBinaryStringInfo(partial, pq_getmsgbytes(frame, piece), piece);
+	gather_release(node, src);
+
+	if (partial->len < total)
+	{
+		return false;
+	}
+	if (partial->len > total)
+	{
+		elog(ERROR, "gather: the pieces of a tuple from node %d add up to %d bytes instead of %d", src, partial->len, total);
+	}
+	if (node->local[src])
+	{
+		// The buffer is reused for the next tuple, so the slot gets a copy
+		gather_store_minimal(node, src, (MinimalTuple) partial->data, partial->len, false);
+	}
+	else
+	{
+		par_tunpack(node->layout, partial->data, partial->len, ((PlanState*)node)->ps_ResultTupleSlot);
+	}
+	resetStringInfo(partial);
+	node->recvtuples[src]++;
+	return true;
+}
+
+/*
+ * Gets the next tuple from the node, if something has come from it.
+ * Sets the status: PAR_OK with a tuple, PAR_PROGRESS if a piece of a
+ * large tuple or the EOF has come, PAR_WAIT if nothing has.
+ */
+static TupleTableSlot *
+gather_from(GatherState *node, int i)
+{
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	int port = ((Gather*)((PlanState*)node)->plan)->port;
+	int count;
+
+	if (node->remaining[i] > 0)
+	{
+		// There are tuples left in the frame from the last time
+		node->next = i;
+		node->status = PAR_OK;
+		return gather_unpack(node, i);
+	}
+	if (!gather_test(node, i))
+	{
+		node->status = PAR_WAIT;
+		return NULL;
+	}
+
+	// Yahoo! Something recved from 'i'!
+	node->recvframes[i]++;
+	node->recvbytes[i] += node->frames[i].len;
+	count = pq_getmsgint(&node->frames[i], PAR_FRAME_HEADER);
+	elog(DEBUG5, "gather(port=%d): got a frame of %d tuples from node %d", port, count, i);
+	if (count == PAR_FRAME_CHUNK)
+	{
+		// A piece of a large tuple recved
+		node->next = i;
+		if (gather_piece(node, i))
+		{
+			node->status = PAR_OK;
+			return ((PlanState*)node)->ps_ResultTupleSlot;
+		}
+		node->status = PAR_PROGRESS;
+		return NULL;
+	}
+	else if (count == 0)
+	{
+		// EOF recved
+		elog(DEBUG5, "gather(port=%d): that was EOF", port);
+		if (node->local[i])
+		{
+			_pargresql_RingDone(i, port); // FIXME: INIS naming
+		}
+		node->done[i] = 1;
+		node->nullcnt++;
+		// The source waits for the stop message even after its EOF
+		gather_stop(node, i);
+		node->status = PAR_PROGRESS;
+		return NULL;
+	}
+	else
+	{
+		// A frame of tuples recved
+		node->remaining[i] = count;
+		node->next = (i + 1) % size;
+		node->status = PAR_OK;
+		return gather_unpack(node, i);
+	}
+}
+
 /* ----------------------------------------------------------------
  *		ExecGather
  * ----------------------------------------------------------------
@@ -21,15 +306,14 @@
 TupleTableSlot *				/* return: a tuple or NULL */
 ExecGather(GatherState *node)
 {
-	//ScanDirection direction;
+	int i, k;
 	TupleTableSlot *slot;
-	TupleDesc tupledesc;
-	int i;
 
 	int rank = _pargresql_GetNode(); // FIXME: INIS naming
 	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
 	int port = ((Gather*)((PlanState*)node)->plan)->port;
 	elog(DEBUG5, "gather(port=%d): %d nulls of %d", port, node->nullcnt, size - 1);
+	gather_unhold(node);
 	if (node->nullcnt == size - 1)
 	{
 		// All EOFs have been gathered, return EOF
@@ -37,49 +321,22 @@ ExecGather(GatherState *node)
 		return NULL;
 	}
 
-	for (i = 0; i < size; i++)
+	for (k = 0; k < size; k++)
 	{
+		// Start with a different node every time, so that no node starves
+		i = (node->next + k) % size;
 		if (i == rank) {
 			continue; // don't get from yourself
 		}
-		if (node->bufs[i] == NULL)
+		if (node->done[i])
 		{
 			// This node has alreary sent an EOF - skip the node
 			continue;
 		}
-		int flag;
-		_pargresql_Test(&node->requests[i], &flag);
-		if (flag)
+		slot = gather_from(node, i);
+		if (node->status != PAR_WAIT)
 		{
-			// Yahoo! Something recved from 'i'!
-			char *buf = (char*)node->bufs[i];
-			elog(DEBUG5, "gather(port=%d): got a message from node %d", port, i);
-			if ((buf[0] == '\0') && (buf[1] == '\0'))
-			{
-				// EOF recved
-				elog(DEBUG5, "gather(port=%d): that was EOF", port);
-				pfree(buf);
-				node->bufs[i] = NULL;
-				node->nullcnt++;
-				node->status = PAR_WAIT;
-				return NULL;
-			}
-			else
-			{
-				// A tuple recved
-				elog(DEBUG5, "gather(port=%d): that was a tuple", port);
-				StringInfoData sid;
-				//tupledesc = ExecTypeFromTL(((PlanState*)node)->plan->targetlist, false);
-				//slot = MakeSingleTupleTableSlot(tupledesc);
-				slot = ((PlanState*)node)->ps_ResultTupleSlot;
-				sid.len = GATHER_BUFLEN;
-				sid.data = buf;
-				par_tunpack(sid, slot);
-
-				_pargresql_IRecv(i, port, GATHER_BUFLEN, node->bufs[i], &node->requests[i]);
-				node->status = PAR_OK;
-				return slot;
-			}
+			return slot;
 		}
 	}
 
@@ -87,6 +344,49 @@ ExecGather(GatherState *node)
 	return NULL;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecGatherFrom
+ *
+ *		The same as ExecGather, but gets the tuples of the given
+ *		node only. Returns NULL with PAR_OK after its EOF.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *				/* return: a tuple or NULL */
+ExecGatherFrom(GatherState *node, int src)
+{
+	gather_unhold(node);
+	if (node->done[src])
+	{
+		node->status = PAR_OK;
+		return NULL;
+	}
+	return gather_from(node, src);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecGatherCancel
+ *
+ *		Tells the sources of a cancelable exchange that no more
+ *		tuples are needed. They send their EOFs soon then, and
+ *		the tuples still on the way have to be read till them.
+ * ----------------------------------------------------------------
+ */
+void
+ExecGatherCancel(GatherState *node)
+{
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	int i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (i != rank && !node->done[i])
+		{
+			gather_stop(node, i);
+		}
+	}
+}
+
 /* ----------------------------------------------------------------
  *		ExecInitGather
  *
@@ -101,7 +401,7 @@ ExecInitGather (Gather *node, EState *estate, int eflags)
 	int i, port, size, rank;
 
 	/* check for unsupported flags */
-	Assert(!(eflags)); // FIXME: no flags supported
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK))); // FIXME: no backward scans or marks
 
 	/*
 	 * create state structure
@@ -110,17 +410,36 @@ ExecInitGather (Gather *node, EState *estate, int eflags)
 	gatherstate->ps.plan = (Plan *) node;
 	gatherstate->ps.state = estate;
 
-	port = ((Gather*)((PlanState*)gatherstate)->plan)->port;
+	port = node->port;
 	rank = _pargresql_GetNode(); // FIXME: INIS naming
 	size = _pargresql_GetNodesCount(); // FIXME: INIS naming
 	gatherstate->status = PAR_OK;
 	gatherstate->nullcnt = 0;
+	gatherstate->next = 0;
 	gatherstate->requests = palloc(size * sizeof(_pargresql_request_t));
-	gatherstate->bufs = palloc(size * sizeof(void*));
+	gatherstate->bufs = palloc0(size * sizeof(void*));
+	gatherstate->frames = palloc0(size * sizeof(StringInfoData));
+	gatherstate->remaining = palloc0(size * sizeof(int));
+	gatherstate->local = palloc0(size * sizeof(int));
+	gatherstate->held = -1;
+	gatherstate->done = palloc0(size * sizeof(int));
+	gatherstate->partial = palloc0(size * sizeof(StringInfoData));
+	gatherstate->recvtuples = palloc0(size * sizeof(long));
+	gatherstate->recvframes = palloc0(size * sizeof(long));
+	gatherstate->recvbytes = palloc0(size * sizeof(long));
+	gatherstate->stopping = node->cancelable && rank == 0;
+	gatherstate->stopped = palloc0(size * sizeof(int));
+	gatherstate->stopreqs = palloc(size * sizeof(_pargresql_request_t));
 	for (i = 0; i < size; i++) {
 		if (i != rank) {
-			gatherstate->bufs[i] = palloc0(GATHER_BUFLEN);
-			_pargresql_IRecv(i, port, GATHER_BUFLEN, gatherstate->bufs[i], &gatherstate->requests[i]);
+			gatherstate->local[i] = _pargresql_IsLocal(i, port); // FIXME: INIS naming
+			if (!gatherstate->local[i]) {
+				gatherstate->bufs[i] = palloc0(GATHER_BUFLEN);
+			}
+			if (!(eflags & EXEC_FLAG_EXPLAIN_ONLY)) {
+				// Nothing is to be received when the plan is only explained
+				gather_post(gatherstate, i);
+			}
 		}
 	}
 
@@ -136,6 +455,8 @@ ExecInitGather (Gather *node, EState *estate, int eflags)
 	ExecAssignResultTypeFromTL(&gatherstate->ps);
 	gatherstate->ps.ps_ProjInfo = NULL;
 
+	gatherstate->layout = par_tuplayout(gatherstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor);
+
 	return gatherstate;
 }
 
@@ -155,24 +476,76 @@ ExecCountSlotsGather(Gather *node)
 void
 ExecEndGather(GatherState *node)
 {
-	//int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
-	//int i;
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	int i, flag;
+
+	gather_unhold(node);
+
+	// Wait for the stop messages, so that INIS gets its blocks back
+	for (i = 0; i < size; i++)
+	{
+		while (node->stopped[i])
+		{
+			_pargresql_Test(&node->stopreqs[i], &flag); // FIXME: INIS naming
+			if (flag)
+			{
+				node->stopped[i] = 0;
+			}
+			else
+			{
+				_pargresql_Wait(100); // FIXME: INIS naming
+				CHECK_FOR_INTERRUPTS();
+			}
+		}
+	}
+
+	for (i = 0; i < size; i++) {
+		if (i != rank && node->bufs[i] != NULL) {
+			pfree(node->bufs[i]);
+		}
+		if (node->partial[i].data != NULL) {
+			pfree(node->partial[i].data);
+		}
+	}
 	pfree(node->bufs);
 	pfree(node->requests);
+	pfree(node->frames);
+	pfree(node->remaining);
+	pfree(node->local);
+	pfree(node->done);
+	pfree(node->partial);
+	pfree(node->recvtuples);
+	pfree(node->recvframes);
+	pfree(node->recvbytes);
+	pfree(node->stopped);
+	pfree(node->stopreqs);
+	par_free_tuplayout(node->layout);
 }
 
 
 void
 ExecReScanGather(GatherState *node, ExprContext *exprCtxt)
 {
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
 	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
 	int i;
-	int port = ((Gather*)((PlanState*)node)->plan)->port;
+
+	gather_unhold(node);
 	for (i = 0; i < size; i++) {
-		node->bufs[i] = palloc(GATHER_BUFLEN);
-//		printhex2("newbuf", (char*)node->bufs[i], 20);
-		_pargresql_IRecv(i, port, GATHER_BUFLEN, node->bufs[i], &node->requests[i]);
+		if (i == rank) {
+			continue;
+		}
+		if (node->partial[i].data != NULL) {
+			resetStringInfo(&node->partial[i]);
+		}
+		if (node->done[i]) {
+			// Only the nodes that have sent their EOF are to be listened again
+			node->done[i] = 0;
+			gather_post(node, i);
+		}
 	}
 	node->status = PAR_OK;
 	node->nullcnt = 0;
+	node->next = 0;
 }
@@ -9,10 +9,124 @@
 #include "postgres.h"
 
 #include "executor/executor.h"
+#include "executor/instrument.h"
+#include "executor/par_nodeGather.h"
 #include "executor/par_nodeMerge.h"
+#include "executor/par_nodeScatter.h"
+#include "miscadmin.h"
+#include "utils/tuplesort.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+/*
+ * How long to sleep on the doorbell at most, in milliseconds.
+ * The doorbell normally wakes us up much earlier, the timeout
+ * only bounds the reaction to a lost wakeup.
+ */
+#define MERGE_WAIT_TIMEOUT 100
+
+static TupleTableSlot *merge_ordered(MergeState *node);
+
+/*
+ * Sleeps on the doorbell, keeping track of the time spent blocked.
+ */
+static void
+merge_wait(MergeState *node)
+{
+	instr_time start, end;
+
+	INSTR_TIME_SET_CURRENT(start);
+	_pargresql_Wait(MERGE_WAIT_TIMEOUT); // FIXME: INIS naming
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_SUBTRACT(end, start);
+	node->waittime += INSTR_TIME_GET_DOUBLE(end);
+	node->waits++;
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * Compares the next tuples of the two sources by the sort keys.
+ */
+static int32
+merge_compare(MergeState *node, int a, int b)
+{
+	Merge *plan = (Merge*)((PlanState*)node)->plan;
+	int k;
+
+	for (k = 0; k < plan->numCols; k++)
+	{
+		AttrNumber attno = plan->sortColIdx[k];
+		Datum datum1, datum2;
+		bool isnull1, isnull2;
+		int32 cmp;
+
+		datum1 = slot_getattr(node->heads[a], attno, &isnull1);
+		datum2 = slot_getattr(node->heads[b], attno, &isnull2);
+		cmp = ApplySortFunction(&node->sortFunctions[k], node->sortFlags[k],
+								datum1, isnull1, datum2, isnull2);
+		if (cmp != 0)
+		{
+			return cmp;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Puts the source into the heap, its tuple being in the heads.
+ */
+static void
+merge_heap_insert(MergeState *node, int src)
+{
+	int j = node->heapsize++;
+
+	while (j > 0)
+	{
+		int parent = (j - 1) / 2;
+		if (merge_compare(node, src, node->heap[parent]) >= 0)
+		{
+			break;
+		}
+		node->heap[j] = node->heap[parent];
+		j = parent;
+	}
+	node->heap[j] = src;
+}
+
+/*
+ * Takes the source with the least tuple out of the heap.
+ */
+static int
+merge_heap_pop(MergeState *node)
+{
+	int top = node->heap[0];
+	int last = node->heap[--node->heapsize];
+	int j = 0;
+
+	while (2 * j + 1 < node->heapsize)
+	{
+		int child = 2 * j + 1;
+		if (child + 1 < node->heapsize
+			&& merge_compare(node, node->heap[child + 1], node->heap[child]) < 0)
+		{
+			child++;
+		}
+		if (merge_compare(node, last, node->heap[child]) <= 0)
+		{
+			break;
+		}
+		node->heap[j] = node->heap[child];
+		j = child;
+	}
+	node->heap[j] = last;
+	return top;
+}
 
 /* ----------------------------------------------------------------
  *		ExecMerge
+ *
+ *		Advances both sons in turn. If neither of them could move
+ *		because of the messages, sleeps until the communicator or
+ *		a local node rings the doorbell instead of spinning.
  * ----------------------------------------------------------------
  */
 TupleTableSlot *				/* return: a tuple or NULL */
@@ -20,6 +134,7 @@ ExecMerge(MergeState *node)
 {
 	//ScanDirection direction;
 	TupleTableSlot *slot;
+	PlanState *first, *second;
 	GatherState *left;
 	SplitState *right;
 
@@ -29,74 +144,148 @@ ExecMerge(MergeState *node)
 	int port = ((Gather*)((PlanState*)left)->plan)->port;
 	elog(DEBUG5, "merge(port=%d)", port);
 
+	if (((Merge*)((PlanState*)node)->plan)->numCols > 0)
+	{
+		return merge_ordered(node);
+	}
+
 	while (1)
 	{
 		node->even = !node->even;
 		if (node->even)
 		{ // right, then left
 			elog(DEBUG5, "merge: even (split-gather)");
-			// advance the right son
-			slot = ExecProcNode((PlanState*)right);
-			if (right->status == PAR_WAIT)
-			{
-				// the right son is busy, next iteration
-				continue;
-			}
-			// the right son has advanced
-			if (!TupIsNull(slot))
-			{
-				// the right son has a tuple, returning
-				return slot;
-			}
+			first = (PlanState*)right;
+			second = (PlanState*)left;
+		}
+		else
+		{ // left, then right
+			elog(DEBUG5, "merge: odd (gather-split)");
+			first = (PlanState*)left;
+			second = (PlanState*)right;
+		}
+
+		// advance the first son
+		slot = ExecProcNode(first);
+		if (!TupIsNull(slot))
+		{
+			// the first son has a tuple, returning
+			return slot;
+		}
 
-			// advance the left son
-			slot = ExecProcNode((PlanState*)left);
-			if (left->status == PAR_WAIT)
+		// advance the second son
+		slot = ExecProcNode(second);
+		if (!TupIsNull(slot))
+		{
+			// the second son has a tuple, returning
+			return slot;
+		}
+
+		if (left->status == PAR_OK && right->status == PAR_OK)
+		{
+			// EOF from both sons - return EOF
+			node->finished = 1;
+			return NULL;
+		}
+
+		if (left->status != PAR_PROGRESS && right->status != PAR_PROGRESS)
+		{
+			// No son can move until a message arrives or gets sent
+			elog(DEBUG5, "merge(port=%d): both sons are blocked, waiting", port);
+			merge_wait(node);
+		}
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		merge_ordered
+ *
+ *		The ordered Merge. Every node (the Split for this one, the
+ *		Gather for the others) is a source of sorted tuples. Once the
+ *		next tuple of every source is known, the least one is returned,
+ *		and its source has to give the next one before the following
+ *		call can decide. The Split is advanced along with the others,
+ *		so this node keeps scattering its tuples meanwhile.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+merge_ordered(MergeState *node)
+{
+	GatherState *left = (GatherState*)((PlanState*)node)->lefttree;
+	SplitState *right = (SplitState*)((PlanState*)node)->righttree;
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	int port = ((Gather*)((PlanState*)left)->plan)->port;
+	TupleTableSlot *slot;
+	ExchangeStatus status;
+	int src, empty;
+	bool progress;
+
+	while (1)
+	{
+		empty = 0;
+		progress = false;
+		for (src = 0; src < size; src++)
+		{
+			if (node->sources[src] != MERGE_SRC_EMPTY)
 			{
-				// the left son is busy, next iteration
 				continue;
 			}
-			// the left son has advanced
-			if (!TupIsNull(slot))
+			if (src == rank)
 			{
-				// the left son has a tuple, returning
-				return slot;
+				slot = ExecProcNode((PlanState*)right);
+				status = right->status;
 			}
-		}
-		else
-		{ // left, then right
-			elog(DEBUG5, "merge: odd (gather-split)");
-			// advance the left son
-			slot = ExecProcNode((PlanState*)left);
-			if (left->status == PAR_WAIT)
+			else
 			{
-				// the left son is busy, next iteration
-				continue;
+				slot = ExecGatherFrom(left, src);
+				status = left->status;
 			}
-			// the left son has advanced
+
 			if (!TupIsNull(slot))
 			{
-				// the left son has a tuple, returning
-				return slot;
+				ExecCopySlot(node->heads[src], slot);
+				node->sources[src] = MERGE_SRC_READY;
+				merge_heap_insert(node, src);
+				progress = true;
 			}
-
-			// advance the right son
-			slot = ExecProcNode((PlanState*)right);
-			if (right->status == PAR_WAIT)
+			else if (status == PAR_OK)
 			{
-				// the right son is busy, next iteration
-				continue;
+				node->sources[src] = MERGE_SRC_DONE;
+				progress = true;
 			}
-			// the right son has advanced
-			if (!TupIsNull(slot))
+			else
 			{
-				// the right son has a tuple, returning
-				return slot;
+				if (status == PAR_PROGRESS)
+				{
+					progress = true;
+				}
+				empty++;
 			}
 		}
-		// EOF from both sons - return EOF
+
+		if (empty == 0)
+		{
+			break;
+		}
+		if (!progress)
+		{
+			// Some source has nothing to give yet, and the order
+			// cannot be decided without it
+			elog(DEBUG5, "merge(port=%d): %d sources are blocked, waiting", port, empty);
+			merge_wait(node);
+		}
+	}
+
+	if (node->heapsize == 0)
+	{
+		// EOF from every source - return EOF
+		node->finished = 1;
 		return NULL;
 	}
+	src = merge_heap_pop(node);
+	node->sources[src] = MERGE_SRC_EMPTY;
+	return node->heads[src];
 }
 
 /* ----------------------------------------------------------------
@@ -113,7 +302,7 @@ ExecInitMerge (Merge *node, EState *estate, int eflags)
 	//Plan	   *childPlan;
 
 	/* check for unsupported flags */
-	Assert(!(eflags)); // FIXME: no flags supported
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK))); // FIXME: no backward scans or marks
 
 	/*
 	 * create state structure
@@ -123,6 +312,10 @@ ExecInitMerge (Merge *node, EState *estate, int eflags)
 	mergestate->ps.state = estate;
 
 	mergestate->even = 0;
+	// Nothing is to be drained when the plan is only explained
+	mergestate->finished = (eflags & EXEC_FLAG_EXPLAIN_ONLY) != 0;
+	mergestate->waits = 0;
+	mergestate->waittime = 0;
 
 	/*
 	 * Tuple table initialization (XXX not actually used...)
@@ -142,6 +335,33 @@ ExecInitMerge (Merge *node, EState *estate, int eflags)
 	ExecAssignResultTypeFromTL(&mergestate->ps);
 	mergestate->ps.ps_ProjInfo = NULL;
 
+	if (node->numCols > 0)
+	{
+		int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+		TupleDesc tupdesc = mergestate->ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+		int i;
+
+		mergestate->sortFunctions = (FmgrInfo*)palloc(node->numCols * sizeof(FmgrInfo));
+		mergestate->sortFlags = (int*)palloc(node->numCols * sizeof(int));
+		for (i = 0; i < node->numCols; i++)
+		{
+			Oid sortFunction;
+
+			SelectSortFunction(node->sortOperators[i], node->nullsFirst[i],
+							   &sortFunction, &mergestate->sortFlags[i]);
+			fmgr_info(sortFunction, &mergestate->sortFunctions[i]);
+		}
+
+		mergestate->heads = (TupleTableSlot**)palloc(size * sizeof(TupleTableSlot*));
+		for (i = 0; i < size; i++)
+		{
+			mergestate->heads[i] = MakeSingleTupleTableSlot(tupdesc);
+		}
+		mergestate->sources = (MergeSourceState*)palloc0(size * sizeof(MergeSourceState));
+		mergestate->heap = (int*)palloc(size * sizeof(int));
+		mergestate->heapsize = 0;
+	}
+
 	return mergestate;
 }
 
@@ -153,6 +373,35 @@ ExecCountSlotsMerge(Merge *node)
 		1 /* our slot */;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecMergeDrain
+ *
+ *		Runs the exchange to the end if the plan above has stopped
+ *		early: the other nodes still wait for our EOF, and their
+ *		tuples are still on the way to us. If the exchange is
+ *		cancelable, the sources are told that the rest is not needed.
+ * ----------------------------------------------------------------
+ */
+void
+ExecMergeDrain(MergeState *node)
+{
+	GatherState *left = (GatherState*)outerPlanState(node);
+	SplitState *right = (SplitState*)innerPlanState(node);
+
+	if (node->finished)
+	{
+		return;
+	}
+	elog(DEBUG5, "merge(port=%d): stopped early, draining", ((Gather*)((PlanState*)left)->plan)->port);
+	if (left->stopping)
+	{
+		ExecGatherCancel(left);
+		scatter_stop((ScatterState*)innerPlanState(right));
+	}
+	while (!TupIsNull(ExecMerge(node)))
+		;
+}
+
 /* ----------------------------------------------------------------
  *		ExecEndMerge
  *
@@ -163,6 +412,18 @@ ExecCountSlotsMerge(Merge *node)
 void
 ExecEndMerge(MergeState *node)
 {
+	ExecMergeDrain(node);
+
+	if (((Merge*)((PlanState*)node)->plan)->numCols > 0)
+	{
+		int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+		int i;
+
+		for (i = 0; i < size; i++)
+		{
+			ExecDropSingleTupleTableSlot(node->heads[i]);
+		}
+	}
 	ExecEndNode(outerPlanState(node));
 	ExecEndNode(innerPlanState(node));
 }
@@ -174,4 +435,17 @@ ExecReScanMerge(MergeState *node, ExprContext *exprCtxt)
 	ExecReScan(outerPlanState(node), exprCtxt);
 	ExecReScan(innerPlanState(node), exprCtxt);
 	node->even = 0;
+	node->finished = 0;
+	if (((Merge*)((PlanState*)node)->plan)->numCols > 0)
+	{
+		int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+		int i;
+
+		for (i = 0; i < size; i++)
+		{
+			ExecClearTuple(node->heads[i]);
+			node->sources[i] = MERGE_SRC_EMPTY;
+		}
+		node->heapsize = 0;
+	}
 }
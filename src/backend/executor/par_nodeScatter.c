@@ -9,107 +9,600 @@
 #include "postgres.h"
 #include <stdio.h>
 
+#include "access/par_coopscan.h"
 #include "access/par_tupack.h"
 #include "executor/executor.h"
+#include "libpq/pqformat.h"
+#include "executor/par_bloom.h"
 #include "executor/par_nodeScatter.h"
+#include "miscadmin.h"
+#include "par_parallelizer/par_fragment.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
 #include "par_inis/_pargresql_library.h" // FIXME: INIS naming
 
-// FIXME: use the UUID actually (instead of int)
-int fragfunc(int size, TupleTableSlot *slot, int fragattr)
+// How many seconds a source waits at its end for the stop message
+#define SCATTER_STOP_TIMEOUT 600
+
+/*
+ * Returns the hash of the fragmentation columns of the tuple.
+ * The hash values of the columns are combined the same way as
+ * in nodeHash.c, and a NULL counts as zero. Sets 'allnull' if all
+ * the columns are NULL, which is not the same as a hash of zero:
+ * such a tuple has no bucket and always goes to fragment 0 (see
+ * par_fragment.h).
+ */
+static uint32
+fraghash(ScatterState *node, TupleTableSlot *slot, bool *allnull)
+{
+	Scatter *plan = (Scatter*)node->ps.plan;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	MemoryContext oldContext;
+	uint32 hashkey = 0;
+	int i;
+
+	*allnull = true;
+
+	// The hash functions may detoast the values
+	ResetExprContext(econtext);
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < plan->numCols; i++)
+	{
+		Datum val;
+		bool isnull;
+
+		// rotate hashkey left 1 bit at each step
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		// slot_getattr assumes that attributes are indexed starting from 1
+		val = slot_getattr(slot, plan->fragColIdx[i], &isnull);
+		if (!isnull)
+		{
+			hashkey ^= DatumGetUInt32(FunctionCall1(&node->hashfunctions[i], val));
+			*allnull = false;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	return hashkey;
+}
+
+/*
+ * Returns the node of the hash. With one rank per fragment, this is
+ * the fragment of the virtual bucket of the hash, so that the rows of
+ * a hashed relation are already on the nodes the exchanges hashed by
+ * its fragmentation attribute send them to.
+ */
+static int
+hash_node(uint32 hashkey)
 {
-	bool ignore;
-	// slot_getattr assumes that attributes are indexed starting from 1
-	if (fragattr == 0)
+	if (par_scan_workers == 1)
+	{
+		return par_hash_fragment(hashkey);
+	}
+	return (hashkey & 0x7fffffff) % _pargresql_GetNodesCount(); // FIXME: INIS naming
+}
+
+/*
+ * Returns the destination node of the tuple: the node the hash of its
+ * fragmentation columns goes to (see hash_node), or node 0 if they are
+ * all NULL.
+ *
+ * For a single column this equals
+ * coalesce(pargresql_hash_fragment(hash(x)), 0) with one rank per
+ * fragment, which the parallelizer relies on when filtering INSERTed
+ * tuples.
+ */
+int fragfunc(ScatterState *node, TupleTableSlot *slot)
+{
+	uint32 hashkey;
+	bool allnull;
+
+	if (((Scatter*)node->ps.plan)->numCols == 0)
 	{
 		elog(DEBUG5, "fragfunc is constant zero");
-		// FIXME: this is a hack to allow constant zero exchange
-		// (the root exchange), without the struct having
-		// "fragfunc" property.
 		return 0;
 	}
-	uint32 val = DatumGetUInt32(slot_getattr(slot, fragattr, &ignore));
-	elog(DEBUG5, "fragfunc result = %u", val);
-	return val % size;
+
+	hashkey = fraghash(node, slot, &allnull);
+	elog(DEBUG5, "fragfunc result = %u%s", hashkey, allnull ? " (null)" : "");
+	return allnull ? 0 : hash_node(hashkey);
 }
 
-void printhex(char *name, char *buf, int len)
+/*
+ * Returns the node that holds the range or the list the fragmentation
+ * column of the tuple falls into.
+ */
+static int
+fragscheme_route(ScatterState *node, TupleTableSlot *slot)
 {
-	int i;
-	elog(DEBUG5, "%s {", name);
-	for (i = 0; i < len; i++)
+	Scatter *plan = (Scatter*)node->ps.plan;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	MemoryContext oldContext;
+	Datum val;
+	bool isnull;
+	int dst;
+
+	// The comparison function may detoast the value
+	ResetExprContext(econtext);
+	oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	val = slot_getattr(slot, plan->fragColIdx[0], &isnull);
+	dst = fragscheme_node(plan->fragScheme, &node->fragcmp, val, isnull);
+	MemoryContextSwitchTo(oldContext);
+
+	return dst;
+}
+
+/*
+ * Returns the destination node of the tuple, or PAR_DST_ALL if every
+ * node should get it. Unlike fragfunc, takes the broadcasting, the
+ * hot keys and the fragments into account, and counts the tuples
+ * routed to every node.
+ */
+int scatter_route(ScatterState *node, TupleTableSlot *slot)
+{
+	Scatter *plan = (Scatter*)node->ps.plan;
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	uint32 hashkey;
+	bool allnull;
+	int i, dst;
+
+	if (plan->broadcast)
 	{
-		elog(DEBUG5, "%02X ", (unsigned int)buf[i]);
+		return PAR_DST_ALL;
+	}
+	if (plan->numCols == 0)
+	{
+		node->routed[0]++;
+		return 0;
 	}
-	elog(DEBUG5, "}", name);
+	if (plan->toFragments)
+	{
+		// The rows of a relation go to the leader of their fragment
+		if (plan->fragScheme != NULL)
+		{
+			dst = fragscheme_route(node, slot);
+		}
+		else
+		{
+			hashkey = fraghash(node, slot, &allnull);
+			dst = allnull ? 0 : par_hash_fragment(hashkey);
+		}
+		dst = par_fragment_leader(dst);
+		node->routed[dst]++;
+		return dst;
+	}
+
+	// The NULLs are where a relation hashed on the columns keeps them
+	hashkey = fraghash(node, slot, &allnull);
+	if (allnull)
+	{
+		node->routed[0]++;
+		return 0;
+	}
+	for (i = 0; i < plan->numHot; i++)
+	{
+		if (plan->hotHashes[i] == hashkey)
+		{
+			node->hot++;
+			if (plan->skew == PAR_SKEW_BROADCAST)
+			{
+				return PAR_DST_ALL;
+			}
+			// Spread the hot tuples evenly, instead of overloading one node
+			dst = node->nexthot;
+			node->nexthot = (node->nexthot + 1) % size;
+			node->routed[dst]++;
+			return dst;
+		}
+	}
+
+	dst = hash_node(hashkey);
+	node->routed[dst]++;
+	return dst;
 }
 
+/*
+ * Returns true if node 0 needs no more tuples from the cancelable
+ * Scatter, or the Scatter has been stopped by scatter_stop.
+ */
+bool scatter_stopped(ScatterState *node)
+{
+	if (node->stoppending)
+	{
+		int flag;
+		_pargresql_Test(&node->stopreq, &flag); // FIXME: INIS naming
+		if (flag)
+		{
+			elog(DEBUG5, "scatter(port=%d): node 0 says stop", ((Scatter*)node->ps.plan)->port);
+			node->stoppending = 0;
+			node->stopped = 1;
+		}
+	}
+	return node->stopped;
+}
 
-/* ----------------------------------------------------------------
- *		ExecScatter
- * ----------------------------------------------------------------
+/*
+ * Makes the Split stop as if its input had ended.
  */
-TupleTableSlot *				/* return: a tuple or NULL */
-ExecScatter(ScatterState *node)
+void scatter_stop(ScatterState *node)
 {
-	//ScanDirection direction;
-	//TupleTableSlot *slot
-	elog(DEBUG5, "scatter(port=%d)", ((Scatter*)node->ps.plan)->port);
+	node->stopped = 1;
+}
 
-	if (node->isSending)
+/*
+ * Returns true if the tuple is not needed by the destination, because
+ * the hash join above it has nothing to join the tuple with (see
+ * par_bloom.h). 'matchable' and 'hashvalue' are from par_bloom_hash.
+ */
+static bool
+scatter_filtered(ScatterState *node, int dst, bool matchable, uint32 hashvalue)
+{
+	if (node->bloom == NULL)
+	{
+		return false;
+	}
+	if (matchable && !par_bloom_rejects(node->bloom, dst, hashvalue))
 	{
+		return false;
+	}
+	node->filtered++;
+	return true;
+}
+
+/*
+ * Starts a new empty frame for the destination.
+ */
+static void
+scatter_reset_frame(ScatterState *node, int dst)
+{
+	resetStringInfo(&node->frames[dst]);
+	appendBinaryStringInfo(&node->frames[dst], "\0\0", PAR_FRAME_HEADER);
+	node->framecnt[dst] = 0;
+}
+
+/*
+ * Hands the frame over to INIS. Returns false if the previous
+ * message to the same destination has not been sent yet (or,
+ * for a node on the same host, if its ring is full), so the
+ * frame has to wait.
+ */
+static bool
+scatter_flush(ScatterState *node, int dst)
+{
+	StringInfo frame = &node->frames[dst];
+	uuid_t port = ((Scatter*)node->ps.plan)->port; // FIXME: use the UUID actually (instead of int)
+
+	// Put the tuple count into the frame header (in network byte order)
+	frame->data[0] = (char) ((node->framecnt[dst] >> 8) & 0xFF);
+	frame->data[1] = (char) (node->framecnt[dst] & 0xFF);
+
+	if (node->local[dst])
+	{
+		// Same host: copy the frame straight into the ring of the receiver
 		int flag;
-		_pargresql_Test(&node->request, &flag); // FIXME: INIS naming
-		if (flag)
+		_pargresql_RingSend(dst, port, frame->len, frame->data, &flag); // FIXME: INIS naming
+		if (!flag)
 		{
-			node->buf = NULL;
-			node->isSending = 0;
-			node->status = PAR_OK;
-			return NULL;
+			return false; // the ring is full, the receiver is behind
 		}
-		else
+		elog(DEBUG5, "scatter(port=%d) put %d tuples (%d bytes) into the ring of %d", port, node->framecnt[dst], frame->len, dst);
+		node->sentframes[dst]++;
+		node->sentbytes[dst] += frame->len;
+		scatter_reset_frame(node, dst);
+		return true;
+	}
+
+	if (node->inflight[dst])
+	{
+		int flag;
+		_pargresql_Test(&node->requests[dst], &flag); // FIXME: INIS naming
+		if (!flag)
+		{
+			return false;
+		}
+		node->inflight[dst] = 0;
+	}
+
+	elog(DEBUG5, "scatter(port=%d) sending %d tuples (%d bytes) to %d", port, node->framecnt[dst], frame->len, dst);
+	_pargresql_ISend(dst, port, frame->len, frame->data, &node->requests[dst]); // FIXME: INIS naming
+	node->inflight[dst] = 1;
+	node->sentframes[dst]++;
+	node->sentbytes[dst] += frame->len;
+
+	// INIS has copied the message, so the frame can be reused at once
+	scatter_reset_frame(node, dst);
+	return true;
+}
+
+/*
+ * Returns the tuple being scattered as the destination gets it: a
+ * MinimalTuple for a node on the same host, a packed tuple otherwise.
+ */
+static StringInfo
+scatter_tuple(ScatterState *node, int dst)
+{
+	return node->local[dst] ? &node->minimal : &node->packed;
+}
+
+/*
+ * Returns the offset the tuple would start at in a frame of the
+ * destination that is 'len' bytes long now. A MinimalTuple has its
+ * length inside and is aligned, to be read in place by the receiver.
+ */
+static int
+scatter_offset(ScatterState *node, int dst, int len)
+{
+	if (node->local[dst])
+	{
+		return MAXALIGN(len);
+	}
+	return len + PAR_FRAME_TUPLE_HEADER;
+}
+
+/*
+ * Returns true if the tuple fits into an empty frame of the destination.
+ */
+static bool
+scatter_fits(ScatterState *node, int dst, StringInfo tuple)
+{
+	return scatter_offset(node, dst, PAR_FRAME_HEADER) + tuple->len <= PAR_FRAME_SIZE;
+}
+
+/*
+ * Appends a tuple to the frame of the destination.
+ * The caller must make sure the tuple fits.
+ */
+static void
+scatter_append(ScatterState *node, int dst, StringInfo tuple)
+{
+	StringInfo frame = &node->frames[dst];
+
+	if (node->local[dst])
+	{
+		static const char padding[MAXIMUM_ALIGNOF] = {0};
+		appendBinaryStringInfo(frame, padding, MAXALIGN(frame->len) - frame->len);
+	}
+	else
+	{
+		pq_sendint(frame, tuple->len, PAR_FRAME_TUPLE_HEADER);
+	}
+	appendBinaryStringInfo(frame, tuple->data, tuple->len);
+	node->framecnt[dst]++;
+	if (node->framecnt[dst] == PAR_FRAME_TUPLES)
+	{
+		node->toflush[dst]++;
+	}
+}
+
+/*
+ * Appends the tuple to the frame of the destination, or, if the
+ * frame is full (or the tuple does not fit into any frame), schedules
+ * the frame and keeps the tuple pending.
+ */
+static void
+scatter_put(ScatterState *node, int dst)
+{
+	StringInfo tuple = scatter_tuple(node, dst);
+
+	if (scatter_offset(node, dst, node->frames[dst].len) + tuple->len > PAR_FRAME_SIZE)
+	{
+		// No room for the tuple, the frame has to go first
+		if (node->framecnt[dst] > 0)
+		{
+			node->toflush[dst]++;
+		}
+		node->haspending[dst] = 1;
+		node->pendingoff[dst] = 0;
+	}
+	else
+	{
+		scatter_append(node, dst, tuple);
+	}
+}
+
+/*
+ * Moves the pending tuple into the empty frame of the destination,
+ * the whole tuple if it fits, or its next piece otherwise.
+ */
+static void
+scatter_pend(ScatterState *node, int dst)
+{
+	StringInfo tuple = scatter_tuple(node, dst); // stays intact until everything is sent
+	StringInfo frame = &node->frames[dst];
+	int piece;
+
+	if (scatter_fits(node, dst, tuple))
+	{
+		scatter_append(node, dst, tuple);
+		node->haspending[dst] = 0;
+		return;
+	}
+
+	// A large tuple goes in pieces, one frame each
+	Assert(node->framecnt[dst] == 0);
+	piece = Min(tuple->len - node->pendingoff[dst], PAR_FRAME_SIZE - PAR_FRAME_HEADER - PAR_FRAME_CHUNK_HEADER);
+	pq_sendint(frame, tuple->len, PAR_FRAME_TUPLE_HEADER);
+	pq_sendint(frame, piece, PAR_FRAME_TUPLE_HEADER);
+	appendBinaryStringInfo(frame, tuple->data + node->pendingoff[dst], piece);
+	node->framecnt[dst] = PAR_FRAME_CHUNK;
+	node->toflush[dst]++;
+
+	node->pendingoff[dst] += piece;
+	if (node->pendingoff[dst] == tuple->len)
+	{
+		node->haspending[dst] = 0;
+	}
+}
+
+/*
+ * Tries to send all the frames that are ready. Returns true if
+ * there is nothing left to send (and, after the EOF, if all the
+ * messages have been completed).
+ */
+static bool
+scatter_pump(ScatterState *node)
+{
+	int dst;
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	bool done = true;
+
+	for (dst = 0; dst < size; dst++)
+	{
+		if (dst == rank)
+		{
+			continue; // nothing is sent to yourself
+		}
+		while (1)
+		{
+			while (node->toflush[dst] > 0)
+			{
+				if (!scatter_flush(node, dst))
+				{
+					break;
+				}
+				node->toflush[dst]--;
+			}
+			if (node->toflush[dst] > 0 || !node->haspending[dst])
+			{
+				break;
+			}
+			// The frame has been sent, there is room for the pending tuple now
+			scatter_pend(node, dst);
+		}
+		if (node->toflush[dst] > 0)
+		{
+			done = false;
+			continue;
+		}
+		if (node->eof && node->inflight[dst])
 		{
-			node->status = PAR_WAIT;
-			return NULL;
+			// Wait for the last messages, so that INIS gets its blocks back
+			int flag;
+			_pargresql_Test(&node->requests[dst], &flag); // FIXME: INIS naming
+			if (flag)
+			{
+				node->inflight[dst] = 0;
+			}
+			else
+			{
+				done = false;
+			}
 		}
 	}
+	return done;
+}
+
+/*
+ * Packs the tuple from the Split for its destinations and puts it into
+ * their frames, skipping the destinations its filter says do not need it.
+ */
+static void
+scatter_tuple_out(ScatterState *node, bool matchable, uint32 hashvalue)
+{
+	int dst;
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	uuid_t port = ((Scatter*)node->ps.plan)->port; // FIXME: use the UUID actually (instead of int)
+
+	if (node->upstreamDst == PAR_DST_ALL)
+	{
+		// Every other node gets a copy, the Split keeps the original
+		elog(DEBUG5, "scatter(port=%d) packing tuple for everyone", port);
+		if (node->nlocal < size - 1)
+		{
+			par_tupack(node->layout, node->upstreamTuple, &node->packed);
+		}
+		if (node->nlocal > 0)
+		{
+			par_tupack_minimal(node->layout, node->upstreamTuple, &node->minimal);
+		}
+		for (dst = 0; dst < size; dst++)
+		{
+			if (dst != rank && !scatter_filtered(node, dst, matchable, hashvalue))
+			{
+				scatter_put(node, dst);
+			}
+		}
+		return;
+	}
+
+	dst = node->upstreamDst;
+	if (scatter_filtered(node, dst, matchable, hashvalue))
+	{
+		elog(DEBUG5, "scatter(port=%d) filtered out a tuple for %d", port, dst);
+		node->routed[dst]--;
+		return;
+	}
+	elog(DEBUG5, "scatter(port=%d) packing tuple for %d", port, dst);
+	if (node->local[dst])
+	{
+		par_tupack_minimal(node->layout, node->upstreamTuple, &node->minimal);
+	}
 	else
 	{
-		int dst, rank, size;
-		rank = _pargresql_GetNode(); // FIXME: INIS naming
-		size = _pargresql_GetNodesCount(); // FIXME: INIS naming
-		uuid_t port = ((Scatter*)node->ps.plan)->port; // FIXME: use the UUID actually (instead of int)
+		par_tupack(node->layout, node->upstreamTuple, &node->packed);
+	}
+	scatter_put(node, dst);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecScatter
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *				/* return: a tuple or NULL */
+ExecScatter(ScatterState *node)
+{
+	int dst, rank, size;
+	uuid_t port = ((Scatter*)node->ps.plan)->port; // FIXME: use the UUID actually (instead of int)
+
+	elog(DEBUG5, "scatter(port=%d)", port);
+
+	rank = _pargresql_GetNode(); // FIXME: INIS naming
+	size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+
+	if (!node->isSending)
+	{
 		if (TupIsNull(node->upstreamTuple))
-		{ // send EOF tuple
+		{ // send the rest of the frames, followed by the EOF frames
 			for (dst = 0; dst < size; dst++)
 			{
-				char *zero = "\0\0";
 				if (dst != rank) {
-					elog(DEBUG5, "scatter(port=%d) sending zero to %d", port, dst);
-					_pargresql_ISend(dst, port, 2, zero, &node->request); // FIXME: is NULL a valid message/request
+					if (node->framecnt[dst] > 0 && node->framecnt[dst] < PAR_FRAME_TUPLES)
+					{
+						node->toflush[dst]++; // the last incomplete frame
+					}
+					node->toflush[dst]++; // the empty frame (EOF)
 				}
-				elog(DEBUG5, "scatter: NULLs sent");
 			}
-			node->isSending = 0;
-			node->status = PAR_OK;
-			return NULL;
+			node->eof = 1;
+			elog(DEBUG5, "scatter(port=%d) scattering EOF", port);
 		}
 		else
 		{
-			int fragattr;
-			fragattr = node->ps.plan->fragattr;
-			dst = fragfunc(size, node->upstreamTuple, fragattr);
-			StringInfoData sid = par_tupack(node->upstreamTuple);
-			node->buf = sid.data;
-			elog(DEBUG5, "scatter(port=%d) sending tuple to %d", port, dst);
-			printhex("the data", sid.data, sid.len);
-			_pargresql_ISend(dst, port, sid.len, sid.data, &node->request);
-			elog(DEBUG5, "scatter: tuple sent");
-			pfree(sid.data);
-			node->isSending = 1;
-			node->status = PAR_WAIT;
-			return NULL;
+			bool matchable = false;
+			uint32 hashvalue = 0;
+
+			if (node->bloom != NULL)
+			{
+				matchable = par_bloom_hash(node->bloom, node->ps.ps_ExprContext, node->upstreamTuple, &hashvalue);
+			}
+			scatter_tuple_out(node, matchable, hashvalue);
 		}
 	}
+
+	if (scatter_pump(node))
+	{
+		node->isSending = 0;
+		node->status = PAR_OK;
+	}
+	else
+	{
+		node->isSending = 1;
+		node->status = PAR_WAIT;
+	}
 	return NULL;
 }
 
@@ -124,10 +617,11 @@ ScatterState *
 ExecInitScatter (Scatter *node, EState *estate, int eflags)
 {
 	ScatterState *scatterstate;
-	Plan	   *childPlan;
+	int dst, size, i;
+	uuid_t port = node->port;
 
 	/* check for unsupported flags */
-	Assert(!(eflags)); // FIXME: no flags supported
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK))); // FIXME: no backward scans or marks
 
 	/*
 	 * create state structure
@@ -138,7 +632,66 @@ ExecInitScatter (Scatter *node, EState *estate, int eflags)
 
 	scatterstate->status = PAR_OK;
 	scatterstate->isSending = 0;
+	scatterstate->eof = 0;
 	scatterstate->upstreamTuple = NULL;
+	scatterstate->upstreamDst = 0;
+
+	/*
+	 * Frames, one per destination
+	 */
+	size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	scatterstate->frames = palloc(size * sizeof(StringInfoData));
+	scatterstate->framecnt = palloc0(size * sizeof(int));
+	scatterstate->toflush = palloc0(size * sizeof(int));
+	scatterstate->requests = palloc(size * sizeof(_pargresql_request_t));
+	scatterstate->inflight = palloc0(size * sizeof(int));
+	scatterstate->local = palloc(size * sizeof(int));
+	scatterstate->nlocal = 0;
+	for (dst = 0; dst < size; dst++)
+	{
+		scatterstate->local[dst] = _pargresql_IsLocal(dst, port); // FIXME: INIS naming
+		if (scatterstate->local[dst] && dst != _pargresql_GetNode()) // FIXME: INIS naming
+		{
+			scatterstate->nlocal++;
+		}
+		initStringInfo(&scatterstate->frames[dst]);
+		scatter_reset_frame(scatterstate, dst);
+	}
+	scatterstate->haspending = palloc0(size * sizeof(int));
+	scatterstate->pendingoff = palloc0(size * sizeof(int));
+	scatterstate->routed = palloc0(size * sizeof(long));
+	scatterstate->sentframes = palloc0(size * sizeof(long));
+	scatterstate->sentbytes = palloc0(size * sizeof(long));
+	scatterstate->hot = 0;
+	scatterstate->bloom = NULL; // set by the hash join above, if any
+	scatterstate->filtered = 0;
+	scatterstate->nexthot = _pargresql_GetNode(); // FIXME: INIS naming
+
+	/*
+	 * The sources of a cancelable exchange listen to node 0 all along
+	 */
+	scatterstate->stoppending = 0;
+	scatterstate->stopped = 0;
+	if (node->cancelable && _pargresql_GetNode() != 0 // FIXME: INIS naming
+		&& !(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+	{
+		_pargresql_IRecv(0, PAR_STOP_PORT(port), 1, &scatterstate->stopbuf, &scatterstate->stopreq); // FIXME: INIS naming
+		scatterstate->stoppending = 1;
+	}
+
+	/*
+	 * Fragmentation hash functions, and a context to call them in
+	 */
+	scatterstate->hashfunctions = palloc(node->numCols * sizeof(FmgrInfo));
+	for (i = 0; i < node->numCols; i++)
+	{
+		fmgr_info(node->fragFunctions[i], &scatterstate->hashfunctions[i]);
+	}
+	if (node->fragScheme != NULL)
+	{
+		fmgr_info(node->fragScheme->cmpfunc, &scatterstate->fragcmp);
+	}
+	ExecAssignExprContext(estate, &scatterstate->ps);
 
 	/*
 	 * Tuple table initialization
@@ -152,6 +705,13 @@ ExecInitScatter (Scatter *node, EState *estate, int eflags)
 	ExecAssignResultTypeFromTL(&scatterstate->ps);
 	scatterstate->ps.ps_ProjInfo = NULL;
 
+	/*
+	 * The tuples are packed to the same buffers one by one
+	 */
+	scatterstate->layout = par_tuplayout(scatterstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor);
+	initStringInfo(&scatterstate->packed);
+	initStringInfo(&scatterstate->minimal);
+
 	return scatterstate;
 }
 
@@ -173,13 +733,117 @@ ExecCountSlotsScatter(Scatter *node)
 void
 ExecEndScatter(ScatterState *node)
 {
+	int dst;
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	long total = 0, most = 0;
+	TimestampTz start;
+
+	for (dst = 0; dst < size; dst++)
+	{
+		total += node->routed[dst];
+		most = Max(most, node->routed[dst]);
+	}
+	// The counts are only reported, the hot keys stay as planned
+	// (see par_plannodes.h)
+	if (total > 0)
+	{
+		elog(DEBUG1, "scatter(port=%d): %ld tuples, %ld with hot keys, at most %ld to one node",
+			((Scatter*)node->ps.plan)->port, total, node->hot, most);
+	}
+	if (node->filtered > 0)
+	{
+		elog(DEBUG1, "scatter(port=%d): %ld tuples filtered out by the hash join",
+			((Scatter*)node->ps.plan)->port, node->filtered);
+	}
+
+	// Node 0 sends the stop message to every source, at the latest
+	// when it gets the EOF, so the receive has to complete. A node 0
+	// that has failed never sends it, so the wait is bounded; the
+	// receive given up on stays posted, as INIS cannot cancel it
+	start = GetCurrentTimestamp();
+	while (node->stoppending)
+	{
+		scatter_stopped(node);
+		if (!node->stoppending)
+		{
+			break;
+		}
+		if (TimestampDifferenceExceeds(start, GetCurrentTimestamp(), SCATTER_STOP_TIMEOUT * 1000))
+		{
+			elog(WARNING, "scatter(port=%d): node 0 has not stopped the exchange in %d seconds",
+				((Scatter*)node->ps.plan)->port, SCATTER_STOP_TIMEOUT);
+			break;
+		}
+		_pargresql_Wait(100); // FIXME: INIS naming
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	for (dst = 0; dst < size; dst++)
+	{
+		pfree(node->frames[dst].data);
+	}
+	pfree(node->frames);
+	pfree(node->framecnt);
+	pfree(node->toflush);
+	pfree(node->requests);
+	pfree(node->inflight);
+	pfree(node->local);
+	pfree(node->haspending);
+	pfree(node->pendingoff);
+	pfree(node->routed);
+	pfree(node->sentframes);
+	pfree(node->sentbytes);
+	pfree(node->hashfunctions);
+	par_free_tuplayout(node->layout);
+	pfree(node->packed.data);
+	pfree(node->minimal.data);
+	ExecFreeExprContext(&node->ps);
 }
 
 
 void
 ExecReScanScatter(ScatterState *node, ExprContext *exprCtxt)
 {
-	node->buf = NULL;
+	int dst;
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+
+	// The stop message comes once per query, so a stopped stream
+	// cannot be started again
+	if (((Scatter*)node->ps.plan)->cancelable)
+	{
+		elog(ERROR, "scatter(port=%d): a cancelable exchange cannot be rescanned",
+			((Scatter*)node->ps.plan)->port);
+	}
+
+	for (dst = 0; dst < size; dst++)
+	{
+		// Let INIS get its blocks back before the request is reused
+		while (node->inflight[dst])
+		{
+			int flag;
+			_pargresql_Test(&node->requests[dst], &flag); // FIXME: INIS naming
+			if (flag)
+			{
+				node->inflight[dst] = 0;
+			}
+			else
+			{
+				_pargresql_Wait(100); // FIXME: INIS naming
+				CHECK_FOR_INTERRUPTS();
+			}
+		}
+		scatter_reset_frame(node, dst);
+		node->toflush[dst] = 0;
+		// A tuple sent in pieces starts over from its first piece
+		node->haspending[dst] = 0;
+		node->pendingoff[dst] = 0;
+		node->routed[dst] = 0;
+	}
+	node->upstreamTuple = NULL;
+	node->upstreamDst = 0;
+	node->hot = 0;
+	node->filtered = 0;
 	node->status = PAR_OK;
 	node->isSending = 0;
+	node->eof = 0;
 }
@@ -8,12 +8,10 @@
 
 #include "postgres.h"
 
-#include "access/par_tupack.h"
 #include "executor/executor.h"
 #include "executor/par_nodeSplit.h"
 #include "executor/par_nodeScatter.h"
 
-extern void printhex(char *name, char *buf, int len);
 
 /* ----------------------------------------------------------------
  *		ExecSplit
@@ -57,43 +55,57 @@ ExecSplit(SplitState *node)
 			// The right son (i.e. Scatter) is still busy,
 			// so we wait for him.
 			node->status = PAR_WAIT;
-			return slot;
+			return NULL;
+		}
+		if (right->eof)
+		{
+			// The right son has finished scattering the NULLs.
+			node->sent_nulls = 1;
+			node->status = PAR_OK;
+			return NULL;
 		}
 	}
 
 	// The buffer of the right son is empty.
-	// Advance the left son.
-	slot = ExecProcNode(left);
+	// Advance the left son, unless nobody needs its tuples any more.
+	slot = scatter_stopped(right) ? NULL : ExecProcNode(left);
 	if (TupIsNull(slot))
 	{
-		// Got an EOF tuple from below - scatter it!
+		// Got an EOF tuple from below (or stopped) - scatter it!
 		elog(DEBUG5, "split: got an EOF from below, scattering it");
 		right->upstreamTuple = NULL;
 		ExecProcNode((PlanState*)right);
+		if (right->status == PAR_WAIT)
+		{
+			// The frames are still on their way,
+			// we'll be back for them.
+			node->status = PAR_WAIT;
+			return NULL;
+		}
 		node->sent_nulls = 1;
+		node->status = PAR_OK;
 		return NULL;
 	}
 	else
 	{
-		int dst, rank, size, fragattr;
-
-		// Get the fragattr value from Scatter
-		fragattr = node->ps.plan->righttree->fragattr;
+		int dst, rank;
 
 		rank = _pargresql_GetNode(); // FIXME: INIS naming
-		size = _pargresql_GetNodesCount(); // FIXME: INIS naming
-		// Got a normal tuple
-		elog(DEBUG5, "split: calling fragfunc");
-		dst = fragfunc(size, slot, fragattr);
-		elog(DEBUG5, "split: fragfunc finished");
+		// Got a normal tuple, the Scatter knows where it belongs
+		dst = scatter_route(right, slot);
+		if (dst == PAR_DST_ALL)
+		{ // Everyone gets a copy, and so do we
+			elog(DEBUG5, "split: broadcasting a tuple");
+			right->upstreamTuple = slot;
+			right->upstreamDst = dst;
+			ExecProcNode((PlanState*)right);
+			node->status = PAR_OK;
+			return slot;
+		}
 		if (dst == rank)
 		{ // Native tuple, keep it
-			StringInfoData sid;
 			node->status = PAR_OK;
-			elog(DEBUG5, "split: a native tuple (fragfunc == %d, data below)", dst);
-			sid = par_tupack(slot);
-			pfree(sid.data);
-			printhex("the data", sid.data, sid.len);
+			elog(DEBUG5, "split: a native tuple (fragfunc == %d)", dst);
 			return slot;
 		}
 		else
@@ -114,6 +126,7 @@ ExecSplit(SplitState *node)
 
 				// Scatter the modified tuple
 				right->upstreamTuple = slot;
+				right->upstreamDst = dst;
 				ExecProcNode((PlanState*)right);
 
 				ItemPointerCopy(&ipdata, ctid); // Return to the old value of ctid
@@ -125,15 +138,12 @@ ExecSplit(SplitState *node)
 				node->status = PAR_OK; // We return a tuple flagged as "DELETE ME"
 				return slot;
 			} else {
-				StringInfoData sid;
-				elog(DEBUG5, "split: an alien tuple (fragfunc == %d, data below), expelling", dst);
-				sid = par_tupack(slot);
-				printhex("the data", sid.data, sid.len);
-				pfree(sid.data);
+				elog(DEBUG5, "split: an alien tuple (fragfunc == %d), expelling", dst);
 				// Scatter the tuple
 				right->upstreamTuple = slot;
+				right->upstreamDst = dst;
 				ExecProcNode((PlanState*)right);
-				node->status = PAR_WAIT;
+				node->status = PAR_PROGRESS;
 				return NULL;
 			}
 		}
@@ -154,7 +164,7 @@ ExecInitSplit (Split *node, EState *estate, int eflags)
 	Plan	   *childPlan;
 
 	/* check for unsupported flags */
-	Assert(!(eflags)); // FIXME: no flags supported
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK))); // FIXME: no backward scans or marks
 
 	/*
 	 * create state structure
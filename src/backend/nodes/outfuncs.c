@@ -285,6 +285,7 @@ _outScanInfo(StringInfo str, Scan *node)
 	_outPlanInfo(str, (Plan *) node);
 
 	WRITE_UINT_FIELD(scanrelid);
+	WRITE_BOOL_FIELD(cooperative);
 }
 
 /*
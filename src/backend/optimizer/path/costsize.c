@@ -11,6 +11,8 @@
  *	cpu_tuple_cost		Cost of typical CPU time to process a tuple
  *	cpu_index_tuple_cost  Cost of typical CPU time to process an index tuple
  *	cpu_operator_cost	Cost of CPU time to execute an operator or function
+ *	pargresql_network_tuple_cost  Cost of sending a tuple to another node
+ *	pargresql_network_byte_cost  Cost of sending a byte to another node
  *
  * We expect that the kernel will typically do some amount of read-ahead
  * optimization; this in conjunction with seek costs means that seq_page_cost
@@ -95,6 +97,8 @@ double		random_page_cost = DEFAULT_RANDOM_PAGE_COST;
 double		cpu_tuple_cost = DEFAULT_CPU_TUPLE_COST;
 double		cpu_index_tuple_cost = DEFAULT_CPU_INDEX_TUPLE_COST;
 double		cpu_operator_cost = DEFAULT_CPU_OPERATOR_COST;
+double		pargresql_network_tuple_cost = DEFAULT_PARGRESQL_NETWORK_TUPLE_COST;
+double		pargresql_network_byte_cost = DEFAULT_PARGRESQL_NETWORK_BYTE_COST;
 
 int			effective_cache_size = DEFAULT_EFFECTIVE_CACHE_SIZE;
 
@@ -1215,6 +1219,37 @@ cost_material(Path *path,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_exchange
+ *	  Determines and returns the cost of a PargreSQL Exchange, and also
+ *	  the estimated output size.
+ *
+ * 'shipped' is the number of tuples that one node sends to and receives
+ * from the other nodes, 'rows' is the number of tuples the Exchange
+ * returns on one node.
+ *
+ * As in cost_recursive_union, the arguments are Plans, since the
+ * Exchanges are only put into the finished plan.
+ */
+void
+cost_exchange(Plan *exchange, Plan *input, double shipped, double rows)
+{
+	Cost		per_tuple;
+
+	per_tuple = pargresql_network_tuple_cost +
+		pargresql_network_byte_cost * input->plan_width;
+
+	/*
+	 * The tuples are streamed, so only the run cost grows.  Also charge
+	 * cpu_tuple_cost per returned row for packing and unpacking.
+	 */
+	exchange->startup_cost = input->startup_cost;
+	exchange->total_cost = input->total_cost + per_tuple * shipped +
+		cpu_tuple_cost * rows;
+	exchange->plan_rows = rows;
+	exchange->plan_width = input->plan_width;
+}
+
 /*
  * cost_agg
  *		Determines and returns the cost of performing an Agg plan node,
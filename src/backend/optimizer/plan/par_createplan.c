@@ -3,6 +3,8 @@
 #else // PAR_CREATEPLAN_C is undefined
 #define PAR_CREATEPLAN_C
 
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
 Split *make_split(Plan *lefttree, Plan *righttree)
 {
 	Split	*node = makeNode(Split);
@@ -36,6 +38,10 @@ Merge *make_merge(Plan *lefttree, Plan *righttree)
 	plan->qual = NIL;
 	plan->lefttree = lefttree;
 	plan->righttree = righttree;
+	node->numCols = 0;
+	node->sortColIdx = NULL;
+	node->sortOperators = NULL;
+	node->nullsFirst = NULL;
 
 	return node;
 }
@@ -44,8 +50,12 @@ Merge *make_merge(Plan *lefttree, Plan *righttree)
  * sibling has to be the other child of the Split of the
  * same Exchange "metanode". It's used because Scatter
  * is a nullary operation.
+ *
+ * The tuples are distributed by the hash of the numCols columns
+ * listed in fragColIdx, fragFunctions are the hash functions of
+ * their types. numCols == 0 sends everything to node 0.
  */
-Scatter *make_scatter(Plan *sibling, int port, int fragattr)
+Scatter *make_scatter(Plan *sibling, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions)
 {
 	Scatter	*node = makeNode(Scatter);
 	Plan	*plan = &node->plan;
@@ -58,7 +68,18 @@ Scatter *make_scatter(Plan *sibling, int port, int fragattr)
 	plan->lefttree = NULL;
 	plan->righttree = NULL;
 	node->port = port;
-	plan->fragattr = fragattr;
+	node->broadcast = false;
+	node->numCols = numCols;
+	node->fragColIdx = fragColIdx;
+	node->fragFunctions = fragFunctions;
+	node->skew = PAR_SKEW_NONE;
+	node->numHot = 0;
+	node->hotHashes = NULL;
+	node->toFragments = false;
+	node->fragScheme = NULL;
+	node->cancelable = false;
+	node->joinFilter = false;
+	plan->fragattr = (numCols > 0) ? fragColIdx[0] : 0;
 
 	return node;
 }
@@ -80,14 +101,15 @@ Gather *make_gather(Plan *sibling, int port)
 	plan->lefttree = NULL;
 	plan->righttree = NULL;
 	node->port = port;
+	node->cancelable = false;
 
 	return node;
 }
 
-Plan *make_exchange(Plan *plan, int port, int fragattr)
+Plan *make_exchange(Plan *plan, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions)
 {
 	Plan *split, *merge, *scatter, *gather;
-	scatter = (Plan*)make_scatter(plan, port, fragattr);
+	scatter = (Plan*)make_scatter(plan, port, numCols, fragColIdx, fragFunctions);
 	split = (Plan*)make_split(plan, scatter);
 	gather = (Plan*)make_gather(split, port);
 	merge = (Plan*)make_merge(gather, split);
@@ -96,8 +118,96 @@ Plan *make_exchange(Plan *plan, int port, int fragattr)
 	} else {
 		printf("OK, merge == %lx\n", (unsigned long)merge);
 	}
+	cost_exchange_of(merge, plan, numCols, false);
+	copy_plan_costsize(gather, merge);
+	return merge;
+}
+
+/*
+ * The same as make_exchange, but every node gets all the tuples.
+ */
+Plan *make_broadcast_exchange(Plan *plan, int port)
+{
+	Plan *merge = make_exchange(plan, port, 0, NULL, NULL);
+	((Scatter*)merge->righttree->righttree)->broadcast = true;
+	cost_exchange_of(merge, plan, 0, true);
+	copy_plan_costsize(merge->lefttree, merge);
 	return merge;
 }
 
+/*
+ * An Exchange over the plan which brings everything to node 0 in
+ * order: every node sorts its own tuples, and node 0 merges them.
+ * The output of the plan has to be in the order of the Sort (which
+ * is either the plan itself, or a Limit over it).
+ */
+Plan *make_sorted_exchange(Plan *plan, Sort *sort, int port)
+{
+	return make_ordered_exchange(plan, port, 0, NULL, NULL,
+		sort->numCols, sort->sortColIdx, sort->sortOperators, sort->nullsFirst);
+}
+
+/*
+ * An Exchange over the plan whose output is in the order of the given
+ * sort keys: the tuples every node gets from the others are merged with
+ * its own ones by the keys, so the output of the plan has to be in
+ * that order on every node.
+ * The merge costs a comparison per tuple for every level of the heap.
+ *
+ * Only the Exchange to node 0 (numCols == 0) merges its streams. In a
+ * hashed one, the Split of every node stops reading its input while its
+ * own tuple waits in the heap, and the tuples the other nodes wait for
+ * may come after it in that input, so the nodes could wait for each
+ * other forever. A hashed Exchange gets a Sort over it instead.
+ */
+Plan *make_ordered_exchange(Plan *plan, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions,
+	int numSortCols, AttrNumber *sortColIdx, Oid *sortOperators, bool *nullsFirst)
+{
+	Plan *merge = make_exchange(plan, port, numCols, fragColIdx, fragFunctions);
+	double nodes = _pargresql_GetNodesCount(); // FIXME: INIS naming
+
+	if (numCols > 0)
+	{
+		return (Plan*)make_sort(NULL, merge, numSortCols, sortColIdx, sortOperators, nullsFirst, -1.0);
+	}
+
+	((Merge*)merge)->numCols = numSortCols;
+	((Merge*)merge)->sortColIdx = sortColIdx;
+	((Merge*)merge)->sortOperators = sortOperators;
+	((Merge*)merge)->nullsFirst = nullsFirst;
+	if (nodes > 1 && numSortCols > 0)
+	{
+		merge->total_cost += 2.0 * cpu_operator_cost * merge->plan_rows * ceil(log(nodes) / log(2.0));
+	}
+	copy_plan_costsize(merge->lefttree, merge);
+	return merge;
+}
+
+/*
+ * Fills the costs and the size of an Exchange over the plan. A hashed
+ * Exchange sends (nodes - 1) / nodes of the tuples away and gets about
+ * as many from the others. The constant one (numCols == 0) brings
+ * everything to node 0, and a broadcast one brings everything to every
+ * node, so (nodes - 1) times more tuples arrive than there were.
+ */
+void cost_exchange_of(Plan *exchange, Plan *plan, int numCols, bool broadcast)
+{
+	double nodes = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	double rows = plan->plan_rows;
+
+	if (broadcast)
+	{
+		cost_exchange(exchange, plan, 2 * rows * (nodes - 1), rows * nodes);
+	}
+	else if (numCols == 0)
+	{
+		cost_exchange(exchange, plan, rows * (nodes - 1), rows * nodes);
+	}
+	else
+	{
+		cost_exchange(exchange, plan, 2 * rows * (nodes - 1) / nodes, rows);
+	}
+}
+
 #endif
 
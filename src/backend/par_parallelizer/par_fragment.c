@@ -0,0 +1,518 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_fragment.c
+ *	  Range and list fragmentation of the relations in PargreSQL.
+ *
+ * See par_fragment.h for the meaning of the reloptions, and of the
+ * virtual buckets of the hashed relations.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <ctype.h>
+
+#include "access/heapam.h"
+#include "access/nbtree.h"
+#include "access/par_coopscan.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_par_bucket.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/planmain.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/tqual.h"
+#include "par_parallelizer/par_fragment.h"
+#include "par_parallelizer/par_parallelizer.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+typedef struct FragValue
+{
+	Datum value;
+	int node;
+} FragValue;
+
+// The fragments of the buckets, valid until pg_par_bucket changes
+static int bucket_map[PAR_BUCKETS];
+static bool bucket_map_valid = false;
+static uint32 bucket_map_changes = 0;
+static bool bucket_callback_registered = false;
+
+static char *next_bound(char **str, char sep);
+static int compare_frag_values(const void *a, const void *b, void *arg);
+static Expr *make_bound_op(ParFragScheme *scheme, int strategy, Expr *arg, int i);
+static void bucket_map_invalidate(Datum arg, int cacheid, ItemPointer tuplePtr);
+static void load_bucket_map(void);
+
+// Cuts the next item out of the 'sep'-separated string, without the
+// surrounding spaces. Returns NULL when there is nothing left.
+static char *next_bound(char **str, char sep)
+{
+	char *item, *end;
+
+	if (*str == NULL)
+	{
+		return NULL;
+	}
+	item = *str;
+	end = strchr(item, sep);
+	if (end != NULL)
+	{
+		*end = '\0';
+		*str = end + 1;
+	}
+	else
+	{
+		*str = NULL;
+	}
+
+	while (isspace((unsigned char)*item))
+	{
+		item++;
+	}
+	end = item + strlen(item);
+	while (end > item && isspace((unsigned char)end[-1]))
+	{
+		*--end = '\0';
+	}
+	return item;
+}
+
+static int compare_frag_values(const void *a, const void *b, void *arg)
+{
+	return DatumGetInt32(FunctionCall2((FmgrInfo*)arg,
+		((const FragValue*)a)->value, ((const FragValue*)b)->value));
+}
+
+int par_fragments_count(void)
+{
+	int nodes = _pargresql_GetNodesCount(); // FIXME: INIS naming
+
+	if (nodes % par_scan_workers != 0)
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("%d nodes cannot be split into fragments of %d",
+				nodes, par_scan_workers),
+			 errhint("Set pargresql_scan_workers to a divisor of the number of nodes.")));
+	}
+	return nodes / par_scan_workers;
+}
+
+int par_my_fragment(void)
+{
+	return _pargresql_GetNode() / par_scan_workers; // FIXME: INIS naming
+}
+
+int par_fragment_leader(int fragment)
+{
+	return fragment * par_scan_workers;
+}
+
+int par_hash_bucket(uint32 hash)
+{
+	return (hash & 0x7fffffff) % PAR_BUCKETS;
+}
+
+int par_hash_fragment(uint32 hash)
+{
+	if (par_fragments_count() == 1)
+	{
+		return 0;
+	}
+	if (!bucket_map_valid)
+	{
+		load_bucket_map();
+	}
+	return bucket_map[par_hash_bucket(hash)];
+}
+
+int par_read_bucket_map(int *map, int fragments)
+{
+	Relation rel;
+	HeapScanDesc scan;
+	HeapTuple tuple;
+	int recorded = 0;
+	int i;
+
+	for (i = 0; i < PAR_BUCKETS; i++)
+	{
+		map[i] = i % fragments;
+	}
+
+	rel = heap_open(ParBucketRelationId, AccessShareLock);
+	scan = heap_beginscan(rel, SnapshotNow, 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Form_pg_par_bucket form = (Form_pg_par_bucket)GETSTRUCT(tuple);
+
+		if (form->bucket < 0 || form->bucket >= PAR_BUCKETS || form->fragment < 0)
+		{
+			elog(ERROR, "invalid bucket %d of fragment %d in pg_par_bucket",
+				form->bucket, form->fragment);
+		}
+		map[form->bucket] = form->fragment;
+		recorded++;
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	return recorded;
+}
+
+// Forgets the map whenever pg_par_bucket changes
+static void bucket_map_invalidate(Datum arg, int cacheid, ItemPointer tuplePtr)
+{
+	bucket_map_valid = false;
+	bucket_map_changes++;
+}
+
+static void load_bucket_map(void)
+{
+	int fragments = par_fragments_count();
+	int map[PAR_BUCKETS];
+	uint32 changes;
+	int i;
+
+	if (!bucket_callback_registered)
+	{
+		CacheRegisterSyscacheCallback(PARBUCKET, bucket_map_invalidate, (Datum)0);
+		bucket_callback_registered = true;
+	}
+
+	changes = bucket_map_changes;
+	par_read_bucket_map(map, fragments);
+	for (i = 0; i < PAR_BUCKETS; i++)
+	{
+		if (map[i] >= fragments)
+		{
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("bucket %d belongs to fragment %d, but there are only %d fragments",
+					i, map[i], fragments),
+				 errhint("Removing the nodes from a cluster is not supported.")));
+		}
+	}
+	memcpy(bucket_map, map, sizeof(map));
+
+	// If pg_par_bucket has changed while being read, read it again next time
+	bucket_map_valid = (bucket_map_changes == changes);
+}
+
+Datum pargresql_hash_bucket(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(par_hash_bucket(PG_GETARG_UINT32(0)));
+}
+
+Datum pargresql_hash_fragment(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(par_hash_fragment(PG_GETARG_UINT32(0)));
+}
+
+ParFragScheme *get_relid_fragscheme(Oid relid)
+{
+	Relation relation;
+	StdRdOptions *opts;
+	char *method = NULL, *bounds = NULL, *group, *item;
+	ParFragScheme *scheme;
+	Oid opclass, typinput, typioparam;
+	FmgrInfo cmp;
+	FragValue *values;
+	int maxvalues, node, nodes, i;
+
+	relation = RelationIdGetRelation(relid);
+	opts = (StdRdOptions*)relation->rd_options;
+	// the string options are stored as offsets, see get_relid_fragattr
+	if (opts != NULL && opts->fragmethod != NULL)
+	{
+		method = pstrdup(((char*)opts) + (long)opts->fragmethod);
+	}
+	if (opts != NULL && opts->fragbounds != NULL)
+	{
+		bounds = pstrdup(((char*)opts) + (long)opts->fragbounds);
+	}
+	RelationClose(relation);
+
+	if (method == NULL || strcmp(method, "hash") == 0)
+	{
+		return NULL;
+	}
+
+	scheme = (ParFragScheme*)palloc0(sizeof(ParFragScheme));
+	scheme->method = (strcmp(method, "range") == 0) ? PAR_FRAG_RANGE : PAR_FRAG_LIST;
+	scheme->attno = get_relid_fragatno(relid);
+	if (scheme->attno <= 0)
+	{
+		elog(ERROR, "relation \"%s\" has no valid fragattr", get_rel_name(relid));
+	}
+	if (bounds == NULL)
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("relation \"%s\" is fragmented by %s, but has no fragbounds",
+				get_rel_name(relid), method)));
+	}
+
+	scheme->atttype = get_atttype(relid, scheme->attno);
+	scheme->atttypmod = get_atttypmod(relid, scheme->attno);
+	get_typlenbyval(scheme->atttype, &scheme->typlen, &scheme->typbyval);
+	opclass = GetDefaultOpClass(scheme->atttype, BTREE_AM_OID);
+	if (!OidIsValid(opclass))
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_FUNCTION),
+			 errmsg("could not identify an ordering operator for type %s",
+				format_type_be(scheme->atttype)),
+			 errdetail("Range and list fragmentation need a btree operator class.")));
+	}
+	scheme->opfamily = get_opclass_family(opclass);
+	scheme->opcintype = get_opclass_input_type(opclass);
+	scheme->cmpfunc = get_opfamily_proc(scheme->opfamily,
+		scheme->opcintype, scheme->opcintype, BTORDER_PROC);
+	if (!OidIsValid(scheme->cmpfunc))
+	{
+		elog(ERROR, "missing support function %d(%u,%u) in opfamily %u",
+			BTORDER_PROC, scheme->opcintype, scheme->opcintype, scheme->opfamily);
+	}
+	fmgr_info(scheme->cmpfunc, &cmp);
+
+	// Every ',' or ';' starts one more value
+	maxvalues = 1;
+	for (item = bounds; *item != '\0'; item++)
+	{
+		if (*item == ',' || *item == ';')
+		{
+			maxvalues++;
+		}
+	}
+	values = (FragValue*)palloc(maxvalues * sizeof(FragValue));
+
+	// The first range bound is the lower bound of node 1
+	getTypeInputInfo(scheme->atttype, &typinput, &typioparam);
+	nodes = par_fragments_count();
+	node = (scheme->method == PAR_FRAG_RANGE) ? 1 : 0;
+	while ((group = next_bound(&bounds, ';')) != NULL)
+	{
+		if (node >= nodes)
+		{
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("fragbounds of relation \"%s\" describe more than %d nodes",
+					get_rel_name(relid), nodes)));
+		}
+		if (scheme->method == PAR_FRAG_RANGE)
+		{
+			if (*group == '\0')
+			{
+				ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("empty range bound in fragbounds of relation \"%s\"",
+						get_rel_name(relid))));
+			}
+			values[scheme->numValues].value = OidInputFunctionCall(typinput, group, typioparam, scheme->atttypmod);
+			values[scheme->numValues].node = node;
+			scheme->numValues++;
+		}
+		else
+		{
+			// A node may have no values at all
+			while ((item = next_bound(&group, ',')) != NULL)
+			{
+				if (*item == '\0')
+				{
+					continue;
+				}
+				values[scheme->numValues].value = OidInputFunctionCall(typinput, item, typioparam, scheme->atttypmod);
+				values[scheme->numValues].node = node;
+				scheme->numValues++;
+			}
+		}
+		node++;
+	}
+
+	if (scheme->method == PAR_FRAG_LIST)
+	{
+		qsort_arg(values, scheme->numValues, sizeof(FragValue), compare_frag_values, &cmp);
+	}
+	for (i = 1; i < scheme->numValues; i++)
+	{
+		int c = compare_frag_values(&values[i - 1], &values[i], &cmp);
+		if (scheme->method == PAR_FRAG_RANGE && c >= 0)
+		{
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("range bounds in fragbounds of relation \"%s\" are not ascending",
+					get_rel_name(relid))));
+		}
+		if (scheme->method == PAR_FRAG_LIST && c == 0)
+		{
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("a value is listed twice in fragbounds of relation \"%s\"",
+					get_rel_name(relid))));
+		}
+	}
+
+	scheme->values = (Datum*)palloc(Max(scheme->numValues, 1) * sizeof(Datum));
+	scheme->nodes = (int*)palloc(Max(scheme->numValues, 1) * sizeof(int));
+	for (i = 0; i < scheme->numValues; i++)
+	{
+		scheme->values[i] = values[i].value;
+		scheme->nodes[i] = values[i].node;
+	}
+	pfree(values);
+	pfree(method);
+
+	return scheme;
+}
+
+int fragscheme_node(ParFragScheme *scheme, FmgrInfo *cmp, Datum value, bool isnull)
+{
+	int lo, hi;
+
+	if (isnull)
+	{
+		return 0;
+	}
+
+	// Find the number of values not greater than 'value'
+	lo = 0;
+	hi = scheme->numValues;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (DatumGetInt32(FunctionCall2(cmp, scheme->values[mid], value)) <= 0)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if (lo == 0)
+	{
+		return 0;
+	}
+	if (scheme->method == PAR_FRAG_RANGE)
+	{
+		return scheme->nodes[lo - 1];
+	}
+	if (DatumGetInt32(FunctionCall2(cmp, scheme->values[lo - 1], value)) == 0)
+	{
+		return scheme->nodes[lo - 1];
+	}
+	return 0;
+}
+
+// Makes 'arg <op> values[i]', where op is the btree operator of the strategy.
+static Expr *make_bound_op(ParFragScheme *scheme, int strategy, Expr *arg, int i)
+{
+	Oid opno;
+	Expr *op;
+
+	opno = get_opfamily_member(scheme->opfamily, scheme->opcintype, scheme->opcintype, strategy);
+	if (!OidIsValid(opno))
+	{
+		elog(ERROR, "missing operator %d(%u,%u) in opfamily %u",
+			strategy, scheme->opcintype, scheme->opcintype, scheme->opfamily);
+	}
+	op = make_opclause(opno, BOOLOID, false, arg, (Expr*)makeConst(
+		scheme->atttype,
+		scheme->atttypmod,
+		scheme->typlen,
+		scheme->values[i],
+		false,
+		scheme->typbyval
+	));
+	set_opfuncid((OpExpr*)op);
+	return op;
+}
+
+Expr *fragscheme_qual(ParFragScheme *scheme, Expr *arg, int node)
+{
+	List *args = NIL, *others = NIL;
+	Expr *qual;
+	NullTest *isnull;
+	int i;
+
+	if (scheme->method == PAR_FRAG_RANGE)
+	{
+		int lower = -1, upper = -1;
+
+		for (i = 0; i < scheme->numValues; i++)
+		{
+			if (scheme->nodes[i] == node)
+			{
+				lower = i;
+			}
+			if (scheme->nodes[i] == node + 1)
+			{
+				upper = i;
+			}
+		}
+		if (node > 0 && lower < 0)
+		{
+			// There are fewer ranges than nodes
+			return (Expr*)makeBoolConst(false, false);
+		}
+		if (lower >= 0)
+		{
+			args = lappend(args, make_bound_op(scheme, BTGreaterEqualStrategyNumber, arg, lower));
+		}
+		if (upper >= 0)
+		{
+			args = lappend(args, make_bound_op(scheme, BTLessStrategyNumber, arg, upper));
+		}
+	}
+	else
+	{
+		for (i = 0; i < scheme->numValues; i++)
+		{
+			Expr *eq = make_bound_op(scheme, BTEqualStrategyNumber, arg, i);
+			if (scheme->nodes[i] == node)
+			{
+				args = lappend(args, eq);
+			}
+			else
+			{
+				others = lappend(others, eq);
+			}
+		}
+		if (node > 0)
+		{
+			// Only the listed values
+			return (args == NIL) ? (Expr*)makeBoolConst(false, false)
+				: (list_length(args) == 1) ? (Expr*)linitial(args) : make_orclause(args);
+		}
+		// Node 0 gets everything that is not listed for the others
+		args = NIL;
+		if (others != NIL)
+		{
+			args = list_make1(make_notclause((list_length(others) == 1) ?
+				(Expr*)linitial(others) : make_orclause(others)));
+		}
+	}
+
+	if (args == NIL)
+	{
+		return (Expr*)makeBoolConst(true, false);
+	}
+	qual = (list_length(args) == 1) ? (Expr*)linitial(args) : make_andclause(args);
+	if (node == 0)
+	{
+		isnull = makeNode(NullTest);
+		isnull->arg = arg;
+		isnull->nulltesttype = IS_NULL;
+		qual = make_orclause(list_make2(qual, isnull));
+	}
+	return qual;
+}
@@ -8,8 +8,16 @@
 
 #include "postgres.h"
 
+#include "access/transam.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
 #include "nodes/plannodes.h"
 #include "nodes/relation.h"
 #include "nodes/nodeFuncs.h"
@@ -17,27 +25,33 @@
 //#include "executor/executor.h"
 //#include "executor/nodeAgg.h"
 //#include "miscadmin.h"
-//#include "nodes/makefuncs.h"
-//#include "optimizer/clauses.h"
-//#include "optimizer/cost.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
 //#include "optimizer/pathnode.h"
 //#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 //#include "optimizer/planner.h"
+#include "optimizer/predtest.h"
 //#include "optimizer/prep.h"
 //#include "optimizer/subselect.h"
-//#include "optimizer/tlist.h"
+#include "optimizer/tlist.h"
 //#include "optimizer/var.h"
+#include "access/par_coopscan.h"
+#include "executor/par_bloom.h"
 #include "par_parallelizer/par_parallelizer.h"
+#include "par_parallelizer/par_fragment.h"
 #include "par_inis/_pargresql_library.h"
 //#ifdef OPTIMIZER_DEBUG
 //#include "nodes/print.h"
 //#endif
 //#include "parser/parse_expr.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_func.h"
 #include "parser/parse_node.h"
 #include "parser/parse_oper.h"
 #include "parser/parse_relation.h"
-//#include "parser/parsetree.h"
+#include "parser/parsetree.h"
 //#include "utils/lsyscache.h"
 //#include "utils/syscache.h"
 
@@ -47,15 +61,77 @@
  *
  *****************************************************************************/
 
+/*
+ * How the output of a subplan is spread over the nodes.
+ */
+typedef enum DistributionKind
+{
+	DIST_ANY,			// every node has some part of it, we do not know which
+	DIST_HASHED,		// by the hash of 'keys', the way fragfunc does it
+	DIST_REPLICATED		// every node has all of it
+} DistributionKind;
+
+typedef struct Distribution
+{
+	DistributionKind kind;
+	List *keys;			// the key expressions, for DIST_HASHED
+	List *functions;	// the OIDs of their hash functions
+	bool pinned;		// holds the rows of the result relation of an UPDATE
+						// or DELETE, which have to stay on their nodes
+} Distribution;
+
 void print_targetlist(List *targetlist);
 void print_opexprlist(List *opexprlist);
 void print_restrictlist(List *restrictlist);
 bool isleft(Plan *parent, Plan *child);
-int joinattr(Plan *parent, Plan *child);
+int join_exchange_keys(Plan *join, AttrNumber **leftColIdx, Oid **leftFunctions, AttrNumber **rightColIdx, Oid **rightFunctions);
+bool agg_exchange_functions(Agg *agg, Oid **functions);
+Oid get_type_hash_function(Oid type);
 void print_nodetag_recursive(Plan *plan);
-Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int joinattr);
-Plan *par_Parallelize_recursive(Plan *plan, int *port);
-void add_qual_attr_mod_nodes_equals_me(Plan *plan, int attr, int nodes, int me);
+Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions);
+Plan *insert_broadcast_here_or_deeper(Plan *plan, int *port);
+void scan_distribution(Scan *scan, List *rtable, Index resultRelation, Distribution *dist);
+bool scan_is_excluded(Scan *scan, List *rtable);
+bool is_frag_key_op(Oid opno, Node *left, Index varno, AttrNumber attno, Oid hashfunc);
+int const_frag_node(Datum value, bool isnull, Oid hashfunc);
+bool qual_frag_nodes(Node *qual, Index varno, AttrNumber attno, Oid hashfunc, int nodes, bool *allowed);
+Plan *make_empty_scan(Scan *scan);
+void hashed_distribution(Plan *plan, int numCols, AttrNumber *colIdx, Oid *functions, Distribution *dist);
+bool dist_key_matches(Expr *key, Expr *expr);
+bool join_is_colocated(Plan *join, int numCols, AttrNumber *lcols, Oid *lfuncs, AttrNumber *rcols, Oid *rfuncs, Distribution *ldist, Distribution *rdist);
+bool columns_are_colocated(Plan *input, int numCols, AttrNumber *colIdx, Distribution *dist);
+bool agg_is_colocated(Agg *agg, Distribution *dist);
+Cost exchange_network_cost(Plan *plan, int numCols, bool broadcast);
+void add_child_cost_delta(Plan *parent, Plan *child, Cost startup_before, Cost total_before);
+int redistribute_keys(Plan *hashed, Distribution *dist, int numCols, AttrNumber *cols, Oid *funcs, AttrNumber *othercols, Oid *otherfuncs, AttrNumber **newcols, Oid **newfuncs);
+int hot_key_hashes(Expr *key, Oid hashfunc, List *rtable, uint32 **hashes);
+void set_exchange_skew(Plan *plan, SkewMode skew, int numHot, uint32 *hotHashes);
+void set_exchange_fragments(Plan *plan, ParFragScheme *scheme);
+void set_exchange_cancelable(Plan *plan);
+void set_exchange_join_filter(Plan *join);
+Node *limit_pushdown_count(Limit *limit, int64 *count_est);
+Plan *parallelize_root_limit(Limit *limit, int *port);
+Plan *parallelize_join(Plan *plan, int *port, List *rtable, Distribution *ldist, Distribution *rdist, Distribution *dist);
+bool agg_is_decomposable_walker(Node *node, void *context);
+Expr *add_partial_aggref(List **partial_tlist, Aggref *aggref);
+Expr *make_builtin_aggref(const char *aggname, Expr *arg);
+Expr *coerce_agg_result(Expr *expr, Oid targettype);
+Node *split_agg_mutator(Node *node, List **partial_tlist);
+Plan *make_two_phase_agg(Agg *agg, int *port);
+void keep_only_on_node_zero(Plan *plan);
+Plan *parallelize_pinned_join(Plan *plan, int *port, int numCols, AttrNumber *lcols, Oid *lfuncs, AttrNumber *rcols, Oid *rfuncs, Distribution *ldist, Distribution *rdist);
+bool window_is_colocated(WindowAgg *wa, Distribution *dist);
+int window_sort_keys(WindowAgg *wa, Query *query, AttrNumber **colIdx, Oid **sortOperators, bool **nullsFirst);
+Plan *parallelize_window(WindowAgg *wa, int *port, Query *query, Distribution *ldist, Distribution *dist);
+Plan *exchange_append_branches(Append *append, int *port, int numCols, AttrNumber *colIdx, Oid *functions);
+int distinct_sort_keys(Plan *plan, Query *query, int numCols, AttrNumber *colIdx, Oid *operators, Oid **sortOperators, bool **nullsFirst);
+Plan *exchange_distinct_input(Plan *plan, int *port, Query *query, int numCols, AttrNumber *colIdx, Oid *operators, Distribution *ldist, Distribution *dist);
+Plan *parallelize_append(Append *append, int *port, Query *query, Index resultRelation, Distribution *dist);
+Plan *parallelize_subquery(SubqueryScan *scan, int *port, Query *query, Distribution *dist);
+Plan *par_Parallelize_recursive(Plan *plan, int *port, Query *query, Index resultRelation, Distribution *dist);
+void add_plan_qual(Plan *plan, Expr *qual);
+void add_qual_attr_hash_fragment_equals_me(Plan *plan, int attr, int me);
+void add_qual_attr_in_fragment_of_me(Plan *plan, int attr, ParFragScheme *scheme, int me);
 Oid get_query_result_relid(Query *query);
 AttrNumber get_atno_in_relid_by_atname(Oid relid, const char* atname);
 char *get_relid_fragattr(Oid relid);
@@ -108,56 +184,126 @@ bool isleft(Plan *parent, Plan *child)
 	return parent->lefttree == child;
 }
 
-int joinattr(Plan *parent, Plan *child)
+/*
+ * Finds the hashable equi-join clauses of the join and the columns of
+ * its children they compare. The key columns are located by looking up
+ * the clause arguments in the target lists of the children, and the hash
+ * functions come from the join operator, as in nodeHash.c, so the equal
+ * keys of both sides go to the same node even for cross-type operators.
+ * Returns the number of keys, 0 if the join has no clauses to hash by.
+ */
+int join_exchange_keys(Plan *join, AttrNumber **leftColIdx, Oid **leftFunctions, AttrNumber **rightColIdx, Oid **rightFunctions)
 {
 	List *oxlist;
-	OpExpr *ox;
-	char *opname;
+	ListCell *lc;
+	int numCols = 0;
+
+	if (IsA(join, MergeJoin)) { oxlist = ((MergeJoin*)join)->mergeclauses; }
+	else if (IsA(join, NestLoop)) { oxlist = ((Join*)join)->joinqual; }
+	else if (IsA(join, HashJoin)) { oxlist = ((HashJoin*)join)->hashclauses; }
+	else { Assert(false); oxlist = NIL; }
+
+	*leftColIdx = (AttrNumber*)palloc(sizeof(AttrNumber) * (list_length(oxlist) + 1));
+	*rightColIdx = (AttrNumber*)palloc(sizeof(AttrNumber) * (list_length(oxlist) + 1));
+	*leftFunctions = (Oid*)palloc(sizeof(Oid) * (list_length(oxlist) + 1));
+	*rightFunctions = (Oid*)palloc(sizeof(Oid) * (list_length(oxlist) + 1));
+
+	foreach(lc, oxlist)
+	{
+		OpExpr *ox = (OpExpr*)lfirst(lc);
+		TargetEntry *lte, *rte;
+		Oid lfunc, rfunc;
+
+		if (!IsA(ox, OpExpr) || list_length(ox->args) != 2)
+		{
+			continue;
+		}
+		if (!get_op_hash_functions(ox->opno, &lfunc, &rfunc))
+		{
+			continue;
+		}
+
+		lte = tlist_member((Node*)linitial(ox->args), join->lefttree->targetlist);
+		rte = tlist_member((Node*)lsecond(ox->args), join->righttree->targetlist);
+		if (lte == NULL || rte == NULL)
+		{
+			// NestLoop quals are not commuted to the "outer = inner" form
+			Oid tmp = lfunc;
+			lfunc = rfunc;
+			rfunc = tmp;
+			lte = tlist_member((Node*)lsecond(ox->args), join->lefttree->targetlist);
+			rte = tlist_member((Node*)linitial(ox->args), join->righttree->targetlist);
+		}
+		if (lte == NULL || rte == NULL)
+		{
+			continue;
+		}
+
+		(*leftColIdx)[numCols] = lte->resno;
+		(*leftFunctions)[numCols] = lfunc;
+		(*rightColIdx)[numCols] = rte->resno;
+		(*rightFunctions)[numCols] = rfunc;
+		numCols++;
+	}
 
-	if (IsA(parent, MergeJoin)) { oxlist = ((MergeJoin*)parent)->mergeclauses; }
-	else if (IsA(parent, NestLoop)) { oxlist = ((Join*)parent)->joinqual; }
-	else if (IsA(parent, HashJoin)) { oxlist = ((HashJoin*)parent)->hashclauses; }
-	else { Assert(false); }
+	return numCols;
+}
 
-	//Assert(!IsNull(oxlist));
-	ox = (OpExpr*)linitial(oxlist);
-	Assert(IsA(ox, OpExpr));
-	opname = get_opname(ox->opno);
-	Assert(opname[0] == '=');
-	pfree(opname);
+/*
+ * Finds the hash functions for the grouping columns of the Agg.
+ * Returns false if some of the grouping operators cannot be hashed.
+ */
+bool agg_exchange_functions(Agg *agg, Oid **functions)
+{
+	int i;
 
-	if (isleft(parent, child))
+	*functions = (Oid*)palloc(sizeof(Oid) * (agg->numCols + 1));
+	for (i = 0; i < agg->numCols; i++)
 	{
-		return ((Var*)linitial(ox->args))->varattno;
+		Oid rfunc;
+		if (!get_op_hash_functions(agg->grpOperators[i], &(*functions)[i], &rfunc))
+		{
+			return false;
+		}
 	}
-	else
+	return true;
+}
+
+/*
+ * Returns the hash function of the type's default hash opclass.
+ */
+Oid get_type_hash_function(Oid type)
+{
+	TypeCacheEntry *typentry;
+	Oid lfunc, rfunc;
+
+	typentry = lookup_type_cache(type, TYPECACHE_EQ_OPR);
+	if (!OidIsValid(typentry->eq_opr) || !get_op_hash_functions(typentry->eq_opr, &lfunc, &rfunc))
 	{
-		return ((Var*)lsecond(ox->args))->varattno;
+		elog(ERROR, "could not find a hash function for type %s", format_type_be(type));
 	}
+	return lfunc;
 }
 
 void print_nodetag_recursive(Plan *plan)
 {
+	AttrNumber *lcols, *rcols;
+	Oid *lfuncs, *rfuncs;
+
 	if (plan == NULL) {
 		return;
 	}
 
 	if (IsA(plan, MergeJoin))
 	{
-		elog(DEBUG5, "mjoin<%d = %d",
-			joinattr(plan, plan->lefttree),
-			joinattr(plan, plan->righttree)
-		);
+		elog(DEBUG5, "mjoin<%d keys", join_exchange_keys(plan, &lcols, &lfuncs, &rcols, &rfuncs));
 //		print_opexprlist(((MergeJoin*)plan)->mergeclauses);
 		elog(DEBUG5, ">");
 	}
 	else if (IsA(plan, NestLoop))
 	{
 		if (((Join*)plan)->joinqual != NULL) {
-			elog(DEBUG5, "njoin<%d = %d",
-				joinattr(plan, plan->lefttree),
-				joinattr(plan, plan->righttree)
-			);
+			elog(DEBUG5, "njoin<%d keys", join_exchange_keys(plan, &lcols, &lfuncs, &rcols, &rfuncs));
 		} else {
 			elog(DEBUG5, "njoin<NULL, WHY?");
 		}
@@ -166,10 +312,7 @@ void print_nodetag_recursive(Plan *plan)
 	}
 	else if (IsA(plan, HashJoin))
 	{
-		elog(DEBUG5, "hjoin<%d = %d",
-			joinattr(plan, plan->lefttree),
-			joinattr(plan, plan->righttree)
-		);
+		elog(DEBUG5, "hjoin<%d keys", join_exchange_keys(plan, &lcols, &lfuncs, &rcols, &rfuncs));
 //		print_opexprlist(((HashJoin*)plan)->hashclauses);
 		elog(DEBUG5, ">");
 	}
@@ -248,7 +391,7 @@ void print_nodetag_recursive(Plan *plan)
 // Inserts an Exchange above the specified node, or below it
 // if the node is Material, Sort, Hash, or other node that requires
 // the Exchange to be put underneath instead.
-Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int joinattr)
+Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions)
 {
 	// FIXME: needs to be a recursive function, in order to
 	// cover the case of "Material(Sort(Hash(...)))".
@@ -258,12 +401,16 @@ Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int joinattr)
 		Plan *newleft = make_exchange(
 			plan->lefttree,
 			(*port)++,
-			joinattr
+			numCols,
+			fragColIdx,
+			fragFunctions
 		);
 		//plan->lefttree = make_exchange(
 		//	plan->lefttree,
 		//	(*port)++,
-		//	joinattr
+		//	numCols,
+		//	fragColIdx,
+		//	fragFunctions
 		//);
 		if ((unsigned long)newleft > 0xf0000000000000) {
 			elog(DEBUG5, "failure, newleft == %lx\n", (unsigned long)newleft);
@@ -276,6 +423,7 @@ Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int joinattr)
 		}
 		elog(DEBUG5, "newleft == %lx\n", (unsigned long)newleft);
 		plan->lefttree = newleft;
+		add_child_cost_delta(plan, newleft, oldleft->startup_cost, oldleft->total_cost);
 		return plan;
 	}
 	else
@@ -283,203 +431,2086 @@ Plan *insert_exchange_here_or_deeper(Plan *plan, int *port, int joinattr)
 		return make_exchange(
 			plan,
 			(*port)++,
-			joinattr
+			numCols,
+			fragColIdx,
+			fragFunctions
 		);
 	}
 }
 
-Plan *par_Parallelize_recursive(Plan *plan, int *port)
+// Inserts a broadcast Exchange above the specified node, or below it
+// if the node is Material, Sort or Hash.
+Plan *insert_broadcast_here_or_deeper(Plan *plan, int *port)
 {
-	if (plan == NULL)
+	if (IsA(plan, Material) || IsA(plan, Sort) || IsA(plan, Hash))
 	{
-		return NULL;
+		Plan *oldleft = plan->lefttree;
+		plan->lefttree = make_broadcast_exchange(oldleft, (*port)++);
+		add_child_cost_delta(plan, plan->lefttree, oldleft->startup_cost, oldleft->total_cost);
+		return plan;
+	}
+	else
+	{
+		return make_broadcast_exchange(plan, (*port)++);
 	}
+}
+
+/*****************************************************************************
+ *
+ *	   Co-located and broadcast joins
+ *
+ * While going up the plan, we keep track of how the output of every
+ * subplan is distributed. A scan of a relation with 'fragattr' is hashed
+ * on that attribute (unless the relation is fragmented by ranges or
+ * lists, which do not match any hash), the output of an Exchange is hashed on its keys,
+ * and the output of a broadcast Exchange is replicated. If both sides of
+ * a join are already hashed on the join keys, no Exchange is needed. If
+ * the inner side is small, it is cheaper to send it to every node than
+ * to redistribute both sides.
+ *
+ *****************************************************************************/
 
-	// recursion
-	plan->lefttree = par_Parallelize_recursive(plan->lefttree, port);
-	plan->righttree = par_Parallelize_recursive(plan->righttree, port);
-	// FIXME: consider Append nodes, which do not have "left" or "right" subtrees.
+// Finds out how the relation scanned by the node is fragmented.
+void scan_distribution(Scan *scan, List *rtable, Index resultRelation, Distribution *dist)
+{
+	RangeTblEntry *rte;
+	AttrNumber fragatno;
+	Oid atttype;
 
-	if (
-		IsA(plan, MergeJoin)
-		|| (IsA(plan, NestLoop) && (((Join*)plan)->joinqual != NULL))
-		|| IsA(plan, HashJoin)
-	)
+	dist->kind = DIST_ANY;
+	dist->keys = NIL;
+	dist->functions = NIL;
+	dist->pinned = (resultRelation != 0 && scan->scanrelid == resultRelation);
+
+	rte = rt_fetch(scan->scanrelid, rtable);
+	if (rte->rtekind != RTE_RELATION)
 	{
-		plan->lefttree = insert_exchange_here_or_deeper(
-			plan->lefttree,
-			port,
-			joinattr(plan, plan->lefttree)
-		);
-		plan->righttree = insert_exchange_here_or_deeper(
-			plan->righttree,
-			port,
-			joinattr(plan, plan->righttree)
-		);
+		return;
 	}
-	else if (IsA(plan, Agg))
+	fragatno = get_relid_fragatno(rte->relid);
+	if (fragatno <= 0 || get_relid_fragscheme(rte->relid) != NULL
+		|| par_scan_workers > 1)
+	{
+		// Several ranks share a fragment, each having some of its blocks
+		return;
+	}
+
+	atttype = get_atttype(rte->relid, fragatno);
+	dist->kind = DIST_HASHED;
+	dist->keys = list_make1(makeVar(
+		scan->scanrelid,
+		fragatno,
+		atttype,
+		get_atttypmod(rte->relid, fragatno),
+		0
+	));
+	dist->functions = list_make1_oid(get_type_hash_function(atttype));
+}
+
+// Returns true if the operator compares the fragmentation attribute
+// (on the left) for equality the way its hash function agrees with.
+bool is_frag_key_op(Oid opno, Node *left, Index varno, AttrNumber attno, Oid hashfunc)
+{
+	Oid lfunc, rfunc;
+
+	while (IsA(left, RelabelType))
+	{
+		left = (Node*)((RelabelType*)left)->arg;
+	}
+	if (!IsA(left, Var) || ((Var*)left)->varno != varno
+		|| ((Var*)left)->varattno != attno || ((Var*)left)->varlevelsup != 0)
+	{
+		return false;
+	}
+	// Only an operator hashing both sides with fragfunc's hash function
+	// puts the equal constant on the same node as the rows
+	return get_op_hash_functions(opno, &lfunc, &rfunc)
+		&& lfunc == hashfunc && rfunc == hashfunc;
+}
+
+// Returns the node fragfunc sends the value to, or -1 for a NULL,
+// which is never equal to anything.
+int const_frag_node(Datum value, bool isnull, Oid hashfunc)
+{
+	if (isnull)
+	{
+		return -1;
+	}
+	return par_hash_fragment(DatumGetUInt32(OidFunctionCall1(hashfunc, value)));
+}
+
+// If the qual only lets through the rows whose fragmentation attribute
+// equals some constants ('attr = const', 'attr IN (consts)', or an OR
+// of those), marks the nodes that hold such rows in 'allowed' and
+// returns true. Otherwise returns false and leaves 'allowed' alone.
+bool qual_frag_nodes(Node *qual, Index varno, AttrNumber attno, Oid hashfunc, int nodes, bool *allowed)
+{
+	if (IsA(qual, OpExpr) && list_length(((OpExpr*)qual)->args) == 2)
 	{
-		if (((Agg*)plan)->aggstrategy == AGG_PLAIN)
+		OpExpr *op = (OpExpr*)qual;
+		Node *left = (Node*)linitial(op->args), *right = (Node*)lsecond(op->args);
+		Const *value;
+		int node;
+
+		if (IsA(left, Const))
 		{
-			// No grouping, bad :(
-			// Inserting the constant ZERO exchange :P
-			// FIXME: Implement some kind of two-stage aggregation,
-			// cause this is wrong!
-			plan->lefttree = insert_exchange_here_or_deeper(
-				plan->lefttree,
-				port,
-				0
-				// Send all tuples to one node, hence a global group will occur on 0-node.
-				// But the other nodes will still generate some "zero-sum" tuple.
-			);
+			// 'const = attr'
+			Node *tmp = left;
+			left = right;
+			right = tmp;
 		}
-		else
+		if (!IsA(right, Const) || !is_frag_key_op(op->opno, left, varno, attno, hashfunc))
 		{
-			// Grouping by some attribute - so we just
-			// exchange by this attribute first.
-			plan->lefttree = insert_exchange_here_or_deeper(
-				plan->lefttree,
-				port,
-				((Agg*)plan)->grpColIdx[0]
-				// Use the first group-by attribute
-				// as the exchange attribute, in order
-				// to get the correct results of aggregation.
-			);
+			return false;
+		}
+		value = (Const*)right;
+		node = const_frag_node(value->constvalue, value->constisnull, hashfunc);
+		if (node >= 0)
+		{
+			allowed[node] = true;
 		}
+		return true;
 	}
-	// FIXME: streams not implemented yet
-	/*
-	if (IsA(plan->lefttree, SeqScan))
+	else if (IsA(qual, ScalarArrayOpExpr))
 	{
-		plan->lefttree = make_stream((SeqScan*)plan->lefttree, (*port)++);
+		ScalarArrayOpExpr *saop = (ScalarArrayOpExpr*)qual;
+		Const *array = (Const*)lsecond(saop->args);
+		Datum *values;
+		bool *nulls;
+		int16 elmlen;
+		bool elmbyval;
+		char elmalign;
+		int n, i;
+
+		if (!saop->useOr || !IsA(array, Const)
+			|| !is_frag_key_op(saop->opno, (Node*)linitial(saop->args), varno, attno, hashfunc))
+		{
+			return false;
+		}
+		if (array->constisnull)
+		{
+			return true;
+		}
+		get_typlenbyvalalign(ARR_ELEMTYPE(DatumGetArrayTypeP(array->constvalue)), &elmlen, &elmbyval, &elmalign);
+		deconstruct_array(DatumGetArrayTypeP(array->constvalue),
+			ARR_ELEMTYPE(DatumGetArrayTypeP(array->constvalue)),
+			elmlen, elmbyval, elmalign, &values, &nulls, &n);
+		for (i = 0; i < n; i++)
+		{
+			int node = const_frag_node(values[i], nulls[i], hashfunc);
+			if (node >= 0)
+			{
+				allowed[node] = true;
+			}
+		}
+		return true;
 	}
-	if (IsA(plan->righttree, SeqScan))
+	else if (or_clause(qual))
 	{
-		plan->righttree = make_stream((SeqScan*)plan->righttree, (*port)++);
+		// Every branch has to be restricted, the nodes add up
+		bool *branch = (bool*)palloc0(nodes * sizeof(bool));
+		ListCell *lc;
+		int i;
+
+		foreach(lc, ((BoolExpr*)qual)->args)
+		{
+			if (!qual_frag_nodes((Node*)lfirst(lc), varno, attno, hashfunc, nodes, branch))
+			{
+				pfree(branch);
+				return false;
+			}
+		}
+		for (i = 0; i < nodes; i++)
+		{
+			allowed[i] |= branch[i];
+		}
+		pfree(branch);
+		return true;
 	}
-	*/
-	return plan;
+	return false;
 }
 
-/*
- * Adds the following expression to the plan qual list:
- * tuple[attr] % nodes == me
- */
-void add_qual_attr_mod_nodes_equals_me(Plan *plan, int attr, int nodes, int me)
+// Returns true if the scan cannot find anything in the fragment of this
+// node. This is so if the relation is hashed and the quals of the scan compare its
+// fragmentation attribute with constants that hash to the other nodes
+// only, or if the relation is fragmented by ranges or lists and the
+// quals contradict the fragment of this node (or there is no fragment).
+bool scan_is_excluded(Scan *scan, List *rtable)
 {
-	Expr *mod_nodes, *is_mine, *attr_expr;
-	Const *nodes_const, *me_const;
-	TargetEntry *te;
+	RangeTblEntry *rte;
+	ParFragScheme *scheme;
+	Expr *fragment;
+	List *quals;
+	ListCell *lc;
 
-	// Make constant expressions
-	nodes_const = make_const(NULL, makeInteger(nodes), -1);
-	me_const = make_const(NULL, makeInteger(me), -1);
+	rte = rt_fetch(scan->scanrelid, rtable);
+	if (rte->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
 
-	// Get the expression for tuple[attr]
-	te = list_nth(plan->targetlist, attr - 1);
-	Assert(IsA(te, TargetEntry));
-	attr_expr = te->expr;
+	// The index conditions are not among the quals of the scan
+	quals = list_copy(scan->plan.qual);
+	if (IsA(scan, IndexScan))
+	{
+		quals = list_concat(quals, list_copy(((IndexScan*)scan)->indexqualorig));
+	}
+	else if (IsA(scan, BitmapHeapScan))
+	{
+		quals = list_concat(quals, list_copy(((BitmapHeapScan*)scan)->bitmapqualorig));
+	}
 
-	// Get the expression for % operator
-	mod_nodes = make_op(NULL, list_make1(makeString("%")), (Node*)attr_expr, (Node*)nodes_const, -1);
-	Assert(IsA(mod_nodes, OpExpr));
+	scheme = get_relid_fragscheme(rte->relid);
+	if (scheme == NULL)
+	{
+		AttrNumber fragatno = get_relid_fragatno(rte->relid);
+		int nodes = par_fragments_count();
+		int me = par_my_fragment();
+		Oid hashfunc;
 
-	// Get the expression for == operator
-	is_mine = make_op(NULL, list_make1(makeString("=")), (Node*)mod_nodes, (Node*)me_const, -1);
-	Assert(IsA(is_mine, OpExpr));
+		if (fragatno <= 0 || nodes < 2)
+		{
+			return false;
+		}
+		// The quals are ANDed, so every restricting one narrows the nodes
+		hashfunc = get_type_hash_function(get_atttype(rte->relid, fragatno));
+		foreach(lc, quals)
+		{
+			bool *allowed = (bool*)palloc0(nodes * sizeof(bool));
+			bool restricts = qual_frag_nodes((Node*)lfirst(lc), scan->scanrelid, fragatno, hashfunc, nodes, allowed);
+			bool mine = allowed[me];
 
-	// Append the "==" expression to plan's qual list
-	if (IsA(plan, Result)) {
-		// For some reason, Result operator ignores plain 'qual'
-		// and only respects its own resconstantqual :(
-		((Result*)plan)->resconstantqual = (Node*)lappend(plan->qual, is_mine);
-	} else {
-		plan->qual = lappend(plan->qual, is_mine);
+			pfree(allowed);
+			if (restricts && !mine)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	fragment = fragscheme_qual(
+		scheme,
+		(Expr*)makeVar(scan->scanrelid, scheme->attno, scheme->atttype, scheme->atttypmod, 0),
+		par_my_fragment()
+	);
+	if (IsA(fragment, Const) && !((Const*)fragment)->constisnull
+		&& !DatumGetBool(((Const*)fragment)->constvalue))
+	{
+		return true;
+	}
+	if (quals == NIL)
+	{
+		return false;
 	}
+	return predicate_refuted_by(list_make1(fragment), quals);
 }
 
-/*
- * Returns the Oid of the result relation for an INSERT, UPDATE or DELETE query.
- */
-Oid get_query_result_relid(Query *query)
+// Replaces the scan with a Result that returns nothing. The estimates
+// of the scan are kept, since the plan above it has to be the same on
+// every node, exchanges and all. The bitmap scans under a BitmapHeapScan
+// are gone, so EXPLAIN ANALYZE does not match them up (see par_instrument.c).
+Plan *make_empty_scan(Scan *scan)
 {
-	RangeTblEntry *rte;
-	rte = (RangeTblEntry*)list_nth(query->rtable, query->resultRelation - 1);
-	//Assert(IsEqual(rte->rtekind, RTE_RELATION));
-	return rte->relid;
+	Result *result = makeNode(Result);
+	Plan *plan = &result->plan;
+
+	plan->startup_cost = scan->plan.startup_cost;
+	plan->total_cost = scan->plan.total_cost;
+	plan->plan_rows = scan->plan.plan_rows;
+	plan->plan_width = scan->plan.plan_width;
+	plan->targetlist = scan->plan.targetlist;
+	plan->qual = NIL;
+	plan->lefttree = NULL;
+	plan->righttree = NULL;
+	result->resconstantqual = (Node*)list_make1(makeBoolConst(false, false));
+
+	return plan;
 }
 
-/*
- * Returns the attribute's number (starting from 1) in relation by the
- * attribute's name.
- */
-AttrNumber get_atno_in_relid_by_atname(Oid relid, const char* atname)
+// Describes the output of an Exchange on the given columns of the plan.
+void hashed_distribution(Plan *plan, int numCols, AttrNumber *colIdx, Oid *functions, Distribution *dist)
 {
-	Relation relation;
-	int result;
+	int i;
 
-	relation = RelationIdGetRelation(relid);
-	result = attnameAttNum(relation, atname, /*sysColOk*/TRUE);
-	RelationClose(relation);
+	dist->kind = (numCols > 0) ? DIST_HASHED : DIST_ANY;
+	dist->keys = NIL;
+	dist->functions = NIL;
+	for (i = 0; i < numCols; i++)
+	{
+		TargetEntry *te = get_tle_by_resno(plan->targetlist, colIdx[i]);
+		dist->keys = lappend(dist->keys, te->expr);
+		dist->functions = lappend_oid(dist->functions, functions[i]);
+	}
+}
 
-	return result;
+// Returns true if the expression is the distribution key. The Vars
+// are compared by their attribute only, since the scans and the joins
+// above them may fill the rest of the fields differently.
+bool dist_key_matches(Expr *key, Expr *expr)
+{
+	while (IsA(key, RelabelType))
+	{
+		key = ((RelabelType*)key)->arg;
+	}
+	while (IsA(expr, RelabelType))
+	{
+		expr = ((RelabelType*)expr)->arg;
+	}
+	if (IsA(key, Var) && IsA(expr, Var))
+	{
+		return ((Var*)key)->varno == ((Var*)expr)->varno
+			&& ((Var*)key)->varattno == ((Var*)expr)->varattno
+			&& ((Var*)key)->varlevelsup == ((Var*)expr)->varlevelsup;
+	}
+	return equal(key, expr);
 }
 
-/*
- * This returns 'fragattr' reloption of the relation with given Oid.
- * You should free the allocated string yourself with pfree().
- */
-char *get_relid_fragattr(Oid relid)
+// Returns true if the equal join keys of both sides are already on the
+// same node: both sides are hashed on the keys of the same join clauses,
+// in the same order, with the hash functions that agree with each other.
+bool join_is_colocated(Plan *join, int numCols, AttrNumber *lcols, Oid *lfuncs, AttrNumber *rcols, Oid *rfuncs, Distribution *ldist, Distribution *rdist)
 {
-	Relation relation;
-	char *fragattr, *result;
-	StdRdOptions *opts;
+	int i, j, nkeys;
 
-	relation = RelationIdGetRelation(relid);
+	if (ldist->kind != DIST_HASHED || rdist->kind != DIST_HASHED)
+	{
+		return false;
+	}
+	nkeys = list_length(ldist->keys);
+	if (nkeys != list_length(rdist->keys))
+	{
+		return false;
+	}
 
-	opts = ((StdRdOptions*)relation->rd_options);
-	fragattr = ((char*)opts) + (long)opts->fragattr; // just opts->fragattr would only be an offset
-	result = palloc(strlen(fragattr) + 1);
-	strcpy(result, fragattr);
+	for (i = 0; i < nkeys; i++)
+	{
+		Expr *lkey = (Expr*)list_nth(ldist->keys, i);
+		Expr *rkey = (Expr*)list_nth(rdist->keys, i);
+		Oid lfunc = list_nth_oid(ldist->functions, i);
+		Oid rfunc = list_nth_oid(rdist->functions, i);
 
-	RelationClose(relation);
+		for (j = 0; j < numCols; j++)
+		{
+			TargetEntry *lte = get_tle_by_resno(join->lefttree->targetlist, lcols[j]);
+			TargetEntry *rte = get_tle_by_resno(join->righttree->targetlist, rcols[j]);
+			if (dist_key_matches(lkey, lte->expr)
+				&& dist_key_matches(rkey, rte->expr)
+				&& (lfunc == rfunc || (lfunc == lfuncs[j] && rfunc == rfuncs[j])))
+			{
+				break;
+			}
+		}
+		if (j == numCols)
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-	return result;
+// Returns true if the rows with the same values of the columns of the
+// input are on one node already, i.e. the input is hashed on some of
+// these columns.
+bool columns_are_colocated(Plan *input, int numCols, AttrNumber *colIdx, Distribution *dist)
+{
+	ListCell *lc;
+	int i;
+
+	if (dist->kind != DIST_HASHED || numCols == 0)
+	{
+		return false;
+	}
+
+	foreach(lc, dist->keys)
+	{
+		for (i = 0; i < numCols; i++)
+		{
+			TargetEntry *te = get_tle_by_resno(input->targetlist, colIdx[i]);
+			if (dist_key_matches((Expr*)lfirst(lc), te->expr))
+			{
+				break;
+			}
+		}
+		if (i == numCols)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
-/*
- * This returns fragattr number (starting from 1)
- * in the relation with given Oid.
- */
-int get_relid_fragatno(Oid relid)
+// Returns true if every group of the Agg is on one node already,
+// i.e. the input is hashed on some of the grouping columns.
+bool agg_is_colocated(Agg *agg, Distribution *dist)
 {
-	char *fragattr;
-	int result;
+	return columns_are_colocated(agg->plan.lefttree, agg->numCols, agg->grpColIdx, dist);
+}
 
-	fragattr = get_relid_fragattr(relid);
-	result = get_atno_in_relid_by_atname(relid, fragattr);
-	pfree(fragattr);
+// Returns what an Exchange over the plan would add to its cost.
+Cost exchange_network_cost(Plan *plan, int numCols, bool broadcast)
+{
+	Plan exchange;
+	cost_exchange_of(&exchange, plan, numCols, broadcast);
+	return exchange.total_cost - plan->total_cost;
+}
 
-	return result;
+// Adds the change of the child's cost to the costs of its parent.
+// Sort, Hash and Agg read all of their input before returning
+// anything, so their startup grows with the total of the child.
+void add_child_cost_delta(Plan *parent, Plan *child, Cost startup_before, Cost total_before)
+{
+	Cost startup_delta = child->startup_cost - startup_before;
+	Cost total_delta = child->total_cost - total_before;
+
+	if (IsA(parent, Sort) || IsA(parent, Hash)
+		|| (IsA(parent, Agg) && ((Agg*)parent)->aggstrategy != AGG_SORTED)
+		|| (IsA(parent, SetOp) && ((SetOp*)parent)->strategy == SETOP_HASHED))
+	{
+		startup_delta = total_delta;
+	}
+	parent->startup_cost += startup_delta;
+	parent->total_cost += total_delta;
 }
 
-Plan *par_Parallelize(Plan *plan, Query *query)
+// If one side of the join is hashed on the join keys already, finds the
+// columns and the hash functions to redistribute the other side the same
+// way. 'cols' and 'funcs' are the join keys of the hashed side, and
+// 'othercols' and 'otherfuncs' are the ones of the other side. Returns
+// the number of the keys, or 0 if the hashed side does not fit.
+int redistribute_keys(Plan *hashed, Distribution *dist, int numCols, AttrNumber *cols, Oid *funcs, AttrNumber *othercols, Oid *otherfuncs, AttrNumber **newcols, Oid **newfuncs)
 {
-	int port = 0;
-	int fragatno; // partitioning attribute number
-	int nodes, me;
+	int i, j, nkeys;
 
-	elog(DEBUG5, "Be quiet, parallelizer is working...\n");
-	print_nodetag_recursive(plan);	
-	elog(DEBUG5, "\n");
+	if (dist->kind != DIST_HASHED)
+	{
+		return 0;
+	}
 
-	switch (query->commandType) {
-		case CMD_SELECT:
-			// Aggregate all the result tuples on node-0
+	nkeys = list_length(dist->keys);
+	*newcols = (AttrNumber*)palloc(sizeof(AttrNumber) * nkeys);
+	*newfuncs = (Oid*)palloc(sizeof(Oid) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		Expr *key = (Expr*)list_nth(dist->keys, i);
+		Oid func = list_nth_oid(dist->functions, i);
+
+		for (j = 0; j < numCols; j++)
+		{
+			TargetEntry *te = get_tle_by_resno(hashed->targetlist, cols[j]);
+			if (dist_key_matches(key, te->expr) && func == funcs[j])
+			{
+				(*newcols)[i] = othercols[j];
+				(*newfuncs)[i] = otherfuncs[j];
+				break;
+			}
+		}
+		if (j == numCols)
+		{
+			return 0;
+		}
+	}
+	return nkeys;
+}
+
+// A key is hot if it alone makes more than this share of the tuples
+// a node gets on average, so that it would overload its node.
+#define PAR_SKEW_SHARE 0.5
+#define PAR_SKEW_MAX_HOT 16
+
+// Finds the hot keys among the most common values of the key, if it is
+// a column with statistics, and returns their hashes (computed with
+// the hash function the way fragfunc does it for a single column).
+int hot_key_hashes(Expr *key, Oid hashfunc, List *rtable, uint32 **hashes)
+{
+	double threshold = PAR_SKEW_SHARE / _pargresql_GetNodesCount(); // FIXME: INIS naming
+	RangeTblEntry *rte;
+	HeapTuple statsTuple;
+	Datum *values;
+	int nvalues;
+	float4 *numbers;
+	int nnumbers;
+	Var *var;
+	int i, nhot = 0;
+
+	while (IsA(key, RelabelType))
+	{
+		key = ((RelabelType*)key)->arg;
+	}
+	if (!IsA(key, Var))
+	{
+		return 0;
+	}
+	var = (Var*)key;
+	if (var->varlevelsup != 0 || var->varattno <= 0 || var->varno < 1 || var->varno > list_length(rtable))
+	{
+		return 0;
+	}
+	rte = rt_fetch(var->varno, rtable);
+	if (rte->rtekind != RTE_RELATION)
+	{
+		return 0;
+	}
+
+	statsTuple = SearchSysCache(STATRELATT,
+		ObjectIdGetDatum(rte->relid),
+		Int16GetDatum(var->varattno),
+		0, 0);
+	if (!HeapTupleIsValid(statsTuple))
+	{
+		return 0;
+	}
+	if (get_attstatsslot(statsTuple, var->vartype, var->vartypmod,
+		STATISTIC_KIND_MCV, InvalidOid,
+		&values, &nvalues, &numbers, &nnumbers))
+	{
+		*hashes = palloc(Min(nvalues, PAR_SKEW_MAX_HOT) * sizeof(uint32));
+		for (i = 0; i < nvalues && i < nnumbers && nhot < PAR_SKEW_MAX_HOT; i++)
+		{
+			// The MCVs go from the most common one down
+			if (numbers[i] <= threshold)
+			{
+				break;
+			}
+			(*hashes)[nhot++] = DatumGetUInt32(OidFunctionCall1(hashfunc, values[i]));
+			elog(DEBUG5, "hot key #%d takes %.3f of the tuples", i, numbers[i]);
+		}
+		free_attstatsslot(var->vartype, values, nvalues, numbers, nnumbers);
+	}
+	ReleaseSysCache(statsTuple);
+	return nhot;
+}
+
+// Tells the Scatter of the Exchange at (or right under) the plan
+// how to deal with the hot keys.
+void set_exchange_skew(Plan *plan, SkewMode skew, int numHot, uint32 *hotHashes)
+{
+	Scatter *scatter;
+
+	while (!IsA(plan, Merge))
+	{
+		plan = plan->lefttree;
+	}
+	scatter = (Scatter*)plan->righttree->righttree;
+	scatter->skew = skew;
+	scatter->numHot = numHot;
+	scatter->hotHashes = hotHashes;
+}
+
+// Makes the Scatter of the Exchange at (or right under) the plan route
+// the tuples to the fragments of a relation, by its ranges or lists if
+// the scheme is not NULL.
+void set_exchange_fragments(Plan *plan, ParFragScheme *scheme)
+{
+	Scatter *scatter;
+
+	while (!IsA(plan, Merge))
+	{
+		plan = plan->lefttree;
+	}
+	scatter = (Scatter*)plan->righttree->righttree;
+	scatter->toFragments = true;
+	scatter->fragScheme = scheme;
+}
+
+// Lets node 0 stop the sources of the Exchange at (or right under)
+// the plan when it needs no more tuples.
+void set_exchange_cancelable(Plan *plan)
+{
+	while (!IsA(plan, Merge))
+	{
+		plan = plan->lefttree;
+	}
+	((Gather*)plan->lefttree)->cancelable = true;
+	((Scatter*)plan->righttree->righttree)->cancelable = true;
+}
+
+// Lets the hash join filter its outer side by the bloom filters of the
+// hash tables on the other nodes, if the side comes through an Exchange
+// right under the join. Only the joins that drop the unmatched outer
+// tuples can use them.
+void set_exchange_join_filter(Plan *join)
+{
+	JoinType jointype = ((Join*)join)->jointype;
+
+	if (!par_join_filters || !IsA(join, HashJoin) || !IsA(join->lefttree, Merge))
+	{
+		return;
+	}
+	if (jointype != JOIN_INNER && jointype != JOIN_SEMI)
+	{
+		return;
+	}
+	elog(DEBUG5, "filtering the outer side of the hash join");
+	((Scatter*)join->lefttree->righttree->righttree)->joinFilter = true;
+}
+
+// Puts the Exchanges under the join, if it needs any. Out of the ways
+// to bring the matching tuples together, redistributing both sides,
+// only the one that is not hashed on the join keys yet, or broadcasting
+// the inner side, the one with the least network cost is chosen.
+//
+// When both sides are redistributed, the outer tuples with hot keys
+// are spread over all the nodes instead, and the inner tuples with
+// the same keys are broadcast to meet them.
+Plan *parallelize_join(Plan *plan, int *port, List *rtable, Distribution *ldist, Distribution *rdist, Distribution *dist)
+{
+	JoinType jointype = ((Join*)plan)->jointype;
+	AttrNumber *lcols, *rcols, *cols;
+	Oid *lfuncs, *rfuncs, *funcs;
+	Plan *left = plan->lefttree, *right = plan->righttree;
+	Cost lstartup = left->startup_cost, ltotal = left->total_cost;
+	Cost rstartup = right->startup_cost, rtotal = right->total_cost;
+	int numCols, nkeys;
+	bool inner_may_be_replicated;
+	enum { EXCHANGE_BOTH, EXCHANGE_LEFT, EXCHANGE_RIGHT, EXCHANGE_BROADCAST } best;
+	AttrNumber *bestcols = NULL;
+	Oid *bestfuncs = NULL;
+	int bestkeys = 0;
+	Cost bestcost, cost;
+	uint32 *hot;
+	int nhot;
+
+	// Every node joins its part of the outer side with the whole inner
+	// side, which would duplicate the unmatched inner tuples otherwise.
+	inner_may_be_replicated = (jointype == JOIN_INNER || jointype == JOIN_LEFT
+		|| jointype == JOIN_SEMI || jointype == JOIN_ANTI);
+
+	numCols = join_exchange_keys(plan, &lcols, &lfuncs, &rcols, &rfuncs);
+
+	if (numCols > 0 && join_is_colocated(plan, numCols, lcols, lfuncs, rcols, rfuncs, ldist, rdist))
+	{
+		elog(DEBUG5, "co-located join, no exchanges needed");
+		*dist = *ldist;
+	}
+	else if (rdist->kind == DIST_REPLICATED
+		&& (inner_may_be_replicated || ldist->kind == DIST_REPLICATED))
+	{
+		elog(DEBUG5, "the inner side is replicated already");
+		*dist = *ldist;
+	}
+	else if (ldist->pinned || rdist->pinned)
+	{
+		plan = parallelize_pinned_join(plan, port, numCols, lcols, lfuncs, rcols, rfuncs, ldist, rdist);
+		*dist = ldist->pinned ? *ldist : *rdist;
+		add_child_cost_delta(plan, plan->lefttree, lstartup, ltotal);
+		add_child_cost_delta(plan, plan->righttree, rstartup, rtotal);
+	}
+	else
+	{
+		// If there is nothing to hash by, both sides go to node 0.
+		best = EXCHANGE_BOTH;
+		bestcost = exchange_network_cost(left, numCols, false)
+			+ exchange_network_cost(right, numCols, false);
+
+		if (numCols > 0 && (nkeys = redistribute_keys(left, ldist, numCols, lcols, lfuncs, rcols, rfuncs, &cols, &funcs)) > 0)
+		{
+			cost = exchange_network_cost(right, nkeys, false);
+			if (cost < bestcost)
+			{
+				best = EXCHANGE_RIGHT;
+				bestcost = cost;
+				bestcols = cols;
+				bestfuncs = funcs;
+				bestkeys = nkeys;
+			}
+		}
+		if (numCols > 0 && (nkeys = redistribute_keys(right, rdist, numCols, rcols, rfuncs, lcols, lfuncs, &cols, &funcs)) > 0)
+		{
+			cost = exchange_network_cost(left, nkeys, false);
+			if (cost < bestcost)
+			{
+				best = EXCHANGE_LEFT;
+				bestcost = cost;
+				bestcols = cols;
+				bestfuncs = funcs;
+				bestkeys = nkeys;
+			}
+		}
+		if (inner_may_be_replicated && ldist->kind != DIST_REPLICATED)
+		{
+			cost = exchange_network_cost(right, 0, true);
+			if (cost < bestcost)
+			{
+				best = EXCHANGE_BROADCAST;
+				bestcost = cost;
+			}
+		}
+
+		switch (best)
+		{
+			case EXCHANGE_BOTH:
+				elog(DEBUG5, "redistributing both sides, network cost %.2f", bestcost);
+				plan->lefttree = insert_exchange_here_or_deeper(left, port, numCols, lcols, lfuncs);
+				plan->righttree = insert_exchange_here_or_deeper(right, port, numCols, rcols, rfuncs);
+				if (inner_may_be_replicated && numCols == 1
+					&& (nhot = hot_key_hashes(get_tle_by_resno(left->targetlist, lcols[0])->expr, lfuncs[0], rtable, &hot)) > 0)
+				{
+					elog(DEBUG5, "%d hot keys in the outer side, spreading them", nhot);
+					set_exchange_skew(plan->lefttree, PAR_SKEW_SPREAD, nhot, hot);
+					set_exchange_skew(plan->righttree, PAR_SKEW_BROADCAST, nhot, hot);
+					dist->kind = DIST_ANY;
+					dist->keys = NIL;
+					dist->functions = NIL;
+					break;
+				}
+				hashed_distribution(plan->lefttree, numCols, lcols, lfuncs, dist);
+				break;
+			case EXCHANGE_LEFT:
+				elog(DEBUG5, "redistributing the outer side, network cost %.2f", bestcost);
+				plan->lefttree = insert_exchange_here_or_deeper(left, port, bestkeys, bestcols, bestfuncs);
+				hashed_distribution(plan->lefttree, bestkeys, bestcols, bestfuncs, dist);
+				break;
+			case EXCHANGE_RIGHT:
+				elog(DEBUG5, "redistributing the inner side, network cost %.2f", bestcost);
+				plan->righttree = insert_exchange_here_or_deeper(right, port, bestkeys, bestcols, bestfuncs);
+				*dist = *ldist;
+				break;
+			case EXCHANGE_BROADCAST:
+				elog(DEBUG5, "broadcasting the inner side, network cost %.2f", bestcost);
+				plan->righttree = insert_broadcast_here_or_deeper(right, port);
+				*dist = *ldist;
+				break;
+		}
+
+		add_child_cost_delta(plan, plan->lefttree, lstartup, ltotal);
+		add_child_cost_delta(plan, plan->righttree, rstartup, rtotal);
+	}
+
+	if (plan->lefttree != left)
+	{
+		set_exchange_join_filter(plan);
+	}
+
+	// The NULLs added by an outer join are not where their hash says
+	if (jointype != JOIN_INNER && jointype != JOIN_LEFT
+		&& jointype != JOIN_SEMI && jointype != JOIN_ANTI
+		&& dist->kind != DIST_REPLICATED)
+	{
+		dist->kind = DIST_ANY;
+		dist->keys = NIL;
+		dist->functions = NIL;
+	}
+	dist->pinned = ldist->pinned || rdist->pinned;
+
+	return plan;
+}
+
+// Puts the Exchange under the join of the rows of the result relation
+// with something else. The ctids of the rows mean nothing on the other
+// nodes, so only the other side may move: hashed the way the pinned
+// side is, if the join keys allow it, or to every node otherwise.
+Plan *parallelize_pinned_join(Plan *plan, int *port, int numCols, AttrNumber *lcols, Oid *lfuncs, AttrNumber *rcols, Oid *rfuncs, Distribution *ldist, Distribution *rdist)
+{
+	JoinType jointype = ((Join*)plan)->jointype;
+	AttrNumber *cols;
+	Oid *funcs;
+	int nkeys;
+
+	if (ldist->pinned && rdist->pinned)
+	{
+		elog(ERROR, "cannot join the rows of the result relation with each other on different nodes");
+	}
+
+	if (ldist->pinned)
+	{
+		if (numCols > 0 && (nkeys = redistribute_keys(plan->lefttree, ldist, numCols, lcols, lfuncs, rcols, rfuncs, &cols, &funcs)) > 0)
+		{
+			elog(DEBUG5, "the outer side is pinned, redistributing the inner side");
+			plan->righttree = insert_exchange_here_or_deeper(plan->righttree, port, nkeys, cols, funcs);
+		}
+		else if (jointype == JOIN_INNER || jointype == JOIN_LEFT
+			|| jointype == JOIN_SEMI || jointype == JOIN_ANTI)
+		{
+			elog(DEBUG5, "the outer side is pinned, broadcasting the inner side");
+			plan->righttree = insert_broadcast_here_or_deeper(plan->righttree, port);
+		}
+		else
+		{
+			elog(ERROR, "cannot parallelize this kind of join of the rows of the result relation");
+		}
+	}
+	else if (ldist->kind == DIST_REPLICATED && jointype == JOIN_INNER)
+	{
+		elog(DEBUG5, "the inner side is pinned, the outer side is replicated already");
+	}
+	else
+	{
+		if (numCols > 0 && (nkeys = redistribute_keys(plan->righttree, rdist, numCols, rcols, rfuncs, lcols, lfuncs, &cols, &funcs)) > 0)
+		{
+			elog(DEBUG5, "the inner side is pinned, redistributing the outer side");
+			plan->lefttree = insert_exchange_here_or_deeper(plan->lefttree, port, nkeys, cols, funcs);
+		}
+		else if (jointype == JOIN_INNER)
+		{
+			// Every node joins all of the outer side with its own part
+			// of the inner one, so every match is still found once.
+			elog(DEBUG5, "the inner side is pinned, broadcasting the outer side");
+			plan->lefttree = insert_broadcast_here_or_deeper(plan->lefttree, port);
+		}
+		else
+		{
+			elog(ERROR, "cannot parallelize this kind of join of the rows of the result relation");
+		}
+	}
+	return plan;
+}
+
+/*****************************************************************************
+ *
+ *	   Two-phase aggregation
+ *
+ * An aggregate over the fragmented data is split into a partial Agg that
+ * runs on every node over its own fragment, an Exchange, and a final Agg
+ * that combines the partial results. So only one row per group per node
+ * goes over the network instead of every input tuple.
+ *
+ * Only the built-in count, sum, min, max and avg are supported, since we
+ * know how to combine their results:
+ *   count(x)       -> sum(count(x))::int8
+ *   sum(x)         -> sum(sum(x)), cast back to the type of sum(x)
+ *   min(x), max(x) -> min(min(x)), max(max(x))
+ *   avg(x)         -> sum(sum(x)) / sum(count(x))
+ *
+ *****************************************************************************/
+
+// Returns true if the node contains no aggregates we are unable to split.
+bool agg_is_decomposable_walker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggref = (Aggref*)node;
+		char *aggname;
+		bool ok;
+
+		// User-defined aggregates may be named the same way, skip them.
+		if (aggref->aggfnoid >= FirstBootstrapObjectId || aggref->agglevelsup != 0)
+		{
+			return true;
+		}
+
+		aggname = get_func_name(aggref->aggfnoid);
+		if (strcmp(aggname, "min") == 0 || strcmp(aggname, "max") == 0)
+		{
+			// DISTINCT does not change the result of these
+			ok = true;
+		}
+		else if (aggref->aggdistinct)
+		{
+			ok = false;
+		}
+		else if (strcmp(aggname, "count") == 0 || strcmp(aggname, "sum") == 0)
+		{
+			ok = true;
+		}
+		else if (strcmp(aggname, "avg") == 0)
+		{
+			Oid argtype = exprType((Node*)linitial(aggref->args));
+			ok = (argtype == INT2OID || argtype == INT4OID || argtype == INT8OID
+				|| argtype == NUMERICOID || argtype == FLOAT4OID
+				|| argtype == FLOAT8OID || argtype == INTERVALOID);
+		}
+		else
+		{
+			ok = false;
+		}
+		pfree(aggname);
+
+		// do not look inside the aggregate's arguments
+		return !ok;
+	}
+	return expression_tree_walker(node, agg_is_decomposable_walker, context);
+}
+
+// Appends the aggregate to the target list of the partial Agg (unless
+// it is already there) and returns the expression to refer to it from
+// the final Agg.
+Expr *add_partial_aggref(List **partial_tlist, Aggref *aggref)
+{
+	ListCell *lc;
+	TargetEntry *te;
+
+	foreach(lc, *partial_tlist)
+	{
+		te = (TargetEntry*)lfirst(lc);
+		if (equal(te->expr, aggref))
+		{
+			return (Expr*)copyObject(aggref);
+		}
+	}
+
+	te = makeTargetEntry(
+		(Expr*)copyObject(aggref),
+		list_length(*partial_tlist) + 1,
+		NULL,
+		false
+	);
+	*partial_tlist = lappend(*partial_tlist, te);
+	return (Expr*)copyObject(aggref);
+}
+
+// Makes the built-in aggregate 'aggname' over the given argument.
+Expr *make_builtin_aggref(const char *aggname, Expr *arg)
+{
+	Aggref *aggref;
+	Oid argtype;
+
+	argtype = exprType((Node*)arg);
+	aggref = makeNode(Aggref);
+	aggref->aggfnoid = LookupFuncName(
+		list_make2(makeString("pg_catalog"), makeString(pstrdup(aggname))),
+		1,
+		&argtype,
+		false
+	);
+	aggref->aggtype = get_func_rettype(aggref->aggfnoid);
+	aggref->args = list_make1(arg);
+	aggref->agglevelsup = 0;
+	aggref->aggstar = false;
+	aggref->aggdistinct = false;
+	aggref->location = -1;
+	return (Expr*)aggref;
+}
+
+// Casts the expression to the given type, if it is not already of it.
+Expr *coerce_agg_result(Expr *expr, Oid targettype)
+{
+	Oid exprtype;
+	Node *result;
+
+	exprtype = exprType((Node*)expr);
+	if (exprtype == targettype)
+	{
+		return expr;
+	}
+
+	result = coerce_to_target_type(
+		NULL,
+		(Node*)expr,
+		exprtype,
+		targettype,
+		-1,
+		COERCION_EXPLICIT,
+		COERCE_IMPLICIT_CAST,
+		-1
+	);
+	if (result == NULL)
+	{
+		elog(ERROR, "cannot cast type %s to %s in two-phase aggregation",
+			format_type_be(exprtype),
+			format_type_be(targettype)
+		);
+	}
+	return (Expr*)result;
+}
+
+// Replaces every aggregate with the expression over the partial results,
+// collecting the partial aggregates into 'partial_tlist'.
+Node *split_agg_mutator(Node *node, List **partial_tlist)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggref = (Aggref*)node;
+		char *aggname;
+		Expr *result;
+
+		aggname = get_func_name(aggref->aggfnoid);
+		if (strcmp(aggname, "avg") == 0)
+		{
+			Expr *arg, *sum, *count;
+			Aggref *partial;
+			Oid argtype, divtype;
+
+			arg = (Expr*)linitial(aggref->args);
+			argtype = exprType((Node*)arg);
+			if (argtype == FLOAT4OID)
+			{
+				// avg(float4) accumulates in float8
+				arg = coerce_agg_result(arg, FLOAT8OID);
+				argtype = FLOAT8OID;
+			}
+
+			partial = (Aggref*)make_builtin_aggref("sum", (Expr*)copyObject(arg));
+			sum = make_builtin_aggref("sum", add_partial_aggref(partial_tlist, partial));
+
+			argtype = ANYOID;
+			partial = makeNode(Aggref);
+			partial->aggfnoid = LookupFuncName(
+				list_make2(makeString("pg_catalog"), makeString("count")),
+				1,
+				&argtype,
+				false
+			);
+			partial->aggtype = INT8OID;
+			partial->args = list_make1(copyObject(arg));
+			partial->location = -1;
+			count = make_builtin_aggref("sum", add_partial_aggref(partial_tlist, partial));
+
+			// interval can only be divided by a number
+			divtype = (aggref->aggtype == INTERVALOID) ? FLOAT8OID : aggref->aggtype;
+			result = make_op(
+				NULL,
+				list_make1(makeString("/")),
+				(Node*)coerce_agg_result(sum, aggref->aggtype),
+				(Node*)coerce_agg_result(count, divtype),
+				-1
+			);
+		}
+		else if (strcmp(aggname, "count") == 0)
+		{
+			result = make_builtin_aggref("sum", add_partial_aggref(partial_tlist, aggref));
+		}
+		else if (strcmp(aggname, "sum") == 0)
+		{
+			result = make_builtin_aggref("sum", add_partial_aggref(partial_tlist, aggref));
+		}
+		else
+		{
+			// min and max over the partial results are the same aggregates
+			Aggref *final = makeNode(Aggref);
+			final->aggfnoid = aggref->aggfnoid;
+			final->aggtype = aggref->aggtype;
+			final->args = list_make1(add_partial_aggref(partial_tlist, aggref));
+			final->location = aggref->location;
+			result = (Expr*)final;
+		}
+		pfree(aggname);
+
+		return (Node*)coerce_agg_result(result, aggref->aggtype);
+	}
+	return expression_tree_mutator(node, split_agg_mutator, (void*)partial_tlist);
+}
+
+// Turns the Agg into FinalAgg(Exchange(PartialAgg(...))). Returns NULL
+// if some of the aggregates cannot be split, or the Agg expects sorted
+// input that the Exchange would not preserve.
+Plan *make_two_phase_agg(Agg *agg, int *port)
+{
+	Agg *partial;
+	List *partial_tlist = NIL;
+	List *final_tlist, *final_qual;
+	AttrNumber *final_grpColIdx;
+	Oid *fragFunctions;
+	int i;
+
+	if (agg->aggstrategy == AGG_SORTED)
+	{
+		return NULL;
+	}
+	if (!agg_exchange_functions(agg, &fragFunctions))
+	{
+		return NULL;
+	}
+	if (agg_is_decomposable_walker((Node*)agg->plan.targetlist, NULL)
+		|| agg_is_decomposable_walker((Node*)agg->plan.qual, NULL))
+	{
+		return NULL;
+	}
+
+	// The grouping columns go first, so the final Agg
+	// and the Exchange find them at 1..numCols.
+	final_grpColIdx = (AttrNumber*)palloc(sizeof(AttrNumber) * (agg->numCols + 1));
+	for (i = 0; i < agg->numCols; i++)
+	{
+		TargetEntry *te = get_tle_by_resno(agg->plan.lefttree->targetlist, agg->grpColIdx[i]);
+		Assert(te != NULL);
+		partial_tlist = lappend(partial_tlist, makeTargetEntry(
+			(Expr*)copyObject(te->expr),
+			i + 1,
+			NULL,
+			false
+		));
+		final_grpColIdx[i] = i + 1;
+	}
+
+	final_tlist = (List*)split_agg_mutator((Node*)agg->plan.targetlist, &partial_tlist);
+	final_qual = (List*)split_agg_mutator((Node*)agg->plan.qual, &partial_tlist);
+
+	partial = makeNode(Agg);
+	partial->plan = agg->plan;
+	partial->plan.targetlist = partial_tlist;
+	partial->plan.qual = NIL;
+	partial->plan.righttree = NULL;
+	partial->aggstrategy = agg->aggstrategy;
+	partial->numCols = agg->numCols;
+	partial->grpColIdx = agg->grpColIdx;
+	partial->grpOperators = agg->grpOperators;
+	partial->numGroups = agg->numGroups;
+
+	agg->plan.targetlist = final_tlist;
+	agg->plan.qual = final_qual;
+	agg->grpColIdx = final_grpColIdx;
+	agg->plan.lefttree = make_exchange(
+		(Plan*)partial,
+		(*port)++,
+		agg->numCols,
+		final_grpColIdx,
+		fragFunctions
+	);
+	if (agg->aggstrategy == AGG_PLAIN)
+	{
+		keep_only_on_node_zero((Plan*)agg);
+	}
+
+	// The partial Agg does all the work the original one did, and
+	// the final one only combines a few rows per group from every node.
+	agg->plan.startup_cost = agg->plan.lefttree->total_cost;
+	agg->plan.total_cost = agg->plan.startup_cost + cpu_tuple_cost * agg->plan.lefttree->plan_rows;
+
+	return (Plan*)agg;
+}
+
+// A plain Agg always returns a row, even if its input is empty, so when
+// all the input goes to node 0, the other nodes must not return anything.
+// The same goes for a replicated branch of an Append.
+void keep_only_on_node_zero(Plan *plan)
+{
+	if (_pargresql_GetNode() != 0)
+	{
+		add_plan_qual(plan, (Expr*)makeBoolConst(false, false));
+	}
+}
+
+Plan *par_Parallelize_recursive(Plan *plan, int *port, Query *query, Index resultRelation, Distribution *dist)
+{
+	List *rtable = query->rtable;
+	Distribution ldist, rdist;
+	Cost lstartup = 0, ltotal = 0, rstartup = 0, rtotal = 0;
+
+	dist->kind = DIST_ANY;
+	dist->keys = NIL;
+	dist->functions = NIL;
+	dist->pinned = false;
+
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	if (plan->lefttree != NULL)
+	{
+		lstartup = plan->lefttree->startup_cost;
+		ltotal = plan->lefttree->total_cost;
+	}
+	if (plan->righttree != NULL)
+	{
+		rstartup = plan->righttree->startup_cost;
+		rtotal = plan->righttree->total_cost;
+	}
+
+	// recursion (the branches of an Append and the plan of a subquery
+	// are parallelized below)
+	plan->lefttree = par_Parallelize_recursive(plan->lefttree, port, query, resultRelation, &ldist);
+	plan->righttree = par_Parallelize_recursive(plan->righttree, port, query, resultRelation, &rdist);
+
+	// The Exchanges inserted below make the plan more expensive
+	if (plan->lefttree != NULL)
+	{
+		add_child_cost_delta(plan, plan->lefttree, lstartup, ltotal);
+	}
+	if (plan->righttree != NULL)
+	{
+		add_child_cost_delta(plan, plan->righttree, rstartup, rtotal);
+	}
+
+	if (plan->lefttree != NULL)
+	{
+		// Sort, Material, Hash, Result etc. keep the tuples where they are
+		*dist = ldist;
+	}
+
+	if (IsA(plan, SeqScan) || IsA(plan, IndexScan)
+		|| IsA(plan, BitmapHeapScan) || IsA(plan, TidScan))
+	{
+		scan_distribution((Scan*)plan, rtable, resultRelation, dist);
+		if (scan_is_excluded((Scan*)plan, rtable))
+		{
+			elog(DEBUG5, "the scan of relation %d is excluded on this node", ((Scan*)plan)->scanrelid);
+			plan = make_empty_scan((Scan*)plan);
+		}
+		else if (par_scan_workers > 1 && IsA(plan, SeqScan))
+		{
+			// The ranks of the fragment share the blocks
+			((Scan*)plan)->cooperative = true;
+		}
+		else if (par_scan_workers > 1 && _pargresql_GetNode() != par_fragment_leader(par_my_fragment()))
+		{
+			// The other scans cannot be shared, the leader runs them alone
+			plan = make_empty_scan((Scan*)plan);
+		}
+	}
+	else if (
+		IsA(plan, MergeJoin)
+		|| (IsA(plan, NestLoop) && (((Join*)plan)->joinqual != NULL))
+		|| IsA(plan, HashJoin)
+	)
+	{
+		plan = parallelize_join(plan, port, rtable, &ldist, &rdist, dist);
+	}
+	else if (IsA(plan, NestLoop))
+	{
+		// FIXME: nothing to exchange by, and the inner side
+		// may depend on the outer one.
+		dist->kind = DIST_ANY;
+		dist->keys = NIL;
+		dist->functions = NIL;
+	}
+	else if (IsA(plan, Agg))
+	{
+		Plan *twophase = NULL;
+		Oid *funcs;
+		Plan *oldleft = plan->lefttree;
+		Cost oldstartup = oldleft->startup_cost, oldtotal = oldleft->total_cost;
+
+		if (agg_is_colocated((Agg*)plan, &ldist))
+		{
+			// Every group is on its own node already.
+			elog(DEBUG5, "co-located aggregation, no exchanges needed");
+		}
+		else if ((twophase = make_two_phase_agg((Agg*)plan, port)) != NULL)
+		{
+			plan = twophase;
+		}
+		else if (((Agg*)plan)->aggstrategy == AGG_PLAIN
+			|| !agg_exchange_functions((Agg*)plan, &funcs))
+		{
+			// No grouping (or nothing to hash by) and the aggregates
+			// cannot be split, so inserting the constant ZERO exchange.
+			plan->lefttree = insert_exchange_here_or_deeper(
+				plan->lefttree,
+				port,
+				0, NULL, NULL
+				// Send all tuples to one node, hence a global group will occur on 0-node.
+			);
+			if (((Agg*)plan)->aggstrategy == AGG_PLAIN)
+			{
+				keep_only_on_node_zero(plan);
+			}
+		}
+		else
+		{
+			// Grouping by some attributes - so we just
+			// exchange by these attributes first.
+			plan->lefttree = insert_exchange_here_or_deeper(
+				plan->lefttree,
+				port,
+				((Agg*)plan)->numCols,
+				((Agg*)plan)->grpColIdx,
+				funcs
+				// Use the group-by attributes
+				// as the exchange attributes, in order
+				// to get the correct results of aggregation.
+			);
+		}
+		if (twophase == NULL)
+		{
+			add_child_cost_delta(plan, plan->lefttree, oldstartup, oldtotal);
+		}
+
+		// The groups stay where they have been formed, but the grouping
+		// columns are not necessarily in the output of the Agg.
+		dist->kind = DIST_ANY;
+		dist->keys = NIL;
+		dist->functions = NIL;
+	}
+	else if (IsA(plan, WindowAgg))
+	{
+		plan = parallelize_window((WindowAgg*)plan, port, query, &ldist, dist);
+	}
+	else if (IsA(plan, Unique))
+	{
+		// The duplicates have to meet on one node
+		plan = exchange_distinct_input(plan, port, query,
+			((Unique*)plan)->numCols,
+			((Unique*)plan)->uniqColIdx,
+			((Unique*)plan)->uniqOperators,
+			&ldist, dist);
+	}
+	else if (IsA(plan, SetOp))
+	{
+		// So do the equal rows of both inputs of INTERSECT and EXCEPT
+		plan = exchange_distinct_input(plan, port, query,
+			((SetOp*)plan)->numCols,
+			((SetOp*)plan)->dupColIdx,
+			((SetOp*)plan)->dupOperators,
+			&ldist, dist);
+	}
+	else if (IsA(plan, Append))
+	{
+		plan = parallelize_append((Append*)plan, port, query, resultRelation, dist);
+	}
+	else if (IsA(plan, SubqueryScan))
+	{
+		plan = parallelize_subquery((SubqueryScan*)plan, port, query, dist);
+	}
+	// FIXME: streams not implemented yet
+	/*
+	if (IsA(plan->lefttree, SeqScan))
+	{
+		plan->lefttree = make_stream((SeqScan*)plan->lefttree, (*port)++);
+	}
+	if (IsA(plan->righttree, SeqScan))
+	{
+		plan->righttree = make_stream((SeqScan*)plan->righttree, (*port)++);
+	}
+	*/
+	return plan;
+}
+
+/*****************************************************************************
+ *
+ *	   Window functions
+ *
+ * A window partition has to be on one node, in the order of the window.
+ * The input of a WindowAgg is exchanged by the hash of its first
+ * PARTITION BY column, so every node computes the windows of its own
+ * partitions. If the input is sorted for the WindowAgg, the Exchange goes
+ * under the Sort, and every node sorts the partitions it gets. Otherwise
+ * the input is in order already, and a Sort by the keys of the window
+ * clause goes over the Exchange. Without PARTITION BY, everything goes
+ * to node 0, which merges the ordered tuples of the nodes.
+ *
+ *****************************************************************************/
+
+// Returns true if every partition of the window is on its own node
+// already: the input is hashed on keys that all are partitioning columns.
+bool window_is_colocated(WindowAgg *wa, Distribution *dist)
+{
+	return columns_are_colocated(wa->plan.lefttree, wa->partNumCols, wa->partColIdx, dist);
+}
+
+// Finds the sort keys the input of the WindowAgg is in the order of:
+// the partitioning columns, then the ordering ones, sorted the way the
+// window clause says. Returns the number of the keys, or -1 if some of
+// them are not in the input.
+int window_sort_keys(WindowAgg *wa, Query *query, AttrNumber **colIdx, Oid **sortOperators, bool **nullsFirst)
+{
+	WindowClause *wc = NULL;
+	List *clauses;
+	ListCell *lc;
+	int i;
+
+	foreach(lc, query->windowClause)
+	{
+		if (((WindowClause*)lfirst(lc))->winref == wa->winref)
+		{
+			wc = (WindowClause*)lfirst(lc);
+		}
+	}
+	if (wc == NULL)
+	{
+		return -1;
+	}
+
+	clauses = list_concat(list_copy(wc->partitionClause), list_copy(wc->orderClause));
+	*colIdx = (AttrNumber*)palloc(sizeof(AttrNumber) * (list_length(clauses) + 1));
+	*sortOperators = (Oid*)palloc(sizeof(Oid) * (list_length(clauses) + 1));
+	*nullsFirst = (bool*)palloc(sizeof(bool) * (list_length(clauses) + 1));
+	i = 0;
+	foreach(lc, clauses)
+	{
+		SortGroupClause *sgc = (SortGroupClause*)lfirst(lc);
+		Node *expr = get_sortgroupclause_expr(sgc, query->targetList);
+		TargetEntry *te = tlist_member(expr, wa->plan.lefttree->targetlist);
+
+		if (te == NULL || !OidIsValid(sgc->sortop))
+		{
+			return -1;
+		}
+		(*colIdx)[i] = te->resno;
+		(*sortOperators)[i] = sgc->sortop;
+		(*nullsFirst)[i] = sgc->nulls_first;
+		i++;
+	}
+	return i;
+}
+
+// Puts the Exchange of the partitions under the WindowAgg.
+Plan *parallelize_window(WindowAgg *wa, int *port, Query *query, Distribution *ldist, Distribution *dist)
+{
+	Plan *plan = (Plan*)wa;
+	Plan *oldleft = plan->lefttree;
+	Cost oldstartup = oldleft->startup_cost, oldtotal = oldleft->total_cost;
+	int numCols = 0;
+	Oid *funcs = NULL;
+	AttrNumber *sortColIdx;
+	Oid *sortOperators;
+	bool *nullsFirst;
+	int numSortCols;
+
+	if (window_is_colocated(wa, ldist))
+	{
+		// Every partition is on its own node already.
+		elog(DEBUG5, "co-located window, no exchanges needed");
+		return plan;
+	}
+
+	if (wa->partNumCols > 0)
+	{
+		Oid rfunc;
+
+		funcs = (Oid*)palloc(sizeof(Oid));
+		if (get_op_hash_functions(wa->partOperators[0], &funcs[0], &rfunc))
+		{
+			numCols = 1;
+		}
+	}
+
+	if (IsA(oldleft, Sort) && numCols > 0)
+	{
+		// Every node sorts the partitions it gets
+		plan->lefttree = insert_exchange_here_or_deeper(oldleft, port, numCols, wa->partColIdx, funcs);
+	}
+	else if (IsA(oldleft, Sort))
+	{
+		// A single window (or nothing to hash by): every node sorts its
+		// own tuples, node-0 merges them
+		plan->lefttree = make_sorted_exchange(oldleft, (Sort*)oldleft, (*port)++);
+	}
+	else if ((numSortCols = window_sort_keys(wa, query, &sortColIdx, &sortOperators, &nullsFirst)) >= 0)
+	{
+		// The input is in order already: node 0 merges the ordered
+		// streams, a hashed Exchange sorts what every node gets
+		plan->lefttree = make_ordered_exchange(oldleft, (*port)++, numCols, wa->partColIdx, funcs,
+			numSortCols, sortColIdx, sortOperators, nullsFirst);
+	}
+	else
+	{
+		elog(DEBUG5, "the order of the window input is unknown, no exchanges inserted");
+		return plan;
+	}
+	add_child_cost_delta(plan, plan->lefttree, oldstartup, oldtotal);
+
+	// The WindowAgg passes its input columns through
+	hashed_distribution(plan->lefttree, numCols, wa->partColIdx, funcs, dist);
+	return plan;
+}
+
+/*****************************************************************************
+ *
+ *	   Set operations
+ *
+ * The branches of an Append (UNION ALL, or the children of an inherited
+ * relation) and the plans of the subqueries (the branches of every set
+ * operation) are parallelized on their own, and the Append is hashed on
+ * the columns its branches are all hashed on. A Unique (DISTINCT, UNION)
+ * and a SetOp (INTERSECT, EXCEPT) need the equal rows on one node, so
+ * their input is exchanged by the hash of all their columns, under the
+ * Sort if there is one, or under a new Sort in the order of the input
+ * if the input is in order already. The input of a SetOp is exchanged
+ * branch by branch under its Append, since the hashed SetOp has to read
+ * the whole first input before the second one.
+ *
+ *****************************************************************************/
+
+// Puts an Exchange over every branch of the Append.
+Plan *exchange_append_branches(Append *append, int *port, int numCols, AttrNumber *colIdx, Oid *functions)
+{
+	ListCell *lc;
+
+	foreach(lc, append->appendplans)
+	{
+		Plan *branch = (Plan*)lfirst(lc);
+		Cost oldstartup = branch->startup_cost, oldtotal = branch->total_cost;
+
+		lfirst(lc) = insert_exchange_here_or_deeper(branch, port, numCols, colIdx, functions);
+		add_child_cost_delta((Plan*)append, (Plan*)lfirst(lc), oldstartup, oldtotal);
+	}
+	return (Plan*)append;
+}
+
+// Finds the sort operators the input of the Unique or the SetOp is in
+// the order of, column by column: the ones of the DISTINCT clause if
+// the Unique is the one of the query, the ascending ones of the equality
+// operators otherwise. Returns the number of the keys, or -1 if some
+// column has no ordering operator.
+int distinct_sort_keys(Plan *plan, Query *query, int numCols, AttrNumber *colIdx, Oid *operators, Oid **sortOperators, bool **nullsFirst)
+{
+	bool distinct = IsA(plan, Unique) && list_length(query->distinctClause) == numCols;
+	ListCell *lc;
+	int i;
+
+	*sortOperators = (Oid*)palloc(sizeof(Oid) * (numCols + 1));
+	*nullsFirst = (bool*)palloc(sizeof(bool) * (numCols + 1));
+	i = 0;
+	foreach(lc, query->distinctClause)
+	{
+		SortGroupClause *sgc = (SortGroupClause*)lfirst(lc);
+		Node *expr = get_sortgroupclause_expr(sgc, query->targetList);
+		TargetEntry *te = tlist_member(expr, plan->lefttree->targetlist);
+
+		if (!distinct || te == NULL || te->resno != colIdx[i] || !OidIsValid(sgc->sortop))
+		{
+			distinct = false;
+			break;
+		}
+		(*sortOperators)[i] = sgc->sortop;
+		(*nullsFirst)[i] = sgc->nulls_first;
+		i++;
+	}
+	if (distinct)
+	{
+		return numCols;
+	}
+
+	for (i = 0; i < numCols; i++)
+	{
+		(*sortOperators)[i] = get_ordering_op_for_equality_op(operators[i], false);
+		(*nullsFirst)[i] = false;
+		if (!OidIsValid((*sortOperators)[i]))
+		{
+			return -1;
+		}
+	}
+	return numCols;
+}
+
+// Exchanges the input of the Unique or the SetOp by the hash of the
+// columns whose equal values it looks for. Everything goes to node 0 if
+// some of them cannot be hashed.
+Plan *exchange_distinct_input(Plan *plan, int *port, Query *query, int numCols, AttrNumber *colIdx, Oid *operators, Distribution *ldist, Distribution *dist)
+{
+	Plan *oldleft = plan->lefttree;
+	Cost oldstartup = oldleft->startup_cost, oldtotal = oldleft->total_cost;
+	Plan *input = oldleft;
+	int hashCols = numCols;
+	Oid *funcs;
+	Oid *sortOperators;
+	bool *nullsFirst;
+	int i;
+
+	if (columns_are_colocated(oldleft, numCols, colIdx, ldist))
+	{
+		// The equal rows are on one node already.
+		elog(DEBUG5, "co-located %s, no exchanges needed", IsA(plan, Unique) ? "unique" : "setop");
+		return plan;
+	}
+
+	funcs = (Oid*)palloc(sizeof(Oid) * (numCols + 1));
+	for (i = 0; i < numCols; i++)
+	{
+		Oid rfunc;
+		if (!get_op_hash_functions(operators[i], &funcs[i], &rfunc))
+		{
+			hashCols = 0;
+			break;
+		}
+	}
+
+	if (IsA(input, Sort))
+	{
+		input = input->lefttree;
+	}
+	if (IsA(plan, SetOp) && IsA(input, Append))
+	{
+		// The branches of a set operation have the columns of the Append
+		Cost startup = input->startup_cost, total = input->total_cost;
+
+		exchange_append_branches((Append*)input, port, hashCols, colIdx, funcs);
+		if (input != oldleft)
+		{
+			add_child_cost_delta(oldleft, input, startup, total);
+		}
+	}
+	else if (input != oldleft)
+	{
+		// Every node sorts the rows it gets
+		plan->lefttree = insert_exchange_here_or_deeper(oldleft, port, hashCols, colIdx, funcs);
+	}
+	else if (distinct_sort_keys(plan, query, numCols, colIdx, operators, &sortOperators, &nullsFirst) >= 0)
+	{
+		// The input is in order already: every node sorts the rows
+		// it gets, or node 0 merges them
+		plan->lefttree = make_ordered_exchange(oldleft, (*port)++, hashCols, colIdx, funcs,
+			numCols, colIdx, sortOperators, nullsFirst);
+	}
+	else
+	{
+		elog(ERROR, "could not find the order of the %s input", IsA(plan, Unique) ? "unique" : "setop");
+	}
+	add_child_cost_delta(plan, plan->lefttree, oldstartup, oldtotal);
+
+	// The rows stay where they have met
+	hashed_distribution(plan->lefttree, hashCols, colIdx, funcs, dist);
+	return plan;
+}
+
+// Parallelizes the branches of the Append, and finds out whether they
+// are all hashed on the same columns.
+Plan *parallelize_append(Append *append, int *port, Query *query, Index resultRelation, Distribution *dist)
+{
+	Plan *plan = (Plan*)append;
+	int nbranches = list_length(append->appendplans);
+	Distribution *dists;
+	AttrNumber *colIdx = NULL;
+	Oid *funcs = NULL;
+	int numCols = 0;
+	bool hashed = true, replicated = true;
+	ListCell *lc, *kc, *fc;
+	int i, k;
+
+	if (append->isTarget)
+	{
+		// FIXME: the branches update different relations, and the rows
+		// of every one of them have to stay on their nodes.
+		elog(DEBUG5, "the append of an inherited result relation, no exchanges inserted");
+		return plan;
+	}
+
+	dists = (Distribution*)palloc(sizeof(Distribution) * nbranches);
+	i = 0;
+	foreach(lc, append->appendplans)
+	{
+		Plan *branch = (Plan*)lfirst(lc);
+		Cost oldstartup = branch->startup_cost, oldtotal = branch->total_cost;
+
+		lfirst(lc) = par_Parallelize_recursive(branch, port, query, resultRelation, &dists[i]);
+		add_child_cost_delta(plan, (Plan*)lfirst(lc), oldstartup, oldtotal);
+		hashed = hashed && dists[i].kind == DIST_HASHED;
+		replicated = replicated && dists[i].kind == DIST_REPLICATED;
+		i++;
+	}
+
+	if (replicated)
+	{
+		dist->kind = DIST_REPLICATED;
+		return plan;
+	}
+
+	// The rows of a replicated branch are returned once
+	i = 0;
+	foreach(lc, append->appendplans)
+	{
+		if (dists[i].kind == DIST_REPLICATED)
+		{
+			keep_only_on_node_zero((Plan*)lfirst(lc));
+		}
+		i++;
+	}
+
+	if (!hashed)
+	{
+		return plan;
+	}
+
+	// The columns of the first branch every key is in
+	numCols = list_length(dists[0].keys);
+	colIdx = (AttrNumber*)palloc(sizeof(AttrNumber) * (numCols + 1));
+	funcs = (Oid*)palloc(sizeof(Oid) * (numCols + 1));
+	k = 0;
+	forboth(kc, dists[0].keys, fc, dists[0].functions)
+	{
+		ListCell *tc;
+
+		colIdx[k] = InvalidAttrNumber;
+		foreach(tc, ((Plan*)linitial(append->appendplans))->targetlist)
+		{
+			TargetEntry *te = (TargetEntry*)lfirst(tc);
+			if (dist_key_matches((Expr*)lfirst(kc), te->expr))
+			{
+				colIdx[k] = te->resno;
+				break;
+			}
+		}
+		if (colIdx[k] == InvalidAttrNumber)
+		{
+			return plan;
+		}
+		funcs[k] = lfirst_oid(fc);
+		k++;
+	}
+
+	// The other branches have to be hashed on the same columns
+	i = 0;
+	foreach(lc, append->appendplans)
+	{
+		if (list_length(dists[i].keys) != numCols)
+		{
+			return plan;
+		}
+		k = 0;
+		forboth(kc, dists[i].keys, fc, dists[i].functions)
+		{
+			TargetEntry *te = get_tle_by_resno(((Plan*)lfirst(lc))->targetlist, colIdx[k]);
+			if (te == NULL || !dist_key_matches((Expr*)lfirst(kc), te->expr) || lfirst_oid(fc) != funcs[k])
+			{
+				return plan;
+			}
+			k++;
+		}
+		i++;
+	}
+
+	hashed_distribution(plan, numCols, colIdx, funcs, dist);
+	return plan;
+}
+
+// Parallelizes the plan of the subquery, which has a range table of its
+// own, and finds the columns of the scan its distribution keys are in.
+Plan *parallelize_subquery(SubqueryScan *scan, int *port, Query *query, Distribution *dist)
+{
+	RangeTblEntry *rte = rt_fetch(scan->scan.scanrelid, query->rtable);
+	Query subquery;
+	Distribution subdist;
+	Cost oldstartup = scan->subplan->startup_cost, oldtotal = scan->subplan->total_cost;
+	ListCell *kc, *fc;
+
+	if (rte->rtekind != RTE_SUBQUERY || rte->subquery == NULL)
+	{
+		return (Plan*)scan;
+	}
+
+	// The Vars of the subplan refer to the range table of the subquery
+	subquery = *rte->subquery;
+	subquery.rtable = scan->subrtable;
+	scan->subplan = par_Parallelize_recursive(scan->subplan, port, &subquery, 0, &subdist);
+	add_child_cost_delta((Plan*)scan, scan->subplan, oldstartup, oldtotal);
+
+	if (subdist.kind == DIST_REPLICATED)
+	{
+		dist->kind = DIST_REPLICATED;
+		return (Plan*)scan;
+	}
+	if (subdist.kind != DIST_HASHED)
+	{
+		return (Plan*)scan;
+	}
+
+	forboth(kc, subdist.keys, fc, subdist.functions)
+	{
+		ListCell *tc;
+		Expr *key = NULL;
+
+		// The column of the subplan the key is in...
+		foreach(tc, scan->subplan->targetlist)
+		{
+			TargetEntry *te = (TargetEntry*)lfirst(tc);
+			if (dist_key_matches((Expr*)lfirst(kc), te->expr))
+			{
+				break;
+			}
+		}
+		// ...and the column of the scan that returns it
+		if (tc != NULL)
+		{
+			AttrNumber resno = ((TargetEntry*)lfirst(tc))->resno;
+			ListCell *sc;
+
+			foreach(sc, scan->scan.plan.targetlist)
+			{
+				Expr *expr = ((TargetEntry*)lfirst(sc))->expr;
+				while (IsA(expr, RelabelType))
+				{
+					expr = ((RelabelType*)expr)->arg;
+				}
+				if (IsA(expr, Var) && ((Var*)expr)->varno == scan->scan.scanrelid
+					&& ((Var*)expr)->varattno == resno && ((Var*)expr)->varlevelsup == 0)
+				{
+					key = expr;
+					break;
+				}
+			}
+		}
+		if (key == NULL)
+		{
+			dist->kind = DIST_ANY;
+			dist->keys = NIL;
+			dist->functions = NIL;
+			return (Plan*)scan;
+		}
+		dist->keys = lappend(dist->keys, key);
+		dist->functions = lappend_oid(dist->functions, lfirst_oid(fc));
+	}
+	dist->kind = DIST_HASHED;
+	return (Plan*)scan;
+}
+
+/*****************************************************************************
+ *
+ *	   LIMIT pushdown
+ *
+ * A LIMIT at the root needs at most OFFSET + COUNT rows from every node,
+ * so every node applies such a Limit to its own rows before the root
+ * Exchange, and the original Limit picks the rows out of what node 0
+ * gets. A Limit over a Sort makes the Sort keep the top rows only (see
+ * ExecLimit), and the root Exchange then merges the sorted rows. Once
+ * the Limit of node 0 has got enough, the Exchange stops the other
+ * nodes (see ExecGatherCancel).
+ *
+ *****************************************************************************/
+
+// The count of the Limit every node applies to its own rows, or NULL
+// if there is no count (LIMIT ALL), or it cannot be computed before
+// the execution.
+Node *limit_pushdown_count(Limit *limit, int64 *count_est)
+{
+	Const *count, *offset;
+	int64 sum;
+
+	if (limit->limitCount == NULL
+		|| (IsA(limit->limitCount, Const) && ((Const*)limit->limitCount)->constisnull))
+	{
+		return NULL;
+	}
+	if (limit->limitOffset == NULL)
+	{
+		// The count may be a parameter, every node gets the same one
+		*count_est = IsA(limit->limitCount, Const) ? DatumGetInt64(((Const*)limit->limitCount)->constvalue) : -1;
+		return (Node*)copyObject(limit->limitCount);
+	}
+	if (!IsA(limit->limitCount, Const) || !IsA(limit->limitOffset, Const))
+	{
+		return NULL;
+	}
+
+	count = (Const*)limit->limitCount;
+	offset = (Const*)limit->limitOffset;
+	sum = DatumGetInt64(count->constvalue);
+	if (!offset->constisnull && DatumGetInt64(offset->constvalue) > 0)
+	{
+		sum += DatumGetInt64(offset->constvalue);
+	}
+	if (sum < 0)
+	{
+		return NULL; // an overflow, or a negative count ExecLimit will complain about
+	}
+	*count_est = sum;
+	return (Node*)makeConst(INT8OID, -1, sizeof(int64), Int64GetDatum(sum), false, FLOAT8PASSBYVAL);
+}
+
+// Puts the root Exchange under the Limit, with a Limit of every node
+// under the Exchange if the count of it can be computed. Without one,
+// every node sends all of its rows, and the Limit of node 0 still skips
+// the OFFSET rows of the whole result, not the ones of every node.
+Plan *parallelize_root_limit(Limit *limit, int *port)
+{
+	Plan *below = limit->plan.lefttree;
+	Plan *local, *exchange;
+	Node *count;
+	int64 count_est = 0;
+	Cost oldstartup = below->startup_cost, oldtotal = below->total_cost;
+
+	count = limit_pushdown_count(limit, &count_est);
+	local = below;
+	if (count != NULL)
+	{
+		local = (Plan*)make_limit(below, NULL, count, 0, count_est);
+	}
+	if (IsA(below, Sort))
+	{
+		// Every node sorts its (top) rows, node-0 merges them
+		exchange = make_sorted_exchange(local, (Sort*)below, (*port)++);
+	}
+	else
+	{
+		exchange = make_exchange(local, (*port)++, 0, NULL, NULL);
+	}
+	set_exchange_cancelable(exchange);
+
+	limit->plan.lefttree = exchange;
+	add_child_cost_delta((Plan*)limit, exchange, oldstartup, oldtotal);
+	return (Plan*)limit;
+}
+
+/*
+ * Adds the following expression to the plan qual list:
+ * coalesce(pargresql_hash_fragment(hash(tuple[attr])), 0) == me
+ * which keeps the tuples of the virtual buckets of this fragment.
+ */
+void add_qual_attr_hash_fragment_equals_me(Plan *plan, int attr, int me)
+{
+	Expr *hash, *fragment, *is_mine, *attr_expr;
+	Const *me_const, *zero_const;
+	CoalesceExpr *null_is_zero;
+	TargetEntry *te;
+
+	// Make constant expressions
+	me_const = make_const(NULL, makeInteger(me), -1);
+	zero_const = make_const(NULL, makeInteger(0), -1);
+
+	// Get the expression for tuple[attr]
+	te = list_nth(plan->targetlist, attr - 1);
+	Assert(IsA(te, TargetEntry));
+	attr_expr = te->expr;
+
+	// Get the expression for the hash of tuple[attr]
+	hash = (Expr*)makeFuncExpr(
+		get_type_hash_function(exprType((Node*)attr_expr)),
+		INT4OID,
+		list_make1(attr_expr),
+		COERCE_EXPLICIT_CALL
+	);
+
+	// Get the expression for the fragment of its bucket
+	fragment = (Expr*)makeFuncExpr(
+		F_PARGRESQL_HASH_FRAGMENT,
+		INT4OID,
+		list_make1(hash),
+		COERCE_EXPLICIT_CALL
+	);
+
+	// The hash of NULL is NULL, but fragfunc sends such tuples to node 0
+	null_is_zero = makeNode(CoalesceExpr);
+	null_is_zero->coalescetype = INT4OID;
+	null_is_zero->args = list_make2(fragment, zero_const);
+	null_is_zero->location = -1;
+
+	// Get the expression for == operator
+	is_mine = make_op(NULL, list_make1(makeString("=")), (Node*)null_is_zero, (Node*)me_const, -1);
+	Assert(IsA(is_mine, OpExpr));
+
+	// Append the "==" expression to plan's qual list
+	add_plan_qual(plan, is_mine);
+}
+
+/*
+ * Adds the expression that keeps the tuples whose tuple[attr] is in
+ * the range or the list of this node.
+ */
+void add_qual_attr_in_fragment_of_me(Plan *plan, int attr, ParFragScheme *scheme, int me)
+{
+	TargetEntry *te;
+
+	te = list_nth(plan->targetlist, attr - 1);
+	Assert(IsA(te, TargetEntry));
+	add_plan_qual(plan, fragscheme_qual(scheme, te->expr, me));
+}
+
+/*
+ * Appends the expression to the plan qual list.
+ */
+void add_plan_qual(Plan *plan, Expr *qual)
+{
+	if (IsA(plan, Result)) {
+		// For some reason, Result operator ignores plain 'qual'
+		// and only respects its own resconstantqual :(
+		((Result*)plan)->resconstantqual = (Node*)lappend(plan->qual, qual);
+	} else {
+		plan->qual = lappend(plan->qual, qual);
+	}
+}
+
+/*
+ * Returns the Oid of the result relation for an INSERT, UPDATE or DELETE query.
+ */
+Oid get_query_result_relid(Query *query)
+{
+	RangeTblEntry *rte;
+	rte = (RangeTblEntry*)list_nth(query->rtable, query->resultRelation - 1);
+	//Assert(IsEqual(rte->rtekind, RTE_RELATION));
+	return rte->relid;
+}
+
+/*
+ * Returns the attribute's number (starting from 1) in relation by the
+ * attribute's name.
+ */
+AttrNumber get_atno_in_relid_by_atname(Oid relid, const char* atname)
+{
+	Relation relation;
+	int result;
+
+	relation = RelationIdGetRelation(relid);
+	result = attnameAttNum(relation, atname, /*sysColOk*/TRUE);
+	RelationClose(relation);
+
+	return result;
+}
+
+/*
+ * This returns 'fragattr' reloption of the relation with given Oid,
+ * or NULL if the relation has no options at all.
+ * You should free the allocated string yourself with pfree().
+ */
+char *get_relid_fragattr(Oid relid)
+{
+	Relation relation;
+	char *fragattr, *result;
+	StdRdOptions *opts;
+
+	relation = RelationIdGetRelation(relid);
+
+	opts = ((StdRdOptions*)relation->rd_options);
+	if (opts == NULL)
+	{
+		RelationClose(relation);
+		return NULL;
+	}
+	fragattr = ((char*)opts) + (long)opts->fragattr; // just opts->fragattr would only be an offset
+	result = palloc(strlen(fragattr) + 1);
+	strcpy(result, fragattr);
+
+	RelationClose(relation);
+
+	return result;
+}
+
+/*
+ * This returns fragattr number (starting from 1)
+ * in the relation with given Oid, or InvalidAttrNumber
+ * if the relation is not fragmented by an attribute.
+ */
+int get_relid_fragatno(Oid relid)
+{
+	char *fragattr;
+	int result;
+
+	fragattr = get_relid_fragattr(relid);
+	if (fragattr == NULL)
+	{
+		return InvalidAttrNumber;
+	}
+	result = get_atno_in_relid_by_atname(relid, fragattr);
+	pfree(fragattr);
+
+	return result;
+}
+
+Plan *par_Parallelize(Plan *plan, Query *query)
+{
+	int port = 0;
+	int fragatno; // partitioning attribute number
+	int me;
+	Distribution dist; // of the result
+	AttrNumber *fragcol; // the key of the UPDATE root exchange
+	Oid *fragfunc;
+	Var *fragvar;
+	ParFragScheme *scheme; // of the result relation, if not hashed
+
+	elog(DEBUG5, "Be quiet, parallelizer is working...\n");
+	print_nodetag_recursive(plan);	
+	elog(DEBUG5, "\n");
+
+	switch (query->commandType) {
+		case CMD_SELECT:
+			// Aggregate all the result tuples on node-0
 			elog(DEBUG5, "This is a SELECT.\n");
-			plan = par_Parallelize_recursive(plan, &port);
+			plan = par_Parallelize_recursive(plan, &port, query, 0, &dist);
 			elog(DEBUG5, "Exchange nodes inserted into the plan.\n");
-			plan = insert_exchange_here_or_deeper(plan, &port, 0);
+			if (IsA(plan, Limit))
+			{
+				// The OFFSET is of the whole result, so the exchange
+				// always goes under the Limit
+				plan = parallelize_root_limit((Limit*)plan, &port);
+				elog(DEBUG5, "The Limit pushed down under the special exchange (ex.func == 0).\n");
+				break;
+			}
+			if (IsA(plan, Sort))
+			{
+				// Every node sorts its own tuples, node-0 merges them
+				plan = make_sorted_exchange(plan, (Sort*)plan, port++);
+				elog(DEBUG5, "An ordered exchange (ex.func == 0) inserted above the root Sort.\n");
+				break;
+			}
+			plan = insert_exchange_here_or_deeper(plan, &port, 0, NULL, NULL);
 			elog(DEBUG5, "A special exchange (ex.func == 0) inserted into the root.\n");
 			break;
 		case CMD_INSERT:
@@ -487,23 +2518,63 @@ Plan *par_Parallelize(Plan *plan, Query *query)
 			// tuples of the root node, so they wouldn't get inserted
 			// into every partition.
 			fragatno = get_relid_fragatno(get_query_result_relid(query));
+			if (fragatno <= 0)
+			{
+				elog(ERROR, "relation \"%s\" has no valid fragattr", get_rel_name(get_query_result_relid(query)));
+			}
 			elog(DEBUG5, "This is an INSERT into a table where fragattr is set to %d.\n", fragatno);
-			nodes = _pargresql_GetNodesCount();
-			me = _pargresql_GetNode();
-			add_qual_attr_mod_nodes_equals_me(plan, fragatno, nodes, me);
-			elog(DEBUG5, "Added qual 'tuple[%d] %% %d == %d'.\n", fragatno, nodes, me);
+			me = par_my_fragment();
+			if (_pargresql_GetNode() != par_fragment_leader(me))
+			{
+				// The leader inserts the rows of the whole fragment
+				add_plan_qual(plan, (Expr*)makeBoolConst(false, false));
+				elog(DEBUG5, "Not the leader of fragment %d, inserting nothing.\n", me);
+				break;
+			}
+			scheme = get_relid_fragscheme(get_query_result_relid(query));
+			if (scheme != NULL)
+			{
+				add_qual_attr_in_fragment_of_me(plan, fragatno, scheme, me);
+				elog(DEBUG5, "Added qual 'tuple[%d] in fragment %d'.\n", fragatno, me);
+				break;
+			}
+			add_qual_attr_hash_fragment_equals_me(plan, fragatno, me);
+			elog(DEBUG5, "Added qual 'fragment of hash(tuple[%d]) == %d'.\n", fragatno, me);
 			break;
 		case CMD_UPDATE:
-			// FIXME: 
+			// Every node updates the rows of its own fragment, and the
+			// rows whose fragattr changes move to their new nodes: the
+			// root exchange deletes them here and inserts them there
+			// (see ExecSplit).
 			fragatno = get_relid_fragatno(get_query_result_relid(query));
+			if (fragatno <= 0)
+			{
+				elog(ERROR, "relation \"%s\" has no valid fragattr", get_rel_name(get_query_result_relid(query)));
+			}
 			elog(DEBUG5, "This is an UPDATE of a table where fragattr is set to %d.\n", fragatno);
-			plan = par_Parallelize_recursive(plan, &port);
+			plan = par_Parallelize_recursive(plan, &port, query, query->resultRelation, &dist);
 			elog(DEBUG5, "Exchange nodes inserted into the plan.\n");
-			plan = insert_exchange_here_or_deeper(plan, &port, fragatno);
-			elog(DEBUG5, "A special exchange (ex.func == tuple[%d] %% nodes) inserted into the root.\n", fragatno);
+			fragvar = (Var*)get_tle_by_resno(plan->targetlist, fragatno)->expr;
+			if (IsA(fragvar, Var) && fragvar->varno == query->resultRelation
+				&& fragvar->varattno == fragatno && fragvar->varlevelsup == 0)
+			{
+				elog(DEBUG5, "The fragattr is not changed, the rows stay where they are.\n");
+				break;
+			}
+			fragcol = (AttrNumber*)palloc(sizeof(AttrNumber));
+			fragcol[0] = fragatno;
+			fragfunc = (Oid*)palloc(sizeof(Oid));
+			fragfunc[0] = get_type_hash_function(exprType((Node*)get_tle_by_resno(plan->targetlist, fragatno)->expr));
+			plan = insert_exchange_here_or_deeper(plan, &port, 1, fragcol, fragfunc);
+			set_exchange_fragments(plan, get_relid_fragscheme(get_query_result_relid(query)));
+			elog(DEBUG5, "A special exchange (ex.func == fragment of tuple[%d]) inserted into the root.\n", fragatno);
 			break;
 		case CMD_DELETE:
-			elog(DEBUG5, "This is a DELETE. Doing nothing...\n");
+			// Every node deletes the rows of its own fragment, the
+			// exchanges only bring the other relations to them.
+			elog(DEBUG5, "This is a DELETE.\n");
+			plan = par_Parallelize_recursive(plan, &port, query, query->resultRelation, &dist);
+			elog(DEBUG5, "Exchange nodes inserted into the plan.\n");
 			break;
 		default:
 			elog(DEBUG5, "This is not a SELECT, INSERT, UPDATE or DELETE command. Doing nothing...\n");
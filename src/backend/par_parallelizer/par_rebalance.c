@@ -0,0 +1,861 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_rebalance.c
+ *	  Moving the virtual buckets of the hashed relations between the
+ *	  fragments of PargreSQL.
+ *
+ * SELECT pargresql_rebalance(from_fragments, max_buckets) runs on every
+ * node at once, as every command does. Then:
+ *
+ * 1. Every node takes the map of the buckets from node 0, so that a new
+ *    node, whose pg_par_bucket is empty, gets the map the rows have been
+ *    placed by. If node 0 has not recorded its map yet, the map is
+ *    bucket % from_fragments, the one of the cluster before it has grown
+ *    (0 stands for the current number of the fragments).
+ *
+ * 2. Every node picks the same buckets to move: the ones of the
+ *    fragments that have more than their share of PAR_BUCKETS, at most
+ *    max_buckets of them, go to the fragments that have less.
+ *
+ * 3. For every bucket moved, the old leader of the bucket sends its rows
+ *    of every hashed relation to the new leader, the new leader inserts
+ *    them and acknowledges the number of the rows inserted, and only
+ *    then the old leader deletes them. The rows move as they are: they
+ *    get their index entries and are checked against the constraints,
+ *    but neither the triggers nor the rules see them. If the new leader
+ *    fails to insert the rows, it says so instead, and the command fails
+ *    on the old leader as well.
+ *
+ * 4. The leaders record the new map.
+ *
+ * A node does all of this in the transaction of the command, and the
+ * command must run in a transaction block which is ended by PREPARE
+ * TRANSACTION on every node and then, once every node has prepared, by
+ * COMMIT PREPARED on every node (par_PQrebalance of par_libpq does so).
+ * A node refuses to COMMIT a transaction that has moved buckets. So the
+ * rows and the map change on both leaders of a bucket or on neither: a
+ * failure before every node has prepared rolls back every node, and a
+ * prepared transaction outlives a crash of its node until it is
+ * committed. Until then, the other sessions see the rows and the map as
+ * they were. This needs max_prepared_transactions > 0.
+ *
+ * Every message carries the transaction id node 0 has in the command,
+ * so that the messages left over by a failed run are dropped by the
+ * next one, and a node waits REBALANCE_TIMEOUT seconds at most for the
+ * other one.
+ * The hashed relations are locked against writes until the commit, but
+ * can be read all along. Moving a few buckets per command keeps the
+ * locks short: every node returns the number of the buckets still to
+ * move, and the command can be repeated until that is 0.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <arpa/inet.h>
+
+#include "access/heapam.h"
+#include "access/par_coopscan.h"
+#include "access/par_tupack.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_par_bucket.h"
+#include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "executor/tuptable.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "storage/lmgr.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "par_parallelizer/par_fragment.h"
+#include "par_parallelizer/par_parallelizer.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+
+// Every message is REBALANCE_FRAME bytes at most, and starts with
+//	uint32	the run: the transaction id of node 0
+//	int32	the kind of the message
+//	int32	the count: the bytes used after the header (REBALANCE_ROWS),
+//		or the rows inserted, -1 if they could not be (REBALANCE_ACK)
+// The map (REBALANCE_MAP) is PAR_BUCKETS int32 after the header. The rows
+// of a bucket go in REBALANCE_ROWS messages, and one with none used ends
+// the bucket. The rows are
+//	int32	the length of the packed row
+//	...	the packed row (see par_tupack)
+// one after another, and may be cut anywhere between the messages.
+#define REBALANCE_FRAME GATHER_BUFLEN
+#define REBALANCE_HEADER 12
+#define REBALANCE_MAP 1
+#define REBALANCE_ROWS 2
+#define REBALANCE_ACK 3
+#define REBALANCE_FETCH 1000
+#define REBALANCE_TIMEOUT 600 // seconds to wait for another node
+
+// A hashed relation, as the queries moving its rows need it
+typedef struct RebalanceRel
+{
+	Oid relid;
+	char *name; // the quoted qualified name
+	char *bucket; // the expression of the bucket of a row
+	TupleDesc desc; // the columns 'SELECT *' returns
+	AttrNumber fragatno; // the fragmentation attribute
+	FmgrInfo hashfn; // the hash function of its type
+} RebalanceRel;
+
+typedef struct RebalanceStream
+{
+	int peer;
+	StringInfoData buf; // the message being filled, or the bytes not read yet
+	char *frame; // the message being received
+} RebalanceStream;
+
+// The run of the current command, and the transaction that has moved
+// buckets and cannot be committed but through PREPARE TRANSACTION
+static uint32 rebalance_run = 0;
+static TransactionId rebalance_xid = InvalidTransactionId;
+
+static void rebalance_wait(_pargresql_request_t *request, int peer);
+static void msg_begin(StringInfo buf, int kind, int32 count);
+static void msg_send(int peer, StringInfo buf);
+static int32 msg_recv(int peer, int kind, char *frame, StringInfo msg);
+static void sync_bucket_map(int *map, int fragments);
+static int plan_moves(int *map, int fragments, int max);
+static void record_bucket(Relation rel, int bucket, int fragment);
+static List *hashed_relations(void);
+static char *function_name(Oid funcid);
+static void stream_put(RebalanceStream *s, const char *data, int len);
+static void stream_flush(RebalanceStream *s);
+static bool stream_fill(RebalanceStream *s, int len);
+static void send_ack(int peer, int32 rows);
+static int32 recv_ack(int peer);
+static void send_bucket(RebalanceRel *r, int bucket, int dst);
+static uint32 delete_bucket(RebalanceRel *r, int bucket);
+static uint32 recv_bucket(RebalanceRel *r, int src);
+
+// Waits until the message has been sent to or received from 'peer'. A
+// request given up on stays posted, but the run it belongs to fails.
+static void rebalance_wait(_pargresql_request_t *request, int peer)
+{
+	TimestampTz start = GetCurrentTimestamp();
+	int flag;
+
+	while (1)
+	{
+		_pargresql_Test(request, &flag); // FIXME: INIS naming
+		if (flag)
+		{
+			return;
+		}
+		if (TimestampDifferenceExceeds(start, GetCurrentTimestamp(), REBALANCE_TIMEOUT * 1000))
+		{
+			ereport(ERROR,
+				(errmsg("node %d has not answered in %d seconds", peer, REBALANCE_TIMEOUT),
+				 errdetail("Nothing moves unless every node prepares its transaction.")));
+		}
+		_pargresql_Wait(100); // FIXME: INIS naming
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+// Starts a message of the run.
+static void msg_begin(StringInfo buf, int kind, int32 count)
+{
+	resetStringInfo(buf);
+	pq_sendint(buf, rebalance_run, 4);
+	pq_sendint(buf, kind, 4);
+	pq_sendint(buf, count, 4);
+}
+
+static void msg_send(int peer, StringInfo buf)
+{
+	_pargresql_request_t request;
+
+	_pargresql_ISend(peer, PAR_REBALANCE_PORT, buf->len, buf->data, &request); // FIXME: INIS naming
+	rebalance_wait(&request, peer);
+}
+
+// Receives the next message of the kind from 'peer' into 'frame', of
+// REBALANCE_FRAME bytes, and points 'msg' past its header. The messages
+// of the runs before are dropped, and the map starts a run. Returns the
+// count of the message.
+static int32 msg_recv(int peer, int kind, char *frame, StringInfo msg)
+{
+	while (1)
+	{
+		_pargresql_request_t request;
+		uint32 run;
+		int k;
+		int32 count;
+
+		_pargresql_IRecv(peer, PAR_REBALANCE_PORT, REBALANCE_FRAME, frame, &request); // FIXME: INIS naming
+		rebalance_wait(&request, peer);
+
+		msg->data = frame;
+		msg->len = REBALANCE_FRAME;
+		msg->maxlen = REBALANCE_FRAME;
+		msg->cursor = 0;
+		run = pq_getmsgint(msg, 4);
+		k = pq_getmsgint(msg, 4);
+		count = pq_getmsgint(msg, 4);
+
+		if (k == REBALANCE_MAP && kind == REBALANCE_MAP)
+		{
+			rebalance_run = run;
+			return count;
+		}
+		if (kind != REBALANCE_MAP && run == rebalance_run)
+		{
+			if (k != kind)
+			{
+				elog(ERROR, "node %d has sent a rebalance message of kind %d instead of %d", peer, k, kind);
+			}
+			return count;
+		}
+		elog(DEBUG1, "rebalance: dropped a message of a failed run from node %d", peer);
+	}
+}
+
+// Reads the map of node 0 and hands it to all the other nodes, and starts
+// the run.
+static void sync_bucket_map(int *map, int fragments)
+{
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int size = _pargresql_GetNodesCount(); // FIXME: INIS naming
+	StringInfoData msg;
+	int i, b;
+
+	if (rank != 0)
+	{
+		char *frame = (char*)palloc(REBALANCE_FRAME);
+
+		msg_recv(0, REBALANCE_MAP, frame, &msg);
+		for (b = 0; b < PAR_BUCKETS; b++)
+		{
+			map[b] = pq_getmsgint(&msg, 4);
+		}
+		pfree(frame);
+		return;
+	}
+
+	rebalance_run = GetTopTransactionId();
+	if (par_read_bucket_map(map, fragments) > 0)
+	{
+		elog(DEBUG5, "rebalance: the map of the buckets is recorded");
+	}
+	initStringInfo(&msg);
+	msg_begin(&msg, REBALANCE_MAP, 0);
+	for (b = 0; b < PAR_BUCKETS; b++)
+	{
+		pq_sendint(&msg, map[b], 4);
+	}
+	for (i = 1; i < size; i++)
+	{
+		msg_send(i, &msg);
+	}
+	pfree(msg.data);
+}
+
+// Gives the buckets of the fragments that have too many to the ones that
+// have too few, at most 'max' of them, the lowest buckets first. Every
+// fragment ends up with PAR_BUCKETS / fragments buckets, give or take
+// one. Returns the number of the buckets still to move after that.
+static int plan_moves(int *map, int fragments, int max)
+{
+	int *count = (int*)palloc0(fragments * sizeof(int));
+	int *target = (int*)palloc(fragments * sizeof(int));
+	int surplus = 0, moved = 0;
+	int b, f, to = 0;
+
+	for (b = 0; b < PAR_BUCKETS; b++)
+	{
+		count[map[b]]++;
+	}
+	for (f = 0; f < fragments; f++)
+	{
+		target[f] = PAR_BUCKETS / fragments + (f < PAR_BUCKETS % fragments ? 1 : 0);
+		if (count[f] > target[f])
+		{
+			surplus += count[f] - target[f];
+		}
+	}
+
+	for (b = 0; b < PAR_BUCKETS && moved < max; b++)
+	{
+		f = map[b];
+		if (count[f] <= target[f])
+		{
+			continue;
+		}
+		while (count[to] >= target[to])
+		{
+			to++;
+		}
+		elog(DEBUG5, "rebalance: bucket %d goes from fragment %d to %d", b, f, to);
+		map[b] = to;
+		count[f]--;
+		count[to]++;
+		moved++;
+	}
+
+	pfree(count);
+	pfree(target);
+	return surplus - moved;
+}
+
+// Makes pg_par_bucket say the bucket belongs to the fragment.
+static void record_bucket(Relation rel, int bucket, int fragment)
+{
+	HeapTuple tuple;
+
+	tuple = SearchSysCacheCopy(PARBUCKET, Int32GetDatum(bucket), 0, 0, 0);
+	if (HeapTupleIsValid(tuple))
+	{
+		Form_pg_par_bucket form = (Form_pg_par_bucket)GETSTRUCT(tuple);
+
+		if (form->fragment == fragment)
+		{
+			heap_freetuple(tuple);
+			return;
+		}
+		form->fragment = fragment;
+		simple_heap_update(rel, &tuple->t_self, tuple);
+	}
+	else
+	{
+		Datum values[Natts_pg_par_bucket];
+		bool nulls[Natts_pg_par_bucket];
+
+		values[Anum_pg_par_bucket_bucket - 1] = Int32GetDatum(bucket);
+		values[Anum_pg_par_bucket_fragment - 1] = Int32GetDatum(fragment);
+		memset(nulls, false, sizeof(nulls));
+		tuple = heap_form_tuple(RelationGetDescr(rel), values, nulls);
+		simple_heap_insert(rel, tuple);
+	}
+	CatalogUpdateIndexes(rel, tuple);
+	heap_freetuple(tuple);
+}
+
+// Returns the quoted qualified name of the function.
+static char *function_name(Oid funcid)
+{
+	HeapTuple tuple;
+	Form_pg_proc proc;
+	char *result;
+
+	tuple = SearchSysCache(PROCOID, ObjectIdGetDatum(funcid), 0, 0, 0);
+	if (!HeapTupleIsValid(tuple))
+	{
+		elog(ERROR, "cache lookup failed for function %u", funcid);
+	}
+	proc = (Form_pg_proc)GETSTRUCT(tuple);
+	result = quote_qualified_identifier(get_namespace_name(proc->pronamespace), NameStr(proc->proname));
+	ReleaseSysCache(tuple);
+	return result;
+}
+
+// Lists the relations fragmented by hash, in the order of their names,
+// which is the same on every node.
+static List *hashed_relations(void)
+{
+	SPIPlanPtr plan;
+	List *result = NIL;
+	uint32 i;
+
+	plan = SPI_prepare(
+		"SELECT c.oid FROM pg_catalog.pg_class c"
+		" JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace"
+		" WHERE c.relkind = 'r' AND NOT c.relistemp AND c.reloptions IS NOT NULL"
+		" ORDER BY n.nspname, c.relname",
+		0, NULL);
+	if (plan == NULL || SPI_execute_plan(plan, NULL, NULL, true, 0) != SPI_OK_SELECT)
+	{
+		elog(ERROR, "could not list the hashed relations");
+	}
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		bool isnull;
+		Oid relid = DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull));
+		AttrNumber fragatno = get_relid_fragatno(relid);
+		RebalanceRel *r;
+		Relation rel;
+		TupleDesc desc;
+		StringInfoData buf;
+		int natts, j;
+
+		if (fragatno <= 0 || get_relid_fragscheme(relid) != NULL)
+		{
+			continue;
+		}
+
+		r = (RebalanceRel*)palloc(sizeof(RebalanceRel));
+		r->relid = relid;
+		r->name = quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), get_rel_name(relid));
+		r->fragatno = fragatno;
+		fmgr_info(get_type_hash_function(get_atttype(relid, fragatno)), &r->hashfn);
+		initStringInfo(&buf);
+		appendStringInfo(&buf, "pg_catalog.pargresql_hash_bucket(%s(%s))",
+			function_name(r->hashfn.fn_oid),
+			quote_identifier(get_relid_attribute_name(relid, fragatno)));
+		r->bucket = buf.data;
+		result = lappend(result, r);
+
+		// The dropped columns are not in 'SELECT *'
+		rel = relation_open(relid, AccessShareLock);
+		desc = RelationGetDescr(rel);
+		natts = 0;
+		for (j = 0; j < desc->natts; j++)
+		{
+			if (!desc->attrs[j]->attisdropped)
+			{
+				natts++;
+			}
+		}
+		r->desc = CreateTemplateTupleDesc(natts, false);
+		natts = 0;
+		for (j = 0; j < desc->natts; j++)
+		{
+			Form_pg_attribute att = desc->attrs[j];
+			if (!att->attisdropped)
+			{
+				TupleDescInitEntry(r->desc, ++natts, NameStr(att->attname),
+					att->atttypid, att->atttypmod, att->attndims);
+			}
+		}
+		relation_close(rel, AccessShareLock);
+	}
+	return result;
+}
+
+// Appends the bytes to the stream, sending the full messages.
+static void stream_put(RebalanceStream *s, const char *data, int len)
+{
+	while (len > 0)
+	{
+		int n = Min(len, REBALANCE_FRAME - s->buf.len);
+
+		appendBinaryStringInfo(&s->buf, data, n);
+		data += n;
+		len -= n;
+		if (s->buf.len == REBALANCE_FRAME)
+		{
+			stream_flush(s);
+		}
+	}
+}
+
+// Sends the message, however full it is.
+static void stream_flush(RebalanceStream *s)
+{
+	uint32 used = htonl((uint32)(s->buf.len - REBALANCE_HEADER));
+
+	memcpy(s->buf.data + REBALANCE_HEADER - sizeof(used), &used, sizeof(used));
+	msg_send(s->peer, &s->buf);
+	msg_begin(&s->buf, REBALANCE_ROWS, 0);
+}
+
+// Receives the messages until the stream has 'len' bytes not read yet.
+// Returns false if the bucket has ended before that.
+static bool stream_fill(RebalanceStream *s, int len)
+{
+	while (s->buf.len - s->buf.cursor < len)
+	{
+		StringInfoData msg;
+		int used;
+
+		// Forget the bytes read already
+		if (s->buf.cursor > 0)
+		{
+			memmove(s->buf.data, s->buf.data + s->buf.cursor, s->buf.len - s->buf.cursor);
+			s->buf.len -= s->buf.cursor;
+			s->buf.cursor = 0;
+		}
+
+		used = msg_recv(s->peer, REBALANCE_ROWS, s->frame, &msg);
+		if (used == 0)
+		{
+			return false;
+		}
+		appendBinaryStringInfo(&s->buf, pq_getmsgbytes(&msg, used), used);
+	}
+	return true;
+}
+
+// Tells the old leader how many rows of the bucket have been inserted,
+// or -1 if they could not be.
+static void send_ack(int peer, int32 rows)
+{
+	StringInfoData msg;
+
+	initStringInfo(&msg);
+	msg_begin(&msg, REBALANCE_ACK, rows);
+	msg_send(peer, &msg);
+	pfree(msg.data);
+}
+
+// Waits for the new leader to say how many rows it has inserted.
+static int32 recv_ack(int peer)
+{
+	char *frame = (char*)palloc(REBALANCE_FRAME);
+	StringInfoData msg;
+	int32 rows;
+
+	rows = msg_recv(peer, REBALANCE_ACK, frame, &msg);
+	pfree(frame);
+	return rows;
+}
+
+// Sends the rows of the bucket to the leader 'dst', and deletes them once
+// it has inserted them all.
+static void send_bucket(RebalanceRel *r, int bucket, int dst)
+{
+	StringInfoData query, tuple;
+	RebalanceStream s;
+	ParTupleLayout *layout;
+	TupleTableSlot *slot;
+	SPIPlanPtr plan;
+	Portal portal;
+	Oid argtypes[1] = {INT4OID};
+	Datum args[1];
+	uint32 i, rows = 0, deleted;
+	int32 ack;
+
+	args[0] = Int32GetDatum(bucket);
+	layout = par_tuplayout(r->desc);
+	slot = MakeSingleTupleTableSlot(r->desc);
+	initStringInfo(&tuple);
+	s.peer = dst;
+	initStringInfo(&s.buf);
+	msg_begin(&s.buf, REBALANCE_ROWS, 0);
+
+	initStringInfo(&query);
+	appendStringInfo(&query, "SELECT * FROM ONLY %s WHERE %s = $1", r->name, r->bucket);
+	plan = SPI_prepare(query.data, 1, argtypes);
+	if (plan == NULL)
+	{
+		elog(ERROR, "SPI_prepare(\"%s\") failed", query.data);
+	}
+	portal = SPI_cursor_open(NULL, plan, args, NULL, true);
+	while (1)
+	{
+		SPI_cursor_fetch(portal, true, REBALANCE_FETCH);
+		if (SPI_processed == 0)
+		{
+			break;
+		}
+		for (i = 0; i < SPI_processed; i++)
+		{
+			uint32 len;
+
+			ExecStoreTuple(SPI_tuptable->vals[i], slot, InvalidBuffer, false);
+			par_tupack(layout, slot, &tuple);
+			len = htonl((uint32)tuple.len);
+			stream_put(&s, (char*)&len, sizeof(len));
+			stream_put(&s, tuple.data, tuple.len);
+			ExecClearTuple(slot);
+		}
+		rows += SPI_processed;
+		SPI_freetuptable(SPI_tuptable);
+	}
+	SPI_cursor_close(portal);
+
+	// The rest, and the end of the bucket
+	if (s.buf.len > REBALANCE_HEADER)
+	{
+		stream_flush(&s);
+	}
+	stream_flush(&s);
+	elog(DEBUG5, "rebalance: sent %u rows of %s in bucket %d to %d", rows, r->name, bucket, dst);
+
+	ack = recv_ack(dst);
+	if (ack < 0)
+	{
+		ereport(ERROR,
+			(errmsg("node %d could not insert the rows of %s in bucket %d", dst, r->name, bucket),
+			 errdetail("The rows stay where they are.")));
+	}
+	if ((uint32)ack != rows)
+	{
+		elog(ERROR, "%u rows of %s in bucket %d have been sent, but %d inserted",
+			rows, r->name, bucket, ack);
+	}
+
+	deleted = delete_bucket(r, bucket);
+	if (deleted != rows)
+	{
+		elog(ERROR, "%u rows of %s in bucket %d have been sent, but %u deleted",
+			rows, r->name, bucket, deleted);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	par_free_tuplayout(layout);
+	pfree(s.buf.data);
+	pfree(tuple.data);
+	pfree(query.data);
+}
+
+// Deletes the rows of the bucket, which have moved, so no trigger nor rule
+// sees them go. Returns their number.
+static uint32 delete_bucket(RebalanceRel *r, int bucket)
+{
+	Relation rel = heap_open(r->relid, NoLock); // locked by the caller
+	TupleDesc desc = RelationGetDescr(rel);
+	HeapScanDesc scan;
+	HeapTuple tuple;
+	uint32 rows = 0;
+
+	scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		bool isnull;
+		Datum value = heap_getattr(tuple, r->fragatno, desc, &isnull);
+
+		// A NULL is in no bucket, as in 'SELECT'
+		if (isnull || par_hash_bucket(DatumGetUInt32(FunctionCall1(&r->hashfn, value))) != bucket)
+		{
+			continue;
+		}
+		simple_heap_delete(rel, &tuple->t_self);
+		rows++;
+	}
+	heap_endscan(scan);
+	heap_close(rel, NoLock);
+	CommandCounterIncrement();
+	return rows;
+}
+
+// Inserts the rows the leader 'src' sends, the way COPY does but without
+// the triggers, and with NULL in the dropped columns. Returns their number.
+static uint32 recv_bucket(RebalanceRel *r, int src)
+{
+	Relation rel = heap_open(r->relid, NoLock); // locked by the caller
+	TupleDesc desc = RelationGetDescr(rel);
+	EState *estate = CreateExecutorState();
+	ResultRelInfo *resultRelInfo;
+	CommandId mycid = GetCurrentCommandId(true);
+	BulkInsertState bistate = GetBulkInsertState();
+	RebalanceStream s;
+	ParTupleLayout *layout;
+	TupleTableSlot *slot, *relslot;
+	Datum *values;
+	bool *nulls;
+	uint32 rows = 0;
+
+	resultRelInfo = makeNode(ResultRelInfo);
+	resultRelInfo->ri_RangeTableIndex = 1; // dummy
+	resultRelInfo->ri_RelationDesc = rel;
+	ExecOpenIndices(resultRelInfo);
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+
+	layout = par_tuplayout(r->desc);
+	slot = MakeSingleTupleTableSlot(r->desc);
+	relslot = MakeSingleTupleTableSlot(desc);
+	values = (Datum*)palloc(desc->natts * sizeof(Datum));
+	nulls = (bool*)palloc(desc->natts * sizeof(bool));
+	s.peer = src;
+	initStringInfo(&s.buf);
+	s.frame = (char*)palloc(REBALANCE_FRAME);
+
+	while (stream_fill(&s, sizeof(uint32)))
+	{
+		int len = pq_getmsgint(&s.buf, sizeof(uint32));
+		MemoryContext oldcontext;
+		HeapTuple tuple;
+		int i, j;
+
+		if (!stream_fill(&s, len))
+		{
+			elog(ERROR, "the rows of %s from node %d end in the middle of a row", r->name, src);
+		}
+		oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+		par_tunpack(layout, pq_getmsgbytes(&s.buf, len), len, slot);
+		slot_getallattrs(slot);
+		for (i = 0, j = 0; i < desc->natts; i++)
+		{
+			if (desc->attrs[i]->attisdropped)
+			{
+				values[i] = (Datum)0;
+				nulls[i] = true;
+			}
+			else
+			{
+				values[i] = slot->tts_values[j];
+				nulls[i] = slot->tts_isnull[j];
+				j++;
+			}
+		}
+		tuple = heap_form_tuple(desc, values, nulls);
+		MemoryContextSwitchTo(oldcontext);
+
+		ExecStoreTuple(tuple, relslot, InvalidBuffer, false);
+		if (desc->constr)
+		{
+			ExecConstraints(resultRelInfo, relslot, estate);
+		}
+		heap_insert(rel, tuple, mycid, 0, bistate);
+		if (resultRelInfo->ri_NumIndices > 0)
+		{
+			ExecInsertIndexTuples(relslot, &(tuple->t_self), estate, false);
+		}
+		ExecClearTuple(relslot);
+		ExecClearTuple(slot);
+		ResetPerTupleExprContext(estate);
+		rows++;
+	}
+	elog(DEBUG5, "rebalance: received %u rows of %s from %d", rows, r->name, src);
+
+	FreeBulkInsertState(bistate);
+	ExecCloseIndices(resultRelInfo);
+	ExecDropSingleTupleTableSlot(relslot);
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+	heap_close(rel, NoLock);
+	CommandCounterIncrement();
+
+	par_free_tuplayout(layout);
+	pfree(s.buf.data);
+	pfree(s.frame);
+	pfree(values);
+	pfree(nulls);
+	return rows;
+}
+
+// Called before the commit of a transaction: the buckets it has moved must
+// be committed through PREPARE TRANSACTION, once every node has prepared.
+void par_rebalance_pre_commit(void)
+{
+	if (TransactionIdIsValid(rebalance_xid) && TransactionIdEquals(rebalance_xid, GetTopTransactionIdIfAny()))
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_TRANSACTION_TERMINATION),
+			 errmsg("a transaction that has moved buckets cannot be committed by COMMIT"),
+			 errhint("Use PREPARE TRANSACTION on every node, and then COMMIT PREPARED.")));
+	}
+}
+
+Datum pargresql_rebalance(PG_FUNCTION_ARGS)
+{
+	int from = PG_GETARG_INT32(0);
+	int max = PG_GETARG_INT32(1);
+	int rank = _pargresql_GetNode(); // FIXME: INIS naming
+	int fragments = par_fragments_count();
+	bool leader = (rank == par_fragment_leader(par_my_fragment()));
+	int map[PAR_BUCKETS], newmap[PAR_BUCKETS];
+	int left, b;
+
+	if (!superuser())
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+			 errmsg("must be superuser to move the buckets")));
+	}
+	if (from < 0 || max < 0)
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("the number of the fragments and of the buckets cannot be negative")));
+	}
+	if (!IsTransactionBlock())
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_NO_ACTIVE_SQL_TRANSACTION),
+			 errmsg("pargresql_rebalance can only be used in transaction blocks"),
+			 errhint("The transaction has to be prepared on every node before it commits; par_PQrebalance does so.")));
+	}
+
+	sync_bucket_map(map, (from > 0) ? from : fragments);
+	for (b = 0; b < PAR_BUCKETS; b++)
+	{
+		if (map[b] >= fragments)
+		{
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("bucket %d belongs to fragment %d, but there are only %d fragments",
+					b, map[b], fragments),
+				 errhint("Removing the nodes from a cluster is not supported.")));
+		}
+	}
+	memcpy(newmap, map, sizeof(map));
+	left = plan_moves(newmap, fragments, max);
+
+	if (leader)
+	{
+		Relation rel;
+		List *rels;
+		ListCell *lc;
+
+		// From now on, only COMMIT PREPARED keeps what this transaction does
+		rebalance_xid = GetTopTransactionId();
+
+		if (SPI_connect() != SPI_OK_CONNECT)
+		{
+			elog(ERROR, "SPI_connect failed");
+		}
+		rels = hashed_relations();
+
+		// The rows of the buckets must not change while they move
+		foreach(lc, rels)
+		{
+			LockRelationOid(((RebalanceRel*)lfirst(lc))->relid, ExclusiveLock);
+		}
+
+		for (b = 0; b < PAR_BUCKETS; b++)
+		{
+			int src, dst;
+
+			if (newmap[b] == map[b])
+			{
+				continue;
+			}
+			src = par_fragment_leader(map[b]);
+			dst = par_fragment_leader(newmap[b]);
+			foreach(lc, rels)
+			{
+				if (rank == src)
+				{
+					send_bucket((RebalanceRel*)lfirst(lc), b, dst);
+				}
+				else if (rank == dst)
+				{
+					uint32 rows = 0;
+
+					// The old leader keeps the rows unless they all are here
+					PG_TRY();
+					{
+						rows = recv_bucket((RebalanceRel*)lfirst(lc), src);
+					}
+					PG_CATCH();
+					{
+						send_ack(src, -1);
+						PG_RE_THROW();
+					}
+					PG_END_TRY();
+					send_ack(src, (int32)rows);
+				}
+			}
+		}
+		SPI_finish();
+
+		// Every bucket, so that the map is recorded on every node
+		rel = heap_open(ParBucketRelationId, RowExclusiveLock);
+		for (b = 0; b < PAR_BUCKETS; b++)
+		{
+			record_bucket(rel, b, newmap[b]);
+		}
+		heap_close(rel, RowExclusiveLock);
+		CommandCounterIncrement();
+	}
+
+	PG_RETURN_INT32(left);
+}
@@ -18,6 +18,7 @@
 #include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/nbtree.h"
+#include "access/par_coopscan.h"
 #include "access/subtrans.h"
 #include "access/twophase.h"
 #include "miscadmin.h"
@@ -116,6 +117,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, AutoVacuumShmemSize());
 		size = add_size(size, BTreeShmemSize());
 		size = add_size(size, SyncScanShmemSize());
+		size = add_size(size, ParCoopScanShmemSize());
 #ifdef EXEC_BACKEND
 		size = add_size(size, ShmemBackendArraySize());
 #endif
@@ -216,6 +218,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	 */
 	BTreeShmemInit();
 	SyncScanShmemInit();
+	ParCoopScanShmemInit();
 
 #ifdef EXEC_BACKEND
 
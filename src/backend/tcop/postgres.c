@@ -39,6 +39,7 @@
 #include "rusagestub.h"
 #endif
 
+#include "access/par_coopscan.h"
 #include "access/printtup.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
@@ -70,6 +71,7 @@
 #include "utils/ps_status.h"
 #include "utils/snapmgr.h"
 #include "mb/pg_wchar.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
 
 
 extern int	optind;
@@ -99,6 +101,9 @@ int			PostAuthDelay = 0;
 /* defined in planner.c */
 extern bool		enable_pargresql;
 
+/* GUC parameter: the shared memory object of the rank of this session */
+char	   *pargresql_shmem = NULL;
+
 /* ----------------
  *		private variables
  * ----------------
@@ -792,6 +797,9 @@ exec_simple_query(const char *query_string)
 
 	TRACE_POSTGRESQL_QUERY_START(query_string);
 
+	/* PargreSQL: the ranks of a fragment count the commands alike */
+	par_coopscan_new_command();
+
 	/*
 	 * We use save_log_statement_stats so ShowUsage doesn't report incorrect
 	 * results because ResetUsage wasn't called.
@@ -1395,6 +1403,9 @@ exec_bind_message(StringInfo input_message)
 	portal_name = pq_getmsgstring(input_message);
 	stmt_name = pq_getmsgstring(input_message);
 
+	/* PargreSQL: the ranks of a fragment count the commands alike */
+	par_coopscan_new_command();
+
 	ereport(DEBUG2,
 			(errmsg("bind %s to %s",
 					*portal_name ? portal_name : "<unnamed>",
@@ -3337,10 +3348,6 @@ PostgresMain(int argc, char *argv[], const char *username)
 
 	SetProcessingMode(NormalProcessing);
 
-	if (enable_pargresql) {
-		_pargresql_InitLib();
-	}
-
 	/*
 	 * Now that we know if client is a superuser, we can try to apply SUSET
 	 * GUC options that came from the client.
@@ -3366,6 +3373,19 @@ PostgresMain(int argc, char *argv[], const char *username)
 		}
 	}
 
+	/*
+	 * PargreSQL: a superuser client may choose the rank of the session, so
+	 * the library is opened after the client options have been applied.
+	 */
+	if (enable_pargresql) {
+		if (!_pargresql_InitLib(pargresql_shmem))
+			ereport(FATAL,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("could not open shared memory of PargreSQL rank \"%s\": %m",
+							pargresql_shmem),
+					 errhint("An empty pargresql_shmem means the PARGRESQL_SHMEM environment variable of the server.")));
+	}
+
 	/*
 	 * Now all GUC states are fully set up.  Report them to client if
 	 * appropriate.
@@ -3812,7 +3832,7 @@ PostgresMain(int argc, char *argv[], const char *username)
 			case 'X':
 			case EOF:
 				// FIXME: see the NOTE below!
-				if (enable_pargresql) {
+				if (_pargresql_IsOpen()) {
 					_pargresql_FinalizeLib();
 				}
 
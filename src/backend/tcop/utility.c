@@ -16,6 +16,7 @@
  */
 #include "postgres.h"
 
+#include "access/par_coopscan.h"
 #include "access/reloptions.h"
 #include "access/twophase.h"
 #include "access/xact.h"
@@ -56,6 +57,11 @@
 #include "utils/acl.h"
 #include "utils/guc.h"
 #include "utils/syscache.h"
+#include "par_inis/_pargresql_library.h" // FIXME: INIS naming
+#include "par_parallelizer/par_fragment.h"
+
+/* defined in planner.c */
+extern bool		enable_pargresql;
 
 
 /*
@@ -135,23 +141,16 @@ CommandIsReadOnly(Node *parsetree)
 }
 
 /*
- * check_xact_readonly: is a utility command read-only?
+ * utility_writes_database: does a utility command have permanent effects
+ * on the database?
  *
- * Here we use the loose rules of XactReadOnly mode: no permanent effects
- * on the database are allowed.
+ * Note: Commands that need to do more complicated checking are handled
+ * elsewhere, in particular COPY and plannable statements do their own
+ * checking.
  */
-static void
-check_xact_readonly(Node *parsetree)
+static bool
+utility_writes_database(Node *parsetree)
 {
-	if (!XactReadOnly)
-		return;
-
-	/*
-	 * Note: Commands that need to do more complicated checking are handled
-	 * elsewhere, in particular COPY and plannable statements do their own
-	 * checking.
-	 */
-
 	switch (nodeTag(parsetree))
 	{
 		case T_AlterDatabaseStmt:
@@ -213,16 +212,44 @@ check_xact_readonly(Node *parsetree)
 		case T_CreateUserMappingStmt:
 		case T_AlterUserMappingStmt:
 		case T_DropUserMappingStmt:
-			ereport(ERROR,
-					(errcode(ERRCODE_READ_ONLY_SQL_TRANSACTION),
-					 errmsg("transaction is read-only")));
-			break;
+			return true;
 		default:
-			/* do nothing */
-			break;
+			return false;
 	}
 }
 
+/*
+ * check_xact_readonly: is a utility command read-only?
+ *
+ * Here we use the loose rules of XactReadOnly mode: no permanent effects
+ * on the database are allowed.
+ */
+static void
+check_xact_readonly(Node *parsetree)
+{
+	if (XactReadOnly && utility_writes_database(parsetree))
+		ereport(ERROR,
+				(errcode(ERRCODE_READ_ONLY_SQL_TRANSACTION),
+				 errmsg("transaction is read-only")));
+}
+
+/*
+ * par_utility_is_leaders: is a utility command left to the leader of the
+ * fragment of this rank?
+ *
+ * PargreSQL: the ranks of a fragment share its database (see
+ * par_coopscan.h), so only the leader changes it, as only the leader
+ * inserts the rows of the fragment. The others see the change once the
+ * leader has committed it.
+ */
+static bool
+par_utility_is_leaders(Node *parsetree)
+{
+	return enable_pargresql && par_scan_workers > 1 && _pargresql_IsOpen()
+		&& _pargresql_GetNode() != par_fragment_leader(par_my_fragment()) // FIXME: INIS naming
+		&& utility_writes_database(parsetree);
+}
+
 
 /*
  * CheckRestrictedOperation: throw error for hazardous command if we're
@@ -278,6 +305,9 @@ ProcessUtility(Node *parsetree,
 	if (completionTag)
 		completionTag[0] = '\0';
 
+	if (par_utility_is_leaders(parsetree))
+		return;
+
 	switch (nodeTag(parsetree))
 	{
 			/*
@@ -39,6 +39,7 @@
 #include "catalog/pg_opclass.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_opfamily.h"
+#include "catalog/pg_par_bucket.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_rewrite.h"
 #include "catalog/pg_statistic.h"
@@ -524,6 +525,18 @@ static const struct cachedesc cacheinfo[] = {
 		},
 		64
 	},
+	{ParBucketRelationId,		/* PARBUCKET */
+		ParBucketIndexId,
+		0,
+		1,
+		{
+			Anum_pg_par_bucket_bucket,
+			0,
+			0,
+			0
+		},
+		1024
+	},
 	{ProcedureRelationId,		/* PROCNAMEARGSNSP */
 		ProcedureNameArgsNspIndexId,
 		0,
@@ -342,6 +342,16 @@ extern const struct config_enum_entry sync_method_options[];
  */
 extern bool enable_pargresql;
 
+/*
+ * PargreSQL: the shared memory object of the rank a session works as
+ * (defined in postgres.c), the number of the ranks that share one
+ * fragment (defined in par_coopscan.c), and whether the hash joins
+ * filter their outer exchanges (defined in par_bloom.c).
+ */
+extern char *pargresql_shmem;
+extern int	par_scan_workers;
+extern bool par_join_filters;
+
 /*
  * GUC option variables that are exported from this module
  */
@@ -598,6 +608,15 @@ static struct config_bool ConfigureNamesBool[] =
 		&enable_pargresql,
 		false, NULL, NULL
 	},
+	{
+		{"pargresql_join_filters", PGC_USERSET, UNGROUPED,
+			gettext_noop("Enables the bloom filters of the parallel hash joins."),
+			gettext_noop("The tuples of the outer side of a hash join are not "
+						 "sent to the nodes that have nothing to join them with.")
+		},
+		&par_join_filters,
+		true, NULL, NULL
+	},
 	{
 		{"enable_seqscan", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of sequential-scan plans."),
@@ -1245,6 +1264,15 @@ static struct config_bool ConfigureNamesBool[] =
 
 static struct config_int ConfigureNamesInt[] =
 {
+	{
+		{"pargresql_scan_workers", PGC_POSTMASTER, UNGROUPED,
+			gettext_noop("Sets the number of consecutive ranks that share one fragment."),
+			gettext_noop("The ranks of a fragment work in the same database "
+						 "and share its sequential scans.")
+		},
+		&par_scan_workers,
+		1, 1, 64, NULL, NULL
+	},
 	{
 		{"archive_timeout", PGC_SIGHUP, WAL_SETTINGS,
 			gettext_noop("Forces a switch to the next xlog file if a "
@@ -2031,6 +2059,24 @@ static struct config_real ConfigureNamesReal[] =
 		&cpu_operator_cost,
 		DEFAULT_CPU_OPERATOR_COST, 0, DBL_MAX, NULL, NULL
 	},
+	{
+		{"pargresql_network_tuple_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the planner's estimate of the cost of "
+						 "sending a tuple to another PargreSQL node."),
+			NULL
+		},
+		&pargresql_network_tuple_cost,
+		DEFAULT_PARGRESQL_NETWORK_TUPLE_COST, 0, DBL_MAX, NULL, NULL
+	},
+	{
+		{"pargresql_network_byte_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the planner's estimate of the cost of "
+						 "sending a byte of a tuple to another PargreSQL node."),
+			NULL
+		},
+		&pargresql_network_byte_cost,
+		DEFAULT_PARGRESQL_NETWORK_BYTE_COST, 0, DBL_MAX, NULL, NULL
+	},
 
 	{
 		{"cursor_tuple_fraction", PGC_USERSET, QUERY_TUNING_OTHER,
@@ -2106,6 +2152,16 @@ static struct config_real ConfigureNamesReal[] =
 
 static struct config_string ConfigureNamesString[] =
 {
+	{
+		{"pargresql_shmem", PGC_SUSET, UNGROUPED,
+			gettext_noop("Sets the shared memory object of the rank the session works as."),
+			gettext_noop("An empty string means the PARGRESQL_SHMEM environment "
+						 "variable of the server.")
+		},
+		&pargresql_shmem,
+		"", NULL, NULL
+	},
+
 	{
 		{"archive_command", PGC_SIGHUP, WAL_SETTINGS,
 			gettext_noop("Sets the shell command that will be called to archive a WAL file."),
@@ -7,18 +7,34 @@
 #include <mpi.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "par_inis/_pargresql_memory_manager.h"
+#include "par_inis/_pargresql_ring.h"
 
 static int node, nodescount;
+static int ringowner;	/* true if this node has created the rings of the host */
+static char ringname[256];	/* name of the rings of the host, empty if none */
+static sem_t *doorbell;	/* rung whenever a block has been processed */
 
 /*
  * This function processes the shared memory blocks.
  */
 void Start();
 
+/*
+ * This function finds out which nodes run on the same host and,
+ * if there are several, sets up the shared memory rings for them.
+ * 'shmtemplate' contains the name of the shared memory objects
+ * of the nodes, see SHMEMNAME_ENV. RINGS_ENV set to "off" turns
+ * the rings off, so that the nodes of a host talk through MPI too.
+ */
+void SetupRings(const char *shmtemplate);
+
 int main(int argc, char *argv[])
 {
 	int res;
+	char shmname[256];
+	const char *shmenv;
 	
 	res = MPI_Init(&argc, &argv);
 	assert(res == MPI_SUCCESS);
@@ -29,17 +45,83 @@ int main(int argc, char *argv[])
 	res = MPI_Comm_size(MPI_COMM_WORLD, &nodescount);
 	assert(res == MPI_SUCCESS);
 
-	CreateSHMObject(SHMEMNAME, node, nodescount);
+	shmenv = getenv(SHMEMNAME_ENV);
+	snprintf(shmname, sizeof(shmname), shmenv != NULL ? shmenv : SHMEMNAME, node);
+	SetupRings(shmenv != NULL ? shmenv : SHMEMNAME);
+	CreateSHMObject(shmname, node, nodescount, ringname);
+
+	/* The library waits on the doorbell of the rings if there are any */
+	doorbell = GetRingDoorbell(node);
+	if (doorbell == NULL)
+		doorbell = GetDoorbell();
 
 	printf(" node %d/%d started!", node, nodescount);
 	Start();
-	RemoveSHMObject(SHMEMNAME);
+	RemoveSHMObject(shmname);
+	if (ringowner)
+		RemoveRingObject(ringname);
 	printf(" node %d/%d finished!", node, nodescount);
 
 	MPI_Finalize();
 	return 0;
 }
 
+void SetupRings(const char *shmtemplate)
+{
+	char host[MPI_MAX_PROCESSOR_NAME];
+	char firstname[256];
+	char *hosts;
+	const char *ringsenv = getenv(RINGS_ENV);
+	int slots[RING_MAX_NODES];
+	int i, len, res, localcount = 0, first = -1;
+	int rings;
+
+	memset(host, 0, sizeof(host));
+	res = MPI_Get_processor_name(host, &len);
+	assert(res == MPI_SUCCESS);
+
+	hosts = malloc(nodescount * MPI_MAX_PROCESSOR_NAME);
+	assert(hosts != NULL);
+	res = MPI_Allgather(host, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, hosts, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, MPI_COMM_WORLD);
+	assert(res == MPI_SUCCESS);
+
+	for (i = 0; i < nodescount && i < RING_MAX_NODES; i++) {
+		if (strcmp(hosts + i * MPI_MAX_PROCESSOR_NAME, host) == 0 && localcount < RING_MAX_LOCAL) {
+			if (first < 0)
+				first = i;
+			slots[i] = localcount++;
+		} else
+			slots[i] = -1;
+	}
+	free(hosts);
+
+	/*
+	 * The rings are named after the shared memory object of the first
+	 * node of the host, so the clusters sharing a host do not meet.
+	 */
+	snprintf(firstname, sizeof(firstname), shmtemplate, first);
+	snprintf(ringname, sizeof(ringname), "%s%s", firstname, RINGSHMEMSUFFIX);
+
+	/* The first node of the host creates the rings for all of them */
+	rings = (localcount > 1 && nodescount <= RING_MAX_NODES &&
+			 (ringsenv == NULL || strcmp(ringsenv, "off") != 0));
+	ringowner = (first == node && rings);
+	if (ringowner)
+		CreateRingObject(ringname, nodescount, slots);
+
+	else if (first == node)
+		shm_unlink(ringname);	/* left by a previous run, if any */
+
+	res = MPI_Barrier(MPI_COMM_WORLD);
+	assert(res == MPI_SUCCESS);
+
+	if (rings) {
+		if (!ringowner)
+			OpenRingObject(ringname);
+	} else
+		ringname[0] = '\0';	/* tells the library there are no rings */
+}
+
 void Start()
 {
 	shmblock_t *block;
@@ -71,6 +153,7 @@ void Start()
 
 			res = sem_post(&block->state);
 			assert(res == 0);
+			RingDoorbell(doorbell);
 			continue;
 		} else if (block->msgType == TO_CLOSE) {
 			printf(" nnode %d TO_CLOSE", node);
@@ -96,6 +179,7 @@ void Start()
 //					printf(" n%db%d", node, blockNumber);fflush(stdout);
 					res = sem_post(&block->state);
 					assert(res == 0);
+					RingDoorbell(doorbell);
 				} else {
 					//printf("\t#Узел %d сообщение блока %d еще не обработано\n", node, blockNumber);fflush(stdout);
 					SetCurrentBlockNumber(blockNumber);
@@ -6,22 +6,67 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include "par_inis/_pargresql_memory_manager.h"
 #include "par_inis/_pargresql_library.h"
+#include "par_inis/_pargresql_ring.h"
 
 static int node;	/* current node id */
 static int nodescount;	/* total number of nodes */
+static sem_t *doorbell;	/* rung when a message of the node may have moved */
+static int opened;	/* 1 between _pargresql_InitLib and _pargresql_FinalizeLib */
 
 
 /*
  * This function opens the access to the shared memory.
  * No other functions of the library should be called
  * before this one.
+ * 'name' contains the name of the shared memory object of the node,
+ * if it is NULL or empty, the one from SHMEMNAME_ENV is used.
+ * Returns 1 on success, or 0 if the object could not be opened,
+ * errno telling why.
  */
-extern void _pargresql_InitLib()
+extern int _pargresql_InitLib(const char *name)
 {
-	OpenSHMObject(SHMEMNAME, &node, &nodescount);
+	if (name == NULL || name[0] == '\0')
+		name = getenv(SHMEMNAME_ENV);
+
+	if (!OpenSHMObject(name != NULL ? name : SHMEMNAME, &node, &nodescount))
+		return 0;
+
+	/* The rings exist only if several nodes share the host */
+	if (GetRingName()[0] != '\0')
+		OpenRingObject(GetRingName());
+
+	/* Both the communicator and the local nodes ring the doorbell of the rings */
+	doorbell = GetRingDoorbell(node);
+	if (doorbell == NULL)
+		doorbell = GetDoorbell();
+	opened = 1;
+	return 1;
+}
+
+/*
+ * This function returns 1 if the access to the shared memory is open,
+ * i.e. _pargresql_InitLib has been called and _pargresql_FinalizeLib
+ * has not, or 0 otherwise.
+ */
+extern int _pargresql_IsOpen(void)
+{
+	return opened;
+}
+
+/*
+ * This function waits until a message of the current node may have
+ * moved (a request has been completed, a message has arrived into a
+ * ring or a ring has got free space), but no longer than 'msec'
+ * milliseconds. It is meant to be called when all the requests and
+ * rings the caller is interested in have been tested without success.
+ */
+extern void _pargresql_Wait(int msec)
+{
+	WaitDoorbell(doorbell, msec);
 }
 
 /*
@@ -154,6 +199,59 @@ extern void _pargresql_Test(_pargresql_request_t *request, int *flag)
 	}
 }
 
+/*
+ * This function returns 1 if the messages between the current node
+ * and 'other' sent to 'port' go through a shared memory ring (i.e. the
+ * nodes run on the same host), or 0 if they go through MPI.
+ */
+extern int _pargresql_IsLocal(int other, uuid_t port)
+{
+	return GetRing(node, other, port) != NULL;
+}
+
+/*
+ * This function copies a message directly into the ring of the
+ * destination node, bypassing the communicator. If there was no
+ * room in the ring, 'flag' is set to 0 and the message should be
+ * sent again later. The message is sent if 'flag' is 1.
+ * 'dst' must be a local node (see _pargresql_IsLocal).
+ */
+extern void _pargresql_RingSend(int dst, uuid_t port, int size, void *buf, int *flag)
+{
+	ring_t *ring = GetRing(node, dst, port);
+
+	assert(ring != NULL);
+	*flag = RingWrite(ring, buf, size);
+	if (*flag)
+		RingDoorbell(GetRingDoorbell(dst));
+}
+
+/*
+ * This function returns the next message from the ring of the source
+ * node in place, without copying it. If there was no message, 'flag'
+ * is set to 0. The message stays valid until _pargresql_RingDone.
+ * 'src' must be a local node (see _pargresql_IsLocal).
+ */
+extern void _pargresql_RingRecv(int src, uuid_t port, void **buf, int *size, int *flag)
+{
+	ring_t *ring = GetRing(src, node, port);
+
+	assert(ring != NULL);
+	*flag = RingPeek(ring, buf, size);
+}
+
+/*
+ * This function frees the message returned by _pargresql_RingRecv.
+ */
+extern void _pargresql_RingDone(int src, uuid_t port)
+{
+	ring_t *ring = GetRing(src, node, port);
+
+	assert(ring != NULL);
+	RingRelease(ring);
+	RingDoorbell(GetRingDoorbell(src));
+}
+
 /*
  * This function returns the current node id.
  */
@@ -185,4 +283,5 @@ extern void _pargresql_FinalizeLib(void)
 	block = GetBlock(blockNumber);
 	block->msgType = TO_CLOSE;
 	SetUnprocBlockNumber(blockNumber);
+	opened = 0;
 }
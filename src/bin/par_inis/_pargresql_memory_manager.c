@@ -5,7 +5,9 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <time.h>
 #include "par_inis/_pargresql_memory_manager.h"
 
 typedef struct stack {
@@ -23,6 +25,9 @@ typedef struct {
 	sem_t semaphore;
 	int node;
 	int nodescount;
+	char ringname[256];	/* see GetRingName */
+
+	sem_t doorbell;	/* rung when a block of the node has been processed */
 	
 	sem_t nempty;
 	sem_t emptySem;
@@ -79,8 +84,10 @@ static queue_t curblocks;
  * 'name' contains the name of the shared memory object.
  * 'node' contains the current node id.
  * 'nodescount' contains the total number of nodes.
+ * 'ringname' contains the name of the ring object of the host,
+ * or an empty string if the node does not use the rings.
  */
-extern void CreateSHMObject(const char *shmName, int node, int nodescount)
+extern void CreateSHMObject(const char *shmName, int node, int nodescount, const char *ringname)
 {
 	int fd, res, i;
 
@@ -102,9 +109,13 @@ extern void CreateSHMObject(const char *shmName, int node, int nodescount)
 	assert(res == 0);
 	res = sem_init(&memptr->emptySem, 1, 1);
 	assert(res == 0);
+	res = sem_init(&memptr->doorbell, 1, 0);
+	assert(res == 0);
 
 	memptr->node = node;
 	memptr->nodescount = nodescount;
+	strncpy(memptr->ringname, ringname, sizeof(memptr->ringname) - 1);
+	memptr->ringname[sizeof(memptr->ringname) - 1] = '\0';
 	init_stack(memptr->emptyblocks);
 	init_queue(memptr->unprocblocks);
 
@@ -124,15 +135,29 @@ extern void CreateSHMObject(const char *shmName, int node, int nodescount)
  * 'name' contains the shared memory object name.
  * 'node' will contain the current node id upon return.
  * 'nodescount' will contin the total number of nodes upon return.
+ * Returns 1 on success, or 0 if there is no such object (or it is not
+ * one of a node), errno telling why.
  */
-extern void OpenSHMObject(const char *shmName, int *node, int *nodescount)
+extern int OpenSHMObject(const char *shmName, int *node, int *nodescount)
 {
 	int fd, res;
+	struct stat st;
+	void *ptr;
 
 	fd = shm_open(shmName, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	assert(fd > -1);
-	memptr = mmap(NULL, sizeof(shmem_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fd < 0)
+		return 0;
+	/* An object of somebody else would be mapped beyond its end */
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(shmem_t)) {
+		close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+	ptr = mmap(NULL, sizeof(shmem_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	close(fd);
+	if (ptr == MAP_FAILED)
+		return 0;
+	memptr = ptr;
 
 	res = sem_wait(&memptr->semaphore);
 	assert(res == 0);
@@ -141,6 +166,16 @@ extern void OpenSHMObject(const char *shmName, int *node, int *nodescount)
 	res = sem_post(&memptr->semaphore);
 	assert(res == 0);
 	init_queue(curblocks);
+	return 1;
+}
+
+/*
+ * This function returns the name of the ring object of the host, or
+ * an empty string if there is none.
+ */
+extern const char *GetRingName(void)
+{
+	return memptr->ringname;
 }
 
 /*
@@ -155,6 +190,54 @@ extern void RemoveSHMObject(const char *name)
 	assert(res == 0);
 }
 
+/*
+ * This function returns the doorbell of the node, the semaphore that
+ * the communicator rings whenever a block of the node has been processed.
+ */
+extern sem_t *GetDoorbell(void)
+{
+	return &memptr->doorbell;
+}
+
+/*
+ * This function wakes up the process waiting on the doorbell. The rings
+ * are not counted: a doorbell is either rung or not, so that a process
+ * busy with the messages does not have to drain it.
+ */
+extern void RingDoorbell(sem_t *doorbell)
+{
+	int value, res;
+
+	res = sem_getvalue(doorbell, &value);
+	assert(res == 0);
+	if (value > 0)
+		return;
+	res = sem_post(doorbell);
+	assert(res == 0);
+}
+
+/*
+ * This function waits until the doorbell rings, but no longer than
+ * 'msec' milliseconds. A signal also ends the wait.
+ */
+extern void WaitDoorbell(sem_t *doorbell, int msec)
+{
+	struct timespec ts;
+	int res;
+
+	res = clock_gettime(CLOCK_REALTIME, &ts);
+	assert(res == 0);
+	ts.tv_sec += msec / 1000;
+	ts.tv_nsec += (long) (msec % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	res = sem_timedwait(doorbell, &ts);
+	assert(res == 0 || errno == ETIMEDOUT || errno == EINTR);
+}
+
 /*
  * This function returns a pointer to a shared memory block by its id.
  */
@@ -0,0 +1,216 @@
+/*
+ * _pargresql_ring.c
+ *
+ * Shared memory rings for the messages between the nodes
+ * that run on the same host.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include "par_inis/_pargresql_ring.h"
+
+typedef struct {
+	/* first, so that the messages start at RING_ALIGNed addresses of the mapping */
+	ring_t rings[RING_MAX_LOCAL][RING_MAX_LOCAL][RING_PORTS];
+
+	sem_t semaphore;
+	int nodescount;
+	int slots[RING_MAX_NODES];	/* local slot of every node, -1 if remote */
+	sem_t doorbells[RING_MAX_LOCAL];	/* rung on every ring event of the node */
+} ringshmem_t;
+
+#define ring_align(len)	(((len) + RING_ALIGN - 1) & ~(RING_ALIGN - 1))
+
+static ringshmem_t *ringptr = NULL;	/* pointer to the ring shared memory */
+
+
+/*
+ * This function creates and opens a new ring shared memory object.
+ * 'name' contains the name of the shared memory object.
+ * 'nodescount' contains the total number of nodes.
+ * 'slots' contains the local slot of every node, or -1 for the nodes
+ * that run on the other hosts.
+ */
+extern void CreateRingObject(const char *name, int nodescount, const int *slots)
+{
+	int fd, res, i;
+
+	assert(nodescount <= RING_MAX_NODES);
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	assert(fd > -1);
+	res = ftruncate(fd, sizeof(ringshmem_t));
+	assert(res == 0);
+	ringptr = mmap(NULL, sizeof(ringshmem_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	res = sem_init(&ringptr->semaphore, 1, 0);
+	assert(res == 0);
+	for (i = 0; i < RING_MAX_LOCAL; i++) {
+		res = sem_init(&ringptr->doorbells[i], 1, 0);
+		assert(res == 0);
+	}
+
+	ringptr->nodescount = nodescount;
+	for (i = 0; i < RING_MAX_NODES; i++) {
+		ringptr->slots[i] = (i < nodescount) ? slots[i] : -1;
+		assert(ringptr->slots[i] < RING_MAX_LOCAL);
+	}
+	/* the rings themselves are zeroed by ftruncate */
+
+	res = sem_post(&ringptr->semaphore);
+	assert(res == 0);
+}
+
+/*
+ * This function opens an existing ring shared memory object.
+ * Returns 0 if there is no such object.
+ */
+extern int OpenRingObject(const char *name)
+{
+	int fd, res;
+
+	fd = shm_open(name, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0)
+		return 0;
+	ringptr = mmap(NULL, sizeof(ringshmem_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ringptr == MAP_FAILED) {
+		ringptr = NULL;
+		return 0;
+	}
+
+	res = sem_wait(&ringptr->semaphore);
+	assert(res == 0);
+	res = sem_post(&ringptr->semaphore);
+	assert(res == 0);
+	return 1;
+}
+
+/*
+ * This function deletes an existing ring shared memory object.
+ */
+extern void RemoveRingObject(const char *name)
+{
+	int res;
+
+	res = shm_unlink(name);
+	assert(res == 0);
+}
+
+/*
+ * This function returns the ring for the messages from 'src' to 'dst'
+ * sent to 'port', or NULL if the message should go through MPI.
+ */
+extern ring_t *GetRing(int src, int dst, uuid_t port)
+{
+	int srcslot, dstslot;
+
+	if (ringptr == NULL || port < 0 || port >= RING_PORTS)
+		return NULL;
+	if (src < 0 || src >= ringptr->nodescount || dst < 0 || dst >= ringptr->nodescount)
+		return NULL;
+
+	srcslot = ringptr->slots[src];
+	dstslot = ringptr->slots[dst];
+	if (srcslot < 0 || dstslot < 0)
+		return NULL;
+
+	return &ringptr->rings[srcslot][dstslot][port];
+}
+
+/*
+ * This function returns the doorbell of the local node 'node', which
+ * replaces the doorbell of its shared memory object (see GetDoorbell),
+ * or NULL if the node does not use the rings.
+ */
+extern sem_t *GetRingDoorbell(int node)
+{
+	int slot;
+
+	if (ringptr == NULL || node < 0 || node >= ringptr->nodescount)
+		return NULL;
+
+	slot = ringptr->slots[node];
+	if (slot < 0)
+		return NULL;
+
+	return &ringptr->doorbells[slot];
+}
+
+/*
+ * This function copies the message into the ring. Returns 0 if there
+ * is not enough free space in the ring at the moment.
+ */
+extern int RingWrite(ring_t *ring, const void *buf, int size)
+{
+	unsigned int head, tail, pos, need, skip;
+
+	need = RING_HEADER + ring_align(size);
+	assert(size >= 0 && need + RING_ALIGN <= RING_SIZE);
+
+	head = ring->head;
+	tail = ring->tail;
+	__sync_synchronize();	/* the consumer has finished reading up to 'tail' */
+
+	pos = head % RING_SIZE;
+	skip = (RING_SIZE - pos < need) ? RING_SIZE - pos : 0;
+	if (RING_SIZE - (head - tail) < skip + need)
+		return 0;
+
+	if (skip > 0) {
+		*(unsigned int *)(ring->data + pos) = RING_WRAP;
+		head += skip;
+		pos = 0;
+	}
+	*(unsigned int *)(ring->data + pos) = (unsigned int) size;
+	memcpy(ring->data + pos + RING_HEADER, buf, size);
+
+	__sync_synchronize();	/* the message is in place before it is published */
+	ring->head = head + need;
+	return 1;
+}
+
+/*
+ * This function returns the first message of the ring without
+ * copying it. Returns 0 if the ring is empty.
+ */
+extern int RingPeek(ring_t *ring, void **buf, int *size)
+{
+	unsigned int head, tail, pos, len;
+
+	head = ring->head;
+	tail = ring->tail;
+	__sync_synchronize();	/* the messages up to 'head' are in place */
+	if (head == tail)
+		return 0;
+
+	pos = tail % RING_SIZE;
+	len = *(unsigned int *)(ring->data + pos);
+	if (len == RING_WRAP) {
+		tail += RING_SIZE - pos;
+		ring->tail = tail;
+		assert(head != tail);
+		pos = 0;
+		len = *(unsigned int *)(ring->data + pos);
+	}
+
+	*buf = ring->data + pos + RING_HEADER;
+	*size = (int) len;
+	return 1;
+}
+
+/*
+ * This function frees the space of the first message of the ring.
+ */
+extern void RingRelease(ring_t *ring)
+{
+	unsigned int tail, len;
+
+	tail = ring->tail;
+	len = *(unsigned int *)(ring->data + tail % RING_SIZE);
+	assert(len != RING_WRAP);
+
+	__sync_synchronize();	/* the message has been read before its space is freed */
+	ring->tail = tail + RING_HEADER + ring_align(len);
+}
@@ -0,0 +1,50 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_coopscan.h
+ *	  Cooperative sequential scans of PargreSQL.
+ *
+ * Several ranks (nodes of the exchanges) may share one database, and so
+ * one fragment of every relation: pargresql_scan_workers consecutive
+ * ranks form a fragment, the first one of them being its leader. The
+ * sequential scans of a fragment are then shared: every block is read
+ * by the rank that takes it first from a dispenser in shared memory.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PAR_COOPSCAN_H
+#define PAR_COOPSCAN_H
+
+#include "access/relscan.h"
+
+/* GUC variable: the number of ranks that share one fragment */
+extern int	par_scan_workers;
+
+/* The blocks of this rank in a cooperative scan */
+typedef struct ParCoopScanState
+{
+	int			slot;			/* the dispenser in shared memory, or -1 */
+	int			fragment;		/* the key of the dispenser: the fragment, */
+	int32		session;		/* the session, */
+	uint32		command;		/* the command, */
+	int			scanno;			/* the scan in it, */
+	Oid			relid;			/* and the relation scanned */
+	BlockNumber nblocks;		/* the number of blocks the dispenser hands out */
+	BlockNumber *chunks;		/* the first blocks of the chunks taken so far */
+	int			nchunks;
+	int			maxchunks;
+	bool		claimed;		/* the dispenser is empty, 'chunks' is complete */
+	int			replay;			/* the next chunk to read again after a rescan */
+	BlockNumber next;			/* the next block of the current chunk */
+	BlockNumber end;			/* the end of the current chunk */
+} ParCoopScanState;
+
+extern Size ParCoopScanShmemSize(void);
+extern void ParCoopScanShmemInit(void);
+
+extern void par_coopscan_new_command(void);
+extern void par_coopscan_begin(HeapScanDesc scan);
+extern BlockNumber par_coopscan_next(HeapScanDesc scan);
+extern void par_coopscan_rescan(HeapScanDesc scan);
+extern void par_coopscan_end(HeapScanDesc scan);
+
+#endif   /* PAR_COOPSCAN_H */
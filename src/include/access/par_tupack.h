@@ -12,7 +12,28 @@
 #include "lib/stringinfo.h"
 #include "executor/tuptable.h"
 
-extern StringInfoData par_tupack(TupleTableSlot *slot);
-extern void par_tunpack(StringInfoData buf, TupleTableSlot *slot);
+/*
+ * The layout of the tuples of one exchange, taken from their
+ * descriptor once, so that packing and unpacking do not have to
+ * look the attributes up for every tuple.
+ */
+typedef struct ParTupleLayout
+{
+	int		natts;
+	int16	*attlen;
+	bool	*attbyval;
+	char	*attalign;
+	bool	*attpackable; // true if a varlena may get a short header
+	Datum	*values; // the values being packed, with the external ones fetched
+	char	*buffer; // the tuple unpacked last, its datums point here
+	int		buflen;
+	MemoryContext	cxt; // where the buffer is allocated
+} ParTupleLayout;
+
+extern ParTupleLayout *par_tuplayout(TupleDesc typeinfo);
+extern void par_free_tuplayout(ParTupleLayout *layout);
+extern void par_tupack(ParTupleLayout *layout, TupleTableSlot *slot, StringInfo buf);
+extern void par_tupack_minimal(ParTupleLayout *layout, TupleTableSlot *slot, StringInfo buf);
+extern void par_tunpack(ParTupleLayout *layout, const char *data, int len, TupleTableSlot *slot);
 
 #endif /* PAR_TUPACK_H */
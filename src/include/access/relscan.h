@@ -49,6 +49,9 @@ typedef struct HeapScanDescData
 	int			rs_mindex;		/* marked tuple's saved index */
 	int			rs_ntuples;		/* number of visible tuples on page */
 	OffsetNumber rs_vistuples[MaxHeapTuplesPerPage];	/* their offsets */
+
+	/* PargreSQL: the blocks shared with the other ranks, see par_coopscan.c */
+	struct ParCoopScanState *rs_coop;	/* NULL if the scan reads all of them */
 } HeapScanDescData;
 
 /*
@@ -53,6 +53,6 @@
  */
 
 /*							yyyymmddN */
-#define CATALOG_VERSION_NO	200904091
+#define CATALOG_VERSION_NO	202610171
 
 #endif
@@ -267,6 +267,9 @@ DECLARE_UNIQUE_INDEX(pg_user_mapping_oid_index, 174, on pg_user_mapping using bt
 DECLARE_UNIQUE_INDEX(pg_user_mapping_user_server_index, 175, on pg_user_mapping using btree(umuser oid_ops, umserver oid_ops));
 #define UserMappingUserServerIndexId	175
 
+DECLARE_UNIQUE_INDEX(pg_par_bucket_index, 3781, on pg_par_bucket using btree(bucket int4_ops));
+#define ParBucketIndexId	3781
+
 /* last step of initialization script: build the indexes declared above */
 BUILD_INDICES
 
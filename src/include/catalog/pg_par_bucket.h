@@ -0,0 +1,56 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_par_bucket.h
+ *	  definition of the system "PargreSQL bucket" relation (pg_par_bucket)
+ *	  along with the relation's initial contents.
+ *
+ * The rows of a relation fragmented by hash go to the virtual bucket
+ * hash(fragattr) % PAR_BUCKETS, and the bucket belongs to the fragment
+ * recorded here. A bucket that is not here belongs to the fragment
+ * bucket % fragments (see par_fragment.h).
+ *
+ * NOTES
+ *	  the genbki.sh script reads this file and generates .bki
+ *	  information from the DATA() statements.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PG_PAR_BUCKET_H
+#define PG_PAR_BUCKET_H
+
+#include "catalog/genbki.h"
+
+/* ----------------
+ *		pg_par_bucket definition.  cpp turns this into
+ *		typedef struct FormData_pg_par_bucket
+ * ----------------
+ */
+#define ParBucketRelationId  3780
+
+CATALOG(pg_par_bucket,3780) BKI_WITHOUT_OIDS
+{
+	int4		bucket;			/* the virtual bucket */
+	int4		fragment;		/* the fragment it belongs to */
+} FormData_pg_par_bucket;
+
+/* ----------------
+ *		Form_pg_par_bucket corresponds to a pointer to a tuple with
+ *		the format of pg_par_bucket relation.
+ * ----------------
+ */
+typedef FormData_pg_par_bucket *Form_pg_par_bucket;
+
+/* ----------------
+ *		compiler constants for pg_par_bucket
+ * ----------------
+ */
+#define Natts_pg_par_bucket				2
+#define Anum_pg_par_bucket_bucket		1
+#define Anum_pg_par_bucket_fragment		2
+
+/* ----------------
+ *		pg_par_bucket has no initial contents
+ * ----------------
+ */
+
+#endif   /* PG_PAR_BUCKET_H */
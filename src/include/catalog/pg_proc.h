@@ -4702,6 +4702,14 @@ DESCR("fetch the last row value");
 DATA(insert OID = 3114 (  nth_value		PGNSP PGUID 12 1 0 0 f t f t f i 2 0 2283 "2283 23" _null_ _null_ _null_ _null_ window_nth_value _null_ _null_ _null_ ));
 DESCR("fetch the Nth row value");
 
+/* PargreSQL virtual buckets */
+DATA(insert OID = 3782 (  pargresql_hash_bucket		PGNSP PGUID 12 1 0 0 f f f t f i 1 0 23 "23" _null_ _null_ _null_ _null_ pargresql_hash_bucket _null_ _null_ _null_ ));
+DESCR("virtual bucket of a hash value");
+DATA(insert OID = 3783 (  pargresql_hash_fragment	PGNSP PGUID 12 1 0 0 f f f t f s 1 0 23 "23" _null_ _null_ _null_ _null_ pargresql_hash_fragment _null_ _null_ _null_ ));
+DESCR("fragment a hash value belongs to");
+DATA(insert OID = 3784 (  pargresql_rebalance		PGNSP PGUID 12 1 0 0 f f f t f v 2 0 23 "23 23" _null_ _null_ _null_ _null_ pargresql_rebalance _null_ _null_ _null_ ));
+DESCR("move virtual buckets to balance the fragments");
+
 
 /*
  * Symbolic values for provolatile column: these indicate whether the result
@@ -0,0 +1,62 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_bloom.h
+ *	  The bloom filters of the PargreSQL hash joins.
+ *
+ * When the outer side of an inner or semi hash join comes through an
+ * exchange, an outer tuple sent to some node can only match the inner
+ * tuples in the hash table of that node. So every node builds a bloom
+ * filter of the hash values in its hash table, and sends it to all the
+ * other nodes, and the Scatter of the outer side drops the tuples the
+ * filter of their destination does not have.
+ *
+ * The filters travel asynchronously: a Scatter sends the tuples as they
+ * are until the filter of their destination comes. A node that never
+ * builds its hash table (because its outer side is empty, for example)
+ * sends an empty message instead, which lets everything through, so
+ * every node gets exactly one message from every other one.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PAR_BLOOM_H
+#define PAR_BLOOM_H
+
+#include "nodes/execnodes.h"
+
+/* The filter of one node fits into one message */
+#define PAR_BLOOM_MINBITS	1024
+#define PAR_BLOOM_MAXBITS	(8 * 16384)
+
+typedef struct ParBloom
+{
+	int			port;			/* the port the filters go through */
+	int			nbits;			/* the size of our filter, a power of 2 */
+	bits8	   *bits;			/* our filter, while it is being built */
+	double		added;			/* the hash values added to it */
+	bool		sent;			/* true if our filter has been sent */
+	bool		disabled;		/* true if the filters are out of date */
+	_pargresql_request_t *sendreqs;	/* the sends of our filter, per node */
+	int		   *sending;		/* true if the send has not completed yet */
+	char	  **bufs;			/* the filters of the other nodes, per node */
+	_pargresql_request_t *recvreqs;	/* their receives */
+	int		   *receiving;		/* true if the filter has not come yet */
+	int		   *nodebits;		/* the size of the filter of the node, 0 if none */
+	int			numkeys;		/* the number of the outer hash keys */
+	List	   *outerkeys;		/* the outer hash keys, ExprStates */
+	FmgrInfo   *hashfunctions;	/* their hash functions */
+	bool	   *hashStrict;		/* true if the join operator is strict */
+} ParBloom;
+
+/* GUC variable */
+extern bool par_join_filters;
+
+extern ParBloom *par_bloom_create(HashJoinState *hjstate, int port, double rows);
+extern void par_bloom_add(ParBloom *bloom, uint32 hashvalue);
+extern void par_bloom_send(ParBloom *bloom, bool built);
+extern bool par_bloom_hash(ParBloom *bloom, ExprContext *econtext,
+			   TupleTableSlot *slot, uint32 *hashvalue);
+extern bool par_bloom_rejects(ParBloom *bloom, int node, uint32 hashvalue);
+extern void par_bloom_disable(ParBloom *bloom);
+extern void par_bloom_finish(ParBloom *bloom);
+
+#endif   /* PAR_BLOOM_H */
@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_instrument.h
+ *	  The instrumentation of a plan on all the PargreSQL nodes.
+ *
+ * Every node runs the same plan, so the n-th node of the plan state
+ * tree (in the order par_instr_collect walks it) is the same plan node
+ * everywhere. The walk skips the parts of the tree that may differ, and
+ * the nodes check that they have as many plan nodes as node 0 before
+ * sending anything. At the end of an EXPLAIN ANALYZE every node sends the
+ * instrumentation of its tree to node 0, which shows it for every plan
+ * node across the cluster.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PAR_INSTRUMENT_H
+#define PAR_INSTRUMENT_H
+
+#include "nodes/execnodes.h"
+
+/* The totals of one plan node on one PargreSQL node (see Instrumentation) */
+typedef struct ParInstrRecord
+{
+	double		startup;
+	double		total;
+	double		ntuples;
+	double		nloops;
+} ParInstrRecord;
+
+typedef struct ParClusterInstr
+{
+	int			nstates;		/* the number of plan nodes */
+	PlanState **states;			/* the plan nodes, in the walk order */
+	int			nnodes;			/* the number of PargreSQL nodes */
+	ParInstrRecord *records;	/* nnodes * nstates, by the node first */
+} ParClusterInstr;
+
+extern ParClusterInstr *par_instr_collect(PlanState *planstate);
+extern ParInstrRecord *par_instr_lookup(ParClusterInstr *cluster,
+				 PlanState *planstate, int node);
+
+#endif   /* PAR_INSTRUMENT_H */
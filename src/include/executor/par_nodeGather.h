@@ -12,6 +12,8 @@
 extern int	ExecCountSlotsGather(Gather *node);
 extern GatherState *ExecInitGather(Gather *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecGather(GatherState *node);
+extern TupleTableSlot *ExecGatherFrom(GatherState *node, int src);
+extern void ExecGatherCancel(GatherState *node);
 extern void ExecEndGather(GatherState *node);
 extern void ExecReScanGather(GatherState *node, ExprContext *exprCtxt);
 
@@ -12,6 +12,7 @@
 extern int	ExecCountSlotsMerge(Merge *node);
 extern MergeState *ExecInitMerge(Merge *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecMerge(MergeState *node);
+extern void ExecMergeDrain(MergeState *node);
 extern void ExecEndMerge(MergeState *node);
 extern void ExecReScanMerge(MergeState *node, ExprContext *exprCtxt);
 
@@ -9,7 +9,10 @@
 
 #include "nodes/execnodes.h"
 
-extern int fragfunc(int size, TupleTableSlot *slot, int fragattr);
+extern int fragfunc(ScatterState *node, TupleTableSlot *slot);
+extern int scatter_route(ScatterState *node, TupleTableSlot *slot);
+extern bool scatter_stopped(ScatterState *node);
+extern void scatter_stop(ScatterState *node);
 
 extern int	ExecCountSlotsScatter(Scatter *node);
 extern ScatterState *ExecInitScatter(Scatter *node, EState *estate, int eflags);
@@ -1432,6 +1432,8 @@ typedef struct HashJoinState
 	bool		hj_NeedNewOuter;
 	bool		hj_MatchedOuter;
 	bool		hj_OuterNotEmpty;
+	/* PargreSQL: the filter of the outer exchange, see par_bloom.h */
+	struct ParBloom *hj_Bloom;	/* NULL if the outer side is not filtered */
 } HashJoinState;
 
 
@@ -1600,6 +1602,7 @@ typedef struct HashState
 	HashJoinTable hashtable;	/* hash table for the hashjoin */
 	List	   *hashkeys;		/* list of ExprState nodes */
 	/* hashkeys is same as parent's hj_InnerHashKeys */
+	struct ParBloom *bloom;		/* PargreSQL: parent's hj_Bloom */
 } HashState;
 
 /* ----------------
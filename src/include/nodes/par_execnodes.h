@@ -3,9 +3,12 @@
 #else // PAR_EXECNODES_H is undefined
 #define PAR_EXECNODES_H
 
+#include "lib/stringinfo.h"
+
 typedef enum {
-	PAR_OK,
-	PAR_WAIT
+	PAR_OK,		// a tuple, or NULL for EOF
+	PAR_WAIT,	// no tuple, blocked on the messages
+	PAR_PROGRESS	// no tuple, but something has moved, call again
 } ExchangeStatus;
 
 typedef struct SplitState
@@ -16,30 +19,152 @@ typedef struct SplitState
 	int		sent_nulls; // true if we've encountered a null and scattered it
 } SplitState;
 
+typedef enum {
+	MERGE_SRC_EMPTY,	// the next tuple of the source is to be fetched
+	MERGE_SRC_READY,	// the next tuple of the source is in the heap
+	MERGE_SRC_DONE		// the source has returned its EOF
+} MergeSourceState;
+
 typedef struct MergeState
 {
 	PlanState	ps;
 	int		even; 
+	int		finished; // true if the EOF has been returned
+	long		waits; // the number of times both sons were blocked
+	double		waittime; // the seconds spent waiting for them
+	// The following are used by the ordered Merge only
+	FmgrInfo	*sortFunctions; // lookup data for the comparison functions of the keys
+	int		*sortFlags; // their SK_BT_DESC and SK_BT_NULLS_FIRST flags
+	TupleTableSlot	**heads; // the next tuple of every source (node)
+	MergeSourceState	*sources;
+	int		*heap; // the sources in the heads, as a binary heap by their tuples
+	int		heapsize;
 } MergeState;
 
+#define GATHER_BUFLEN 8192
+
+/*
+ * Scatter does not ship tuples one by one. The tuples bound for the same
+ * destination are packed into a frame, and the whole frame is sent with
+ * one message when it is full (by size or by tuple count) or at the EOF.
+ *
+ * A frame looks like this:
+ *	int16	the number of tuples in the frame
+ *	then for each tuple:
+ *	int32	the length of the packed tuple
+ *	...	the packed tuple (see par_tupack)
+ *
+ * A frame without tuples is the EOF marker.
+ *
+ * The frames for a node on the same host go through a shared memory
+ * ring and are read in place, so they carry the tuples unpacked, as
+ * MinimalTuples starting at the MAXALIGNed offsets of the frame, with
+ * their t_len instead of the length header. Only the toast pointers
+ * are fetched, the other node cannot follow them.
+ *
+ * A tuple that does not fit into a frame is sent in pieces, one per
+ * frame, and nothing else comes in between:
+ *	int16	PAR_FRAME_CHUNK
+ *	int32	the length of the whole packed (or minimal) tuple
+ *	int32	the length of the piece
+ *	...	the piece
+ */
+#define PAR_FRAME_SIZE GATHER_BUFLEN
+#define PAR_FRAME_TUPLES 256
+#define PAR_FRAME_HEADER 2
+#define PAR_FRAME_TUPLE_HEADER 4
+#define PAR_FRAME_CHUNK 0xFFFF
+#define PAR_FRAME_CHUNK_HEADER (2 * PAR_FRAME_TUPLE_HEADER)
+
+#define PAR_DST_ALL (-1) // the destination of a broadcast tuple (see scatter_route)
+
+/*
+ * Node 0 tells the sources of a cancelable exchange to stop with a
+ * one-byte message to this port. It is far above the ports of the
+ * exchanges, and goes through MPI even between the nodes of a host.
+ */
+#define PAR_STOP_PORT(port) (16384 + (port))
+
+/*
+ * The port the instrumentation of EXPLAIN ANALYZE goes to node 0 through
+ * (see par_instrument.h).
+ */
+#define PAR_INSTR_PORT 16383
+
+/*
+ * The port pargresql_rebalance moves the rows of the buckets through
+ * (see par_rebalance.c).
+ */
+#define PAR_REBALANCE_PORT 16382
+
+/*
+ * The port the leader of a fragment tells the other ranks of the fragment
+ * the session of their cooperative scans through (see par_coopscan.c).
+ */
+#define PAR_COOPSCAN_PORT 16381
+
+/*
+ * The port the hash join filters of the outer side of an exchange go
+ * through (see par_bloom.h).
+ */
+#define PAR_BLOOM_PORT(port) (8192 + (port))
+
 typedef struct ScatterState
 {
 	PlanState	ps;
 	TupleTableSlot	*upstreamTuple;
+	int		upstreamDst; // the destination of upstreamTuple, or PAR_DST_ALL
 	ExchangeStatus	status;
-	int		isSending; 
-	_pargresql_request_t	request;
-	void		*buf;
+	int		isSending; // true if some frames still wait to be handed over to INIS
+	int		eof; // true if the EOF has been scattered
+	StringInfoData	*frames; // the frame being filled, per destination
+	int		*framecnt; // the number of tuples in each frame
+	int		*toflush; // the number of frames waiting to be sent, per destination
+	_pargresql_request_t	*requests; // the last send, per destination
+	int		*inflight; // true if the last send has not been completed yet
+	int		*local; // true if the destination is reached through a shared memory ring
+	int		nlocal; // the number of such destinations
+	int		*haspending; // true if the 'packed' tuple did not fit into the frame and still has to go to the destination
+	int		*pendingoff; // how much of the pending tuple has been sent in pieces, per destination
+	FmgrInfo	*hashfunctions; // lookup data for the fragmentation hash functions
+	FmgrInfo	fragcmp; // lookup data for the comparison function of the fragScheme
+	struct ParTupleLayout	*layout; // the layout of the tuples (see par_tupack)
+	struct ParBloom	*bloom; // the filters of the hash join above (see par_bloom.h), or NULL
+	long		filtered; // the number of tuples the filters have dropped
+	StringInfoData	packed; // the tuple being scattered, packed; kept until it is sent everywhere
+	StringInfoData	minimal; // the same tuple as a MinimalTuple, for the nodes on this host
+	int		nexthot; // the destination of the next hot tuple being spread
+	long		*routed; // the number of tuples routed to each destination
+	long		*sentframes; // the number of frames sent to each destination
+	long		*sentbytes; // the number of bytes sent to each destination
+	long		hot; // the number of tuples with hot keys
+	int		stoppending; // true if the stop message from node 0 is still awaited
+	int		stopped; // true if node 0 needs no more tuples
+	_pargresql_request_t	stopreq; // the receive of the stop message
+	char		stopbuf;
 } ScatterState;
 
-#define GATHER_BUFLEN 8192
 typedef struct GatherState
 {
 	PlanState	ps;
 	ExchangeStatus	status;
 	int		nullcnt;
+	int		next; // the node to look at first next time
 	_pargresql_request_t	*requests;
 	void		**bufs;
+	StringInfoData	*frames; // the frame being unpacked, per source
+	int		*remaining; // the number of tuples left in each frame
+	int		*local; // true if the source is read in place from a shared memory ring
+	int		held; // the source whose ring frame the result slot points into, or -1
+	int		*done; // true if the source has sent its EOF
+	StringInfoData	*partial; // the pieces of a large tuple received so far, per source
+	struct ParTupleLayout	*layout; // the layout of the tuples (see par_tupack)
+	long		*recvtuples; // the number of tuples received from each source
+	long		*recvframes; // the number of frames received from each source
+	long		*recvbytes; // the number of bytes received from each source
+	int		stopping; // true if the sources wait for the stop message from us
+	int		*stopped; // true if the stop message has been sent to the source
+	_pargresql_request_t	*stopreqs; // the stop messages, per source
 } GatherState;
 
 #endif
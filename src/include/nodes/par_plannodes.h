@@ -14,21 +14,74 @@ typedef struct Split
 
 /* ----------------
  *		PargreSQL merge node
+ *
+ * A Merge with sort keys preserves the order: every node sends its
+ * tuples already sorted by them, and the Merge takes the least of the
+ * next tuples of all the nodes, like the final merge of a tuplesort.
  * ----------------
  */
 typedef struct Merge
 {
 	Plan		plan;
+	int		numCols;		/* number of sort-key columns, 0 if unordered */
+	AttrNumber	*sortColIdx;	/* their indexes in the target list */
+	Oid		*sortOperators;	/* OIDs of operators to sort them by */
+	bool		*nullsFirst;	/* NULLS FIRST/LAST directions */
 } Merge;
 
 /* ----------------
  *		PargreSQL scatter node
+ *
+ * The destination of a tuple is the hash of its fragColIdx columns
+ * modulo the number of nodes. With numCols == 0 every tuple goes
+ * to node 0. A broadcast Scatter sends every tuple to all the other
+ * nodes, while the Split keeps it on this one too.
+ *
+ * The tuples whose hash is one of the hotHashes (the keys too frequent
+ * for a single node) are treated according to 'skew': PAR_SKEW_SPREAD
+ * sends them round-robin to all the nodes, PAR_SKEW_BROADCAST sends
+ * them to every node. Spreading the outer side of a join this way
+ * while broadcasting the inner one keeps the join correct.
+ * The hot keys are chosen at plan time from the MCV list and never
+ * change at run time: both sides must agree on them, and when a Split
+ * of one side finds a key frequent, the other side may have already
+ * sent that key's tuples to a single node.
+ *
+ * A Scatter toFragments places the tuples into the fragments of a
+ * relation (see par_fragment.h): the hash, or the range or list of
+ * the fragScheme, selects the fragment, and the tuple goes to its leader.
+ *
+ * A cancelable Scatter sends everything to node 0 (numCols == 0), and
+ * stops as if its input had ended once node 0 needs no more tuples
+ * (see ExecGatherCancel). Its Gather is cancelable as well.
+ *
+ * The Scatter with a joinFilter feeds the outer side of an inner or semi
+ * hash join, and does not send the tuples the hash table of their
+ * destination has nothing for, according to its bloom filter.
  * ----------------
  */
+typedef enum SkewMode
+{
+	PAR_SKEW_NONE,
+	PAR_SKEW_SPREAD,
+	PAR_SKEW_BROADCAST
+} SkewMode;
+
 typedef struct Scatter
 {
 	Plan		plan;
 	int		port; 
+	bool		broadcast;		/* replicate the tuples to every node */
+	int		numCols;		/* number of fragmentation columns */
+	AttrNumber	*fragColIdx;	/* their indexes in the target list */
+	Oid		*fragFunctions;	/* hash functions of their types */
+	SkewMode	skew;			/* what to do with the hot keys */
+	int		numHot;			/* number of hot keys */
+	uint32		*hotHashes;		/* their hashes, as fragfunc computes them */
+	bool		toFragments;	/* route to the fragments, not to the ranks */
+	struct ParFragScheme	*fragScheme;	/* range or list routing, or NULL */
+	bool		cancelable;		/* node 0 may stop it early */
+	bool		joinFilter;		/* the hash join above may drop tuples (see par_bloom.h) */
 } Scatter;
 
 /* ----------------
@@ -39,6 +92,7 @@ typedef struct Gather
 {
 	Plan		plan;
 	int		port; 
+	bool		cancelable;		/* on node 0, tells the sources when to stop */
 } Gather;
 
 #endif
@@ -240,6 +240,8 @@ typedef struct Scan
 {
 	Plan		plan;
 	Index		scanrelid;		/* relid is index into the range table */
+	bool		cooperative;	/* PargreSQL: shares the blocks with the
+								 * other ranks of the fragment */
 } Scan;
 
 /* ----------------
@@ -26,6 +26,8 @@
 #define DEFAULT_CPU_TUPLE_COST	0.01
 #define DEFAULT_CPU_INDEX_TUPLE_COST 0.005
 #define DEFAULT_CPU_OPERATOR_COST  0.0025
+#define DEFAULT_PARGRESQL_NETWORK_TUPLE_COST  0.05
+#define DEFAULT_PARGRESQL_NETWORK_BYTE_COST  0.0005
 
 #define DEFAULT_EFFECTIVE_CACHE_SIZE  16384		/* measured in pages */
 
@@ -48,6 +50,8 @@ extern PGDLLIMPORT double random_page_cost;
 extern PGDLLIMPORT double cpu_tuple_cost;
 extern PGDLLIMPORT double cpu_index_tuple_cost;
 extern PGDLLIMPORT double cpu_operator_cost;
+extern PGDLLIMPORT double pargresql_network_tuple_cost;
+extern PGDLLIMPORT double pargresql_network_byte_cost;
 extern PGDLLIMPORT int effective_cache_size;
 extern Cost disable_cost;
 extern bool enable_seqscan;
@@ -87,6 +91,8 @@ extern void cost_sort(Path *path, PlannerInfo *root,
 extern bool sort_exceeds_work_mem(Sort *sort);
 extern void cost_material(Path *path,
 			  Cost input_cost, double tuples, int width);
+extern void cost_exchange(Plan *exchange, Plan *input,
+			  double shipped, double rows);
 extern void cost_agg(Path *path, PlannerInfo *root,
 		 AggStrategy aggstrategy, int numAggs,
 		 int numGroupCols, double numGroups,
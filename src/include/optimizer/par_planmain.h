@@ -6,10 +6,15 @@
 // These methods are for internal use in make_exchange.
 extern Split *make_split(Plan *lefttree, Plan *righttree);
 extern Merge *make_merge(Plan *lefttree, Plan *righttree);
-extern Scatter *make_scatter(Plan *sibling, int port, int fragattr);
+extern Scatter *make_scatter(Plan *sibling, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions);
 extern Gather *make_gather(Plan *sibling, int port);
 
 // Use these in Parallelizer.
-extern Plan *make_exchange(Plan *plan, int port, int fragattr);
+extern Plan *make_exchange(Plan *plan, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions);
+extern Plan *make_broadcast_exchange(Plan *plan, int port);
+extern Plan *make_sorted_exchange(Plan *plan, Sort *sort, int port);
+extern Plan *make_ordered_exchange(Plan *plan, int port, int numCols, AttrNumber *fragColIdx, Oid *fragFunctions,
+	int numSortCols, AttrNumber *sortColIdx, Oid *sortOperators, bool *nullsFirst);
+extern void cost_exchange_of(Plan *exchange, Plan *plan, int numCols, bool broadcast);
 
 #endif
@@ -18,8 +18,28 @@ typedef struct {
  * This function opens the access to the shared memory.
  * No other functions of the library should be called
  * before this one.
+ * 'name' contains the name of the shared memory object of the node,
+ * if it is NULL or empty, the one from SHMEMNAME_ENV is used.
+ * Returns 1 on success, or 0 if the object could not be opened,
+ * errno telling why.
  */
-extern void _pargresql_InitLib();
+extern int _pargresql_InitLib(const char *name);
+
+/*
+ * This function returns 1 if the access to the shared memory is open,
+ * i.e. _pargresql_InitLib has been called and _pargresql_FinalizeLib
+ * has not, or 0 otherwise.
+ */
+extern int _pargresql_IsOpen(void);
+
+/*
+ * This function waits until a message of the current node may have
+ * moved (a request has been completed, a message has arrived into a
+ * ring or a ring has got free space), but no longer than 'msec'
+ * milliseconds. It is meant to be called when all the requests and
+ * rings the caller is interested in have been tested without success.
+ */
+extern void _pargresql_Wait(int msec);
 
 /*
  * This function puts a message of a given size into a free block
@@ -63,6 +83,35 @@ extern void _pargresql_IRecv(int src, uuid_t port, int size, void *buf, _pargres
 extern void _pargresql_Test(_pargresql_request_t *request, int *flag);
 
 
+/*
+ * This function returns 1 if the messages between the current node
+ * and 'other' sent to 'port' go through a shared memory ring (i.e. the
+ * nodes run on the same host), or 0 if they go through MPI.
+ */
+extern int _pargresql_IsLocal(int other, uuid_t port);
+
+/*
+ * This function copies a message directly into the ring of the
+ * destination node, bypassing the communicator. If there was no
+ * room in the ring, 'flag' is set to 0 and the message should be
+ * sent again later. The message is sent if 'flag' is 1.
+ * 'dst' must be a local node (see _pargresql_IsLocal).
+ */
+extern void _pargresql_RingSend(int dst, uuid_t port, int size, void *buf, int *flag);
+
+/*
+ * This function returns the next message from the ring of the source
+ * node in place, without copying it. If there was no message, 'flag'
+ * is set to 0. The message stays valid until _pargresql_RingDone.
+ * 'src' must be a local node (see _pargresql_IsLocal).
+ */
+extern void _pargresql_RingRecv(int src, uuid_t port, void **buf, int *size, int *flag);
+
+/*
+ * This function frees the message returned by _pargresql_RingRecv.
+ */
+extern void _pargresql_RingDone(int src, uuid_t port);
+
 /*
  * This function returns the current node id.
  */
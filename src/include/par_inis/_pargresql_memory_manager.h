@@ -15,6 +15,7 @@
 #include <unistd.h>
 
 #define SHMEMNAME			"/mem0"
+#define SHMEMNAME_ENV		"PARGRESQL_SHMEM"	/* overrides SHMEMNAME, see below */
 #define BLOCKS_IN_SHMEM		2000
 #define MAX_MESSAGE_SIZE	16777
 #define UNPROCESSED			0
@@ -41,21 +42,41 @@ typedef struct {
 	int msgSize;
 } shmblock_t;
 
+/*
+ * Several nodes can run on the same host, each needing its own shared
+ * memory object. In that case the name of the object is taken from the
+ * SHMEMNAME_ENV environment variable of both the communicator and the
+ * postmaster. The communicator substitutes its node id for "%d" in the
+ * name, so one setting (e.g. "/mem%d") serves all the communicators.
+ */
+
 /*
  * This function creates and opens a new shared memory object.
  * 'name' contains the name of the shared memory object.
  * 'node' contains the current node id.
  * 'nodescount' contains the total number of nodes.
+ * 'ringname' contains the name of the ring object of the host,
+ * or an empty string if the node does not use the rings.
  */
-extern void CreateSHMObject(const char *name, int node, int nodescount);
+extern void CreateSHMObject(const char *name, int node, int nodescount, const char *ringname);
 
 /*
  * This function opens an existing shared memory object.
  * 'name' contains the shared memory object name.
  * 'node' will contain the current node id upon return.
  * 'nodescount' will contin the total number of nodes upon return.
+ * Returns 1 on success, or 0 if there is no such object (or it is not
+ * one of a node), errno telling why.
+ */
+extern int OpenSHMObject(const char *name, int *node, int *nodescount);
+
+/*
+ * This function returns the name of the ring object of the host, or
+ * an empty string if there is none. The communicator names the rings
+ * after the shared memory object of the first node of the host
+ * followed by RINGSHMEMSUFFIX.
  */
-extern void OpenSHMObject(const char *name, int *node, int *nodescount);
+extern const char *GetRingName(void);
 
 /*
  * This function deletes an existing shared memory object.
@@ -63,6 +84,25 @@ extern void OpenSHMObject(const char *name, int *node, int *nodescount);
  */
 extern void RemoveSHMObject(const char *name);
 
+/*
+ * This function returns the doorbell of the node, the semaphore that
+ * the communicator rings whenever a block of the node has been processed.
+ */
+extern sem_t *GetDoorbell(void);
+
+/*
+ * This function wakes up the process waiting on the doorbell. The rings
+ * are not counted: a doorbell is either rung or not, so that a process
+ * busy with the messages does not have to drain it.
+ */
+extern void RingDoorbell(sem_t *doorbell);
+
+/*
+ * This function waits until the doorbell rings, but no longer than
+ * 'msec' milliseconds. A signal also ends the wait.
+ */
+extern void WaitDoorbell(sem_t *doorbell, int msec);
+
 /*
  * This function returns a pointer to a shared memory block by its id.
  */
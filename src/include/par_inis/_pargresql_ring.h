@@ -0,0 +1,93 @@
+/*
+ * _pargresql_ring.h
+ *
+ * Shared memory rings for the messages between the nodes
+ * that run on the same host.
+ */
+
+#ifndef _PARGRESQL_RING_H_
+#define _PARGRESQL_RING_H_
+
+#include "_pargresql_memory_manager.h"
+
+#define RINGSHMEMSUFFIX		"_ring"	/* see GetRingName */
+#define RINGS_ENV			"PARGRESQL_RINGS"	/* "off" sends everything through MPI */
+#define RING_MAX_NODES		256		/* total number of nodes */
+#define RING_MAX_LOCAL		8		/* number of nodes on one host */
+#define RING_PORTS			16		/* ports >= RING_PORTS go through MPI */
+#define RING_SIZE			32768	/* bytes in one ring */
+#define RING_ALIGN			8
+#define RING_HEADER			RING_ALIGN
+#define RING_WRAP			0xFFFFFFFFu
+
+/*
+ * A single-producer/single-consumer ring. The producer only writes
+ * 'head' and the consumer only writes 'tail', so no locks are needed.
+ * Both are byte counters that are never wrapped, the position in
+ * 'data' is the counter modulo RING_SIZE.
+ *
+ * Every message is a RING_HEADER-byte length followed by the message
+ * itself, padded to RING_ALIGN. A length of RING_WRAP means that the
+ * rest of 'data' is unused and the next message is at the beginning.
+ * The messages are RING_ALIGNed in memory too, so the receiver may read
+ * aligned data in place.
+ */
+typedef struct {
+	volatile unsigned int head;
+	char pad[64 - sizeof(unsigned int)];	/* keep head and tail on different cache lines */
+	volatile unsigned int tail;
+	char pad2[64 - sizeof(unsigned int)];
+	char data[RING_SIZE];
+} ring_t;
+
+/*
+ * This function creates and opens a new ring shared memory object.
+ * 'name' contains the name of the shared memory object.
+ * 'nodescount' contains the total number of nodes.
+ * 'slots' contains the local slot of every node, or -1 for the nodes
+ * that run on the other hosts.
+ */
+extern void CreateRingObject(const char *name, int nodescount, const int *slots);
+
+/*
+ * This function opens an existing ring shared memory object.
+ * Returns 0 if there is no such object.
+ */
+extern int OpenRingObject(const char *name);
+
+/*
+ * This function deletes an existing ring shared memory object.
+ */
+extern void RemoveRingObject(const char *name);
+
+/*
+ * This function returns the ring for the messages from 'src' to 'dst'
+ * sent to 'port', or NULL if the message should go through MPI.
+ */
+extern ring_t *GetRing(int src, int dst, uuid_t port);
+
+/*
+ * This function returns the doorbell of the local node 'node', which
+ * replaces the doorbell of its shared memory object (see GetDoorbell),
+ * or NULL if the node does not use the rings.
+ */
+extern sem_t *GetRingDoorbell(int node);
+
+/*
+ * This function copies the message into the ring. Returns 0 if there
+ * is not enough free space in the ring at the moment.
+ */
+extern int RingWrite(ring_t *ring, const void *buf, int size);
+
+/*
+ * This function returns the first message of the ring without
+ * copying it. Returns 0 if the ring is empty.
+ */
+extern int RingPeek(ring_t *ring, void **buf, int *size);
+
+/*
+ * This function frees the space of the first message of the ring.
+ */
+extern void RingRelease(ring_t *ring);
+
+#endif /* _PARGRESQL_RING_H_ */
@@ -0,0 +1,104 @@
+/*-------------------------------------------------------------------------
+ *
+ * par_fragment.h
+ *	  Range and list fragmentation of the relations in PargreSQL.
+ *
+ * A relation with the 'fragattr' reloption is fragmented by that
+ * attribute. The 'fragmethod' reloption tells how:
+ *
+ * hash (the default): a row goes to the virtual bucket
+ * hash(fragattr) % PAR_BUCKETS, and so to the node the bucket belongs to
+ * according to pg_par_bucket. The buckets that are not there belong to
+ * the node bucket % nodes. When the cluster grows, pargresql_rebalance
+ * moves some of the buckets to the new nodes (see par_rebalance.c), and
+ * the rest of the rows stay where they are.
+ *
+ * range: 'fragbounds' lists the ascending lower bounds of the nodes
+ * 1, 2, ... separated by ';'. Node 0 gets the values below the first
+ * bound, node i gets the values from its bound up to the next one.
+ * For example, fragbounds = '2011-01-01;2012-01-01' keeps the older
+ * rows on node 0, the rows of 2011 on node 1 and the rest on node 2.
+ *
+ * list: 'fragbounds' lists the values of the nodes 0, 1, ... separated
+ * by ',' within a node and by ';' between the nodes, for example
+ * 'eu,ru;us;cn,jp'. The values that are not listed go to node 0.
+ *
+ * A NULL always goes to node 0. A NULL has no bucket, so it stays on
+ * node 0 even when bucket 0 moves elsewhere, and pargresql_rebalance
+ * never moves it.
+ *
+ * With pargresql_scan_workers > 1, the "nodes" above are the fragments:
+ * that many consecutive ranks share the database of one fragment (see
+ * par_coopscan.h), and its rows are inserted by the first of them, the
+ * leader of the fragment.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PAR_FRAGMENT_H
+#define PAR_FRAGMENT_H
+
+#include "fmgr.h"
+#include "nodes/primnodes.h"
+
+#define PAR_BUCKETS 1024
+
+typedef enum FragMethod
+{
+	PAR_FRAG_HASH,
+	PAR_FRAG_RANGE,
+	PAR_FRAG_LIST
+} FragMethod;
+
+typedef struct ParFragScheme
+{
+	FragMethod	method;
+	AttrNumber	attno;			/* the fragmentation attribute */
+	Oid			atttype;
+	int32		atttypmod;
+	int16		typlen;
+	bool		typbyval;
+	Oid			opfamily;		/* the default btree operator family of the type */
+	Oid			opcintype;		/* the type its operators take */
+	Oid			cmpfunc;		/* its comparison function */
+	int			numValues;
+	Datum	   *values;			/* the bounds, or the listed values, ascending */
+	int		   *nodes;			/* the node of every value */
+} ParFragScheme;
+
+// The number of the fragments, and the one of this rank
+extern int par_fragments_count(void);
+extern int par_my_fragment(void);
+
+// The rank that inserts the rows of the fragment
+extern int par_fragment_leader(int fragment);
+
+// The virtual bucket of the hash of a fragmentation attribute, and the
+// fragment that bucket belongs to
+extern int par_hash_bucket(uint32 hash);
+extern int par_hash_fragment(uint32 hash);
+
+// Fills 'map' with the fragments of all the buckets as recorded in
+// pg_par_bucket, the missing ones being bucket % fragments. Returns the
+// number of the recorded buckets.
+extern int par_read_bucket_map(int *map, int fragments);
+
+// The range or list fragmentation of the relation, or NULL if it is
+// fragmented by hash, or not fragmented at all
+extern ParFragScheme *get_relid_fragscheme(Oid relid);
+
+// The node the value belongs to; 'cmp' is the looked up cmpfunc
+extern int fragscheme_node(ParFragScheme *scheme, FmgrInfo *cmp, Datum value, bool isnull);
+
+// An expression which is true for the values of 'arg' that belong to the node
+extern Expr *fragscheme_qual(ParFragScheme *scheme, Expr *arg, int node);
+
+// Refuses to commit a transaction that has moved buckets, which has to be
+// prepared on every node first
+extern void par_rebalance_pre_commit(void);
+
+// SQL-callable functions
+extern Datum pargresql_hash_bucket(PG_FUNCTION_ARGS);
+extern Datum pargresql_hash_fragment(PG_FUNCTION_ARGS);
+extern Datum pargresql_rebalance(PG_FUNCTION_ARGS);
+
+#endif   /* PAR_FRAGMENT_H */
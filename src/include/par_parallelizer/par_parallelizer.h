@@ -9,3 +9,9 @@
 #include "postgres.h"
 
 Plan *par_Parallelize(Plan *plan, Query *query);
+
+// The fragmentation attribute of the relation, or InvalidAttrNumber
+int get_relid_fragatno(Oid relid);
+
+// The hash function fragfunc uses for the values of the type
+Oid get_type_hash_function(Oid type);
@@ -236,6 +236,8 @@ typedef struct StdRdOptions
 	int			fillfactor;		/* page fill factor in percent (0..100) */
 	AutoVacOpts autovacuum;		/* autovacuum-related options */
 	char *fragattr;
+	char *fragmethod;	/* hash, range or list; see par_fragment.h */
+	char *fragbounds;
 } StdRdOptions;
 
 #define HEAP_MIN_FILLFACTOR			10
@@ -64,6 +64,7 @@ enum SysCacheIdentifier
 	OPEROID,
 	OPFAMILYAMNAMENSP,
 	OPFAMILYOID,
+	PARBUCKET,
 	PROCNAMEARGSNSP,
 	PROCOID,
 	RELNAMENSP,
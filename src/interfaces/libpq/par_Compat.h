@@ -17,6 +17,14 @@
 	#define PQfinish(X) par_PQfinish(X)
 	#define PQstatus(X) par_PQstatus(X)
 	#define PQexec(X,Y) par_PQexec(X,Y)
+	#define PQsendQuery(X,Y) par_PQsendQuery(X,Y)
+	#define PQsendQueryParams par_PQsendQueryParams
+	#define PQsendPrepare par_PQsendPrepare
+	#define PQsendQueryPrepared par_PQsendQueryPrepared
+	#define PQgetResult(X) par_PQgetResult(X)
+	#define PQerrorMessage(X) par_PQerrorMessage(X)
+	#define PQputCopyData par_PQputCopyData
+	#define PQputCopyEnd par_PQputCopyEnd
 #endif
 
 #endif
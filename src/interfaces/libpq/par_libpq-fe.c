@@ -11,12 +11,25 @@
 
 #define PAR_NO_COMPAT
 #define PAR_CONFIG_FILENAME "par_libpq.conf"
+#define PAR_REBALANCE_GID "pargresql_rebalance_%d"
 
 #include "par_libpq-fe.h"
 #include "libpq-int.h"
 #include "par_config.h"
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+static int par_send_done(par_PGconn *conn, int node, int ok);
+static int par_read_results(par_PGconn *conn, int node, PGresult **result);
+static int par_wait(par_PGconn *conn);
+static PGresult *par_copy_in(par_PGconn *conn);
+static PGresult *par_exec_node(par_PGconn *conn, int node, const char *query, const char *tag);
 
 par_PGconn *par_PQconnectdb(void)
 {
@@ -27,6 +40,10 @@ par_PGconn *par_PQconnectdb(void)
 	conn->len = conf->nodes_count;
 	printf("using %d nodes\n", conn->len);
 	conn->conns = malloc(conn->len * sizeof(PGconn*));
+	conn->busy = calloc(conn->len, sizeof(int));
+	conn->resultnode = 0;
+	conn->errnode = -1;
+	conn->copying = 0;
 	for (i = 0; i < conn->len; i++)
 	{
 		conn->conns[i] = PQconnectdb(conf->conninfo[i]);
@@ -43,6 +60,9 @@ void par_PQfinish(par_PGconn *conn)
 	for (i = 0; i < conn->len; i++) {
 		PQfinish(conn->conns[i]);
 	}
+	free(conn->conns);
+	free(conn->busy);
+	free(conn);
 }
 
 ConnStatusType par_PQstatus(const par_PGconn *conn)
@@ -64,25 +84,439 @@ ConnStatusType par_PQstatus(const par_PGconn *conn)
 	return CONNECTION_OK;
 }
 
+// Runs the command on all the nodes at once. Like PQexec, returns the
+// last result of node 0, or the first error of any node.
 PGresult *par_PQexec(par_PGconn *conn, const char *query)
 {
-	int i;
+	PGresult *r, *last = NULL;
+	int failed = 0;
+
+	if (!par_PQsendQuery(conn, query))
+	{
+		failed = 1;
+	}
+	while ((r = par_PQgetResult(conn)) != NULL)
+	{
+		if (last != NULL)
+		{
+			if (PQresultStatus(last) == PGRES_FATAL_ERROR)
+			{
+				// the first error is the one to report
+				PQclear(r);
+				continue;
+			}
+			PQclear(last);
+		}
+		last = r;
+		if (PQresultStatus(r) == PGRES_COPY_IN)
+		{
+			// the caller goes on with the COPY, as with PQexec
+			if ((r = par_copy_in(conn)) != NULL)
+			{
+				PQclear(last);
+				last = r;
+			}
+			else
+			{
+				conn->copying = 1;
+			}
+			break;
+		}
+		if (PQresultStatus(r) == PGRES_COPY_OUT)
+		{
+			break; // the caller goes on with the COPY, as with PQexec
+		}
+	}
+	if (last == NULL && failed)
+	{
+		last = PQmakeEmptyPGresult(conn->conns[conn->errnode], PGRES_FATAL_ERROR);
+	}
+	return last;
+}
+
+/*
+ * Marks the node busy if it has taken the command. Remembers
+ * the first node that has not.
+ */
+static int par_send_done(par_PGconn *conn, int node, int ok)
+{
+	if (ok)
+	{
+		conn->busy[node] = 1;
+	}
+	else if (conn->errnode < 0)
+	{
+		conn->errnode = node;
+	}
+	return ok;
+}
+
+int par_PQsendQuery(par_PGconn *conn, const char *query)
+{
+	int i, ok = 1;
+
+	conn->errnode = -1;
+	for (i = 0; i < conn->len; i++)
+	{
+		ok &= par_send_done(conn, i, PQsendQuery(conn->conns[i], query));
+	}
+	return ok;
+}
+
+int par_PQsendQueryParams(par_PGconn *conn,
+				  const char *command,
+				  int nParams,
+				  const Oid *paramTypes,
+				  const char *const * paramValues,
+				  const int *paramLengths,
+				  const int *paramFormats,
+				  int resultFormat)
+{
+	int i, ok = 1;
+
+	conn->errnode = -1;
+	for (i = 0; i < conn->len; i++)
+	{
+		ok &= par_send_done(conn, i, PQsendQueryParams(conn->conns[i], command,
+			nParams, paramTypes, paramValues, paramLengths, paramFormats, resultFormat));
+	}
+	return ok;
+}
+
+int par_PQsendPrepare(par_PGconn *conn, const char *stmtName,
+			  const char *query, int nParams,
+			  const Oid *paramTypes)
+{
+	int i, ok = 1;
+
+	conn->errnode = -1;
+	for (i = 0; i < conn->len; i++)
+	{
+		ok &= par_send_done(conn, i, PQsendPrepare(conn->conns[i], stmtName,
+			query, nParams, paramTypes));
+	}
+	return ok;
+}
+
+int par_PQsendQueryPrepared(par_PGconn *conn,
+					const char *stmtName,
+					int nParams,
+					const char *const * paramValues,
+					const int *paramLengths,
+					const int *paramFormats,
+					int resultFormat)
+{
+	int i, ok = 1;
+
+	conn->errnode = -1;
+	for (i = 0; i < conn->len; i++)
+	{
+		ok &= par_send_done(conn, i, PQsendQueryPrepared(conn->conns[i], stmtName,
+			nParams, paramValues, paramLengths, paramFormats, resultFormat));
+	}
+	return ok;
+}
+
+/*
+ * Reads the results of the node that are ready, without blocking.
+ * Returns 1 and sets 'result' if one of them is to be returned:
+ * any result of node 0, or an error of another node.
+ */
+static int par_read_results(par_PGconn *conn, int node, PGresult **result)
+{
+	PGconn *c = conn->conns[node];
 	PGresult *r;
-	for (i = 1; i < conn->len; i++) {
-		//PGresult *ignore = PQexec(conn->conns[i], query);
-		//PQclear(ignore);
-		PQsendQuery(conn->conns[i], query); // asynchronous command
+
+	if (!PQconsumeInput(c))
+	{
+		// The connection is broken, PQgetResult reports it
+		// without waiting for the input
 	}
-	r = PQexec(conn->conns[0], query); // synchronous command
-	for (i = 1; i < conn->len; i++) {
-		PGresult *ignore;
-		while ((ignore = PQgetResult(conn->conns[i])) != NULL) {
-			PQclear(ignore);
+	else if (PQisBusy(c))
+	{
+		return 0;
+	}
+
+	while (1)
+	{
+		r = PQgetResult(c);
+		if (r == NULL)
+		{
+			conn->busy[node] = 0;
+			return 0;
+		}
+		if (node == 0 || PQresultStatus(r) == PGRES_FATAL_ERROR
+			|| PQresultStatus(r) == PGRES_BAD_RESPONSE)
+		{
+			*result = r;
+			conn->resultnode = node;
+			return 1;
+		}
+		if (PQresultStatus(r) == PGRES_COPY_IN || PQresultStatus(r) == PGRES_COPY_OUT)
+		{
+			// COPY through the other nodes is up to the caller
+			*result = r;
+			conn->resultnode = node;
+			return 1;
+		}
+		PQclear(r);
+		if (PQisBusy(c))
+		{
+			return 0;
 		}
 	}
+}
+
+/*
+ * Waits until some of the busy nodes has sent something.
+ * Returns 0 if nothing can be waited for.
+ */
+static int par_wait(par_PGconn *conn)
+{
+	fd_set input;
+	int i, sock, maxsock = -1;
+
+	FD_ZERO(&input);
+	for (i = 0; i < conn->len; i++)
+	{
+		if (!conn->busy[i])
+		{
+			continue;
+		}
+		sock = PQsocket(conn->conns[i]);
+		if (sock < 0)
+		{
+			return 0;
+		}
+		FD_SET(sock, &input);
+		if (sock > maxsock)
+		{
+			maxsock = sock;
+		}
+	}
+	if (maxsock < 0)
+	{
+		return 0;
+	}
+	if (select(maxsock + 1, &input, NULL, NULL, NULL) < 0 && errno != EINTR)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+PGresult *par_PQgetResult(par_PGconn *conn)
+{
+	PGresult *r;
+	int i, busy;
+
+	while (1)
+	{
+		busy = 0;
+		// Node 0 first, its rows are the ones the caller waits for
+		for (i = 0; i < conn->len; i++)
+		{
+			if (!conn->busy[i])
+			{
+				continue;
+			}
+			if (par_read_results(conn, i, &r))
+			{
+				return r;
+			}
+			busy |= conn->busy[i];
+		}
+		if (!busy)
+		{
+			return NULL;
+		}
+		if (!par_wait(conn))
+		{
+			// The sockets are gone, let libpq report it
+			for (i = 0; i < conn->len; i++)
+			{
+				if (conn->busy[i])
+				{
+					conn->busy[i] = 0;
+					conn->resultnode = i;
+					return PQmakeEmptyPGresult(conn->conns[i], PGRES_FATAL_ERROR);
+				}
+			}
+			return NULL;
+		}
+	}
+}
+
+/*
+ * Waits until every node has started the COPY FROM STDIN, and ends it at
+ * once on all the nodes but node 0, which reads all the data (see
+ * copy.c). Returns NULL, or the first error of a node; in that case the
+ * COPY is ended on all the nodes, and they are done with the command.
+ */
+static PGresult *par_copy_in(par_PGconn *conn)
+{
+	PGresult *r, *err = NULL;
+	int i;
+
+	for (i = 0; i < conn->len && err == NULL; i++)
+	{
+		PGconn *c = conn->conns[i];
+
+		while (conn->busy[i] && c->asyncStatus != PGASYNC_COPY_IN)
+		{
+			r = PQgetResult(c);
+			if (r == NULL)
+			{
+				conn->busy[i] = 0;
+				break;
+			}
+			if (PQresultStatus(r) == PGRES_FATAL_ERROR
+				|| PQresultStatus(r) == PGRES_BAD_RESPONSE)
+			{
+				conn->resultnode = i;
+				err = r;
+				break;
+			}
+			PQclear(r);
+		}
+		if (err == NULL && i > 0 && c->asyncStatus == PGASYNC_COPY_IN
+			&& PQputCopyEnd(c, NULL) <= 0)
+		{
+			conn->resultnode = i;
+			err = PQmakeEmptyPGresult(c, PGRES_FATAL_ERROR);
+		}
+	}
+	if (err == NULL)
+	{
+		return NULL;
+	}
+
+	// The nodes still in the COPY would wait for the data forever
+	while ((r = par_PQgetResult(conn)) != NULL)
+	{
+		if (PQresultStatus(r) == PGRES_COPY_IN)
+		{
+			PQputCopyEnd(conn->conns[conn->resultnode], "COPY failed on another node");
+		}
+		PQclear(r);
+	}
+	return err;
+}
+
+int par_PQputCopyData(par_PGconn *conn, const char *buffer, int nbytes)
+{
+	if (!conn->copying)
+	{
+		return -1;
+	}
+	return PQputCopyData(conn->conns[0], buffer, nbytes);
+}
+
+int par_PQputCopyEnd(par_PGconn *conn, const char *errormsg)
+{
+	if (!conn->copying)
+	{
+		return -1;
+	}
+	conn->copying = 0;
+	return PQputCopyEnd(conn->conns[0], errormsg);
+}
+
+// Runs the command on one node. Returns NULL if it has completed with the
+// tag, or its error otherwise.
+static PGresult *par_exec_node(par_PGconn *conn, int node, const char *query, const char *tag)
+{
+	PGresult *r = PQexec(conn->conns[node], query);
+
+	if (r != NULL && PQresultStatus(r) == PGRES_COMMAND_OK && strcmp(PQcmdStatus(r), tag) == 0)
+	{
+		PQclear(r);
+		return NULL;
+	}
+	if (r == NULL || PQresultStatus(r) != PGRES_FATAL_ERROR)
+	{
+		// e.g. PREPARE TRANSACTION of a failed transaction rolls it back
+		PQclear(r);
+		r = PQmakeEmptyPGresult(conn->conns[node], PGRES_FATAL_ERROR);
+	}
 	return r;
 }
 
+PGresult *par_PQrebalance(par_PGconn *conn, int from, int max)
+{
+	char query[128];
+	PGresult *result, *err = NULL;
+	int *prepared = calloc(conn->len, sizeof(int));
+	int commit, i;
+
+	result = par_PQexec(conn, "BEGIN");
+	if (PQresultStatus(result) == PGRES_COMMAND_OK)
+	{
+		PQclear(result);
+		snprintf(query, sizeof(query), "SELECT pg_catalog.pargresql_rebalance(%d, %d)", from, max);
+		result = par_PQexec(conn, query);
+	}
+	commit = (PQresultStatus(result) == PGRES_TUPLES_OK);
+
+	// Every node prepares, or none commits
+	for (i = 0; i < conn->len && commit; i++)
+	{
+		snprintf(query, sizeof(query), "PREPARE TRANSACTION '" PAR_REBALANCE_GID "'", i);
+		err = par_exec_node(conn, i, query, "PREPARE TRANSACTION");
+		prepared[i] = (err == NULL);
+		commit = prepared[i];
+	}
+	for (i = 0; i < conn->len; i++)
+	{
+		PGresult *r;
+
+		if (commit)
+		{
+			snprintf(query, sizeof(query), "COMMIT PREPARED '" PAR_REBALANCE_GID "'", i);
+			r = par_exec_node(conn, i, query, "COMMIT PREPARED");
+		}
+		else if (prepared[i])
+		{
+			snprintf(query, sizeof(query), "ROLLBACK PREPARED '" PAR_REBALANCE_GID "'", i);
+			r = par_exec_node(conn, i, query, "ROLLBACK PREPARED");
+		}
+		else
+		{
+			r = par_exec_node(conn, i, "ROLLBACK", "ROLLBACK");
+		}
+		if (r != NULL)
+		{
+			// the first error is the one to report
+			if (err == NULL)
+			{
+				err = r;
+			}
+			else
+			{
+				PQclear(r);
+			}
+		}
+	}
+	free(prepared);
+
+	if (err != NULL)
+	{
+		PQclear(result);
+		return err;
+	}
+	return result;
+}
+
+int par_PQresultNode(const par_PGconn *conn)
+{
+	return conn->resultnode;
+}
+
+char *par_PQerrorMessage(const par_PGconn *conn)
+{
+	return PQerrorMessage(conn->conns[conn->errnode >= 0 ? conn->errnode : conn->resultnode]);
+}
+
 // Returns current monotonic time in seconds
 float now_s() {
 	struct timespec t;
@@ -24,6 +24,10 @@ typedef struct par_PGconn
 {
 	int len; // number of connections
 	struct pg_conn **conns; // the connections
+	int *busy; // true while the results of the node have not been read to the end
+	int resultnode; // the node of the last result par_PQgetResult returned
+	int errnode; // the node that failed to take the last command, or -1
+	int copying; // true while node 0 takes the data of a COPY FROM STDIN
 } par_PGconn;
 
 /* make new client connections to the backends */
@@ -38,6 +42,70 @@ extern PGresult *par_PQexec(par_PGconn *conn, const char *query);
 
 extern PGresult *par_PQexec_time(par_PGconn *conn, const char *query, float *dt);
 
+/*
+ * Asynchronous commands. They are sent to all the nodes at once, and
+ * return 1 if every node has taken the command, or 0 otherwise (see
+ * par_PQerrorMessage); par_PQgetResult has to be called until it
+ * returns NULL in either case.
+ */
+extern int par_PQsendQuery(par_PGconn *conn, const char *query);
+extern int par_PQsendQueryParams(par_PGconn *conn,
+				  const char *command,
+				  int nParams,
+				  const Oid *paramTypes,
+				  const char *const * paramValues,
+				  const int *paramLengths,
+				  const int *paramFormats,
+				  int resultFormat);
+extern int par_PQsendPrepare(par_PGconn *conn, const char *stmtName,
+			  const char *query, int nParams,
+			  const Oid *paramTypes);
+extern int par_PQsendQueryPrepared(par_PGconn *conn,
+					const char *stmtName,
+					int nParams,
+					const char *const * paramValues,
+					const int *paramLengths,
+					const int *paramFormats,
+					int resultFormat);
+
+/*
+ * Returns the next result of node 0 as soon as it is ready, or an error
+ * of any other node (the other results of the other nodes are dropped),
+ * or NULL when all the nodes are done with the command. While waiting,
+ * reads the input of all the nodes, so that none of them gets stuck on
+ * a full socket.
+ */
+extern PGresult *par_PQgetResult(par_PGconn *conn);
+
+/*
+ * COPY FROM STDIN, once par_PQexec has returned PGRES_COPY_IN. The data
+ * goes to node 0, which routes the rows of a fragmented relation to
+ * their nodes, and the other nodes get an empty stream. Return what
+ * PQputCopyData and PQputCopyEnd of node 0 do, or -1 if there is no
+ * COPY in progress. After par_PQputCopyEnd, par_PQgetResult returns the
+ * results of the COPY on all the nodes.
+ */
+extern int par_PQputCopyData(par_PGconn *conn, const char *buffer, int nbytes);
+extern int par_PQputCopyEnd(par_PGconn *conn, const char *errormsg);
+
+/*
+ * Moves at most 'max' buckets of the hashed relations between the
+ * fragments (see pargresql_rebalance) in one transaction on all the
+ * nodes, which commits by PREPARE TRANSACTION and COMMIT PREPARED, and
+ * only once every node has prepared; the nodes need
+ * max_prepared_transactions > 0. Returns the result of the SELECT, the
+ * number of the buckets still to move, or the first error. A node that
+ * fails to COMMIT PREPARED keeps the transaction 'pargresql_rebalance_N'
+ * (N being the node) prepared, to be committed there by hand.
+ */
+extern PGresult *par_PQrebalance(par_PGconn *conn, int from, int max);
+
+/* the node the last result of par_PQgetResult has come from */
+extern int par_PQresultNode(const par_PGconn *conn);
+
+/* the error message of the node that has failed to take a command */
+extern char *par_PQerrorMessage(const par_PGconn *conn);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
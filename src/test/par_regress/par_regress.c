@@ -0,0 +1,221 @@
+/*-----------------------------------------------------------------------------
+ *
+ * par_regress.c
+ * 	Runs the SQL of the standard input on all the nodes of par_libpq.conf,
+ * 	echoing every line and printing the result of every statement after
+ * 	its last line, for par_regress.sh to compare with the expected files.
+ * 	The data of a COPY FROM STDIN follow its statement, up to a line
+ * 	with "\.", as in psql. A line "\rebalance <from> <max>" moves the
+ * 	buckets with par_PQrebalance, and a line "\session <n>" sends the
+ * 	next statements through the n-th session, connecting it at first.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#define PAR_NO_COMPAT
+
+#include "par_libpq-fe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_SIZE 1024
+#define MAX_SESSIONS 2
+
+static void ignore_notice(void *arg, const char *message);
+static par_PGconn *connect_nodes(void);
+static PGresult *copy_in(par_PGconn *conn);
+static void print_result(PGresult *r);
+
+// The notices come from every node in no particular order
+static void ignore_notice(void *arg, const char *message)
+{
+}
+
+// Connects to all the nodes of par_libpq.conf. Returns NULL if some
+// node is not there.
+static par_PGconn *connect_nodes(void)
+{
+	par_PGconn *conn = par_PQconnectdb();
+	int i;
+
+	if (par_PQstatus(conn) != CONNECTION_OK)
+	{
+		fprintf(stderr, "could not connect to the nodes of par_libpq.conf\n");
+		par_PQfinish(conn);
+		return NULL;
+	}
+	for (i = 0; i < conn->len; i++)
+	{
+		PQsetNoticeProcessor(conn->conns[i], ignore_notice, NULL);
+	}
+	return conn;
+}
+
+// Sends the lines of the standard input up to "\." as the data of the
+// COPY, echoing them. Returns the result of the COPY, or its first error.
+static PGresult *copy_in(par_PGconn *conn)
+{
+	char line[LINE_SIZE];
+	PGresult *r, *last = NULL;
+
+	while (fgets(line, sizeof(line), stdin) != NULL)
+	{
+		fputs(line, stdout);
+		if (strcmp(line, "\\.\n") == 0)
+		{
+			break;
+		}
+		par_PQputCopyData(conn, line, strlen(line));
+	}
+	par_PQputCopyEnd(conn, NULL);
+
+	while ((r = par_PQgetResult(conn)) != NULL)
+	{
+		if (last != NULL && PQresultStatus(last) == PGRES_FATAL_ERROR)
+		{
+			PQclear(r);
+			continue;
+		}
+		PQclear(last);
+		last = r;
+	}
+	return last;
+}
+
+// Prints the rows unaligned under their header, the tag of a command
+// without the counts, which are the ones of node 0 only, or the primary
+// message of an error.
+static void print_result(PGresult *r)
+{
+	int i, j;
+
+	switch (PQresultStatus(r))
+	{
+		case PGRES_TUPLES_OK:
+			for (j = 0; j < PQnfields(r); j++)
+			{
+				printf("%s%s", (j > 0) ? "|" : "", PQfname(r, j));
+			}
+			printf("\n");
+			for (i = 0; i < PQntuples(r); i++)
+			{
+				for (j = 0; j < PQnfields(r); j++)
+				{
+					printf("%s%s", (j > 0) ? "|" : "", PQgetvalue(r, i, j));
+				}
+				printf("\n");
+			}
+			printf("(%d row%s)\n", PQntuples(r), (PQntuples(r) == 1) ? "" : "s");
+			break;
+		case PGRES_COMMAND_OK:
+		{
+			const char *tag = PQcmdStatus(r);
+			int len = strcspn(tag, "0123456789");
+
+			while (len > 0 && tag[len - 1] == ' ')
+			{
+				len--;
+			}
+			printf("%.*s\n", len, tag);
+			break;
+		}
+		default:
+		{
+			const char *msg = PQresultErrorField(r, PG_DIAG_MESSAGE_PRIMARY);
+
+			if (msg == NULL)
+			{
+				msg = PQresultErrorMessage(r);
+			}
+			printf("ERROR:  %s%s", msg, (strchr(msg, '\n') == NULL) ? "\n" : "");
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	par_PGconn *sessions[MAX_SESSIONS] = {NULL};
+	par_PGconn *conn;
+	char line[LINE_SIZE];
+	char *query = NULL;
+	size_t querylen = 0;
+	int i;
+
+	if ((conn = sessions[0] = connect_nodes()) == NULL)
+	{
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), stdin) != NULL)
+	{
+		size_t len = strlen(line);
+
+		fputs(line, stdout);
+		if (querylen == 0 && (strncmp(line, "--", 2) == 0 || strspn(line, " \t\n") == len))
+		{
+			continue;
+		}
+		if (querylen == 0 && strncmp(line, "\\rebalance ", 11) == 0)
+		{
+			int from = 0, max = 0;
+			PGresult *r;
+
+			sscanf(line + 11, "%d %d", &from, &max);
+			r = par_PQrebalance(conn, from, max);
+			print_result(r);
+			PQclear(r);
+			continue;
+		}
+		if (querylen == 0 && strncmp(line, "\\session ", 9) == 0)
+		{
+			int n = atoi(line + 9);
+
+			if (n < 0 || n >= MAX_SESSIONS)
+			{
+				fprintf(stderr, "no session %d\n", n);
+				continue;
+			}
+			if (sessions[n] == NULL && (sessions[n] = connect_nodes()) == NULL)
+			{
+				return 1;
+			}
+			conn = sessions[n];
+			continue;
+		}
+
+		query = realloc(query, querylen + len + 1);
+		memcpy(query + querylen, line, len + 1);
+		querylen += len;
+
+		// A statement ends with the line that ends with a semicolon
+		while (len > 0 && strchr(" \t\n", line[len - 1]) != NULL)
+		{
+			len--;
+		}
+		if (len > 0 && line[len - 1] == ';')
+		{
+			PGresult *r = par_PQexec(conn, query);
+
+			if (PQresultStatus(r) == PGRES_COPY_IN)
+			{
+				PQclear(r);
+				r = copy_in(conn);
+			}
+			print_result(r);
+			PQclear(r);
+			querylen = 0;
+		}
+	}
+
+	free(query);
+	for (i = 0; i < MAX_SESSIONS; i++)
+	{
+		if (sessions[i] != NULL)
+		{
+			par_PQfinish(sessions[i]);
+		}
+	}
+	return 0;
+}
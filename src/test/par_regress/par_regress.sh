@@ -0,0 +1,146 @@
+#! /bin/sh
+#
+# par_regress.sh
+#	Runs the tests of sql/ on a PargreSQL cluster of two ranks on this
+#	host, and compares their output with expected/. The tests run twice:
+#	with the shared memory rings between the ranks, and with the rings
+#	turned off, so that the frames go through MPI. Then the tests of
+#	$cooptests run on the two ranks sharing one fragment.
+#
+# Usage: par_regress.sh [srcdir]
+#
+# initdb, pg_ctl, par_inis_daemon and mpirun (or $MPIRUN) have to be in the
+# PATH, and par_regress in the current directory. The postmasters of the
+# ranks listen on $PGPORT and the next ports (54320 by default).
+
+srcdir=${1:-.}
+port=${PGPORT:-54320}
+mpirun=${MPIRUN:-mpirun}
+nodes=2
+shmem=/par_regress_%d
+tmp=`pwd`/tmp_check
+tests="exchange wide fragment limit bucket window copy setop rebalance join"
+cooptests="coopscan"
+
+daemon=
+failed=0
+
+stop_daemon()
+{
+	if [ -n "$daemon" ]; then
+		kill $daemon 2>/dev/null
+		wait $daemon 2>/dev/null
+		daemon=
+	fi
+	# The killed communicators leave their shared memory behind
+	rm -f /dev/shm/par_regress_*
+}
+
+stop_all()
+{
+	stop_daemon
+	i=0
+	while [ $i -lt $nodes ]; do
+		pg_ctl -D $tmp/data$i -m fast -w stop >/dev/null 2>&1
+		i=`expr $i + 1`
+	done
+}
+
+# Starts the communicators with the rings "on" or "off", and waits until
+# they have made the shared memory of every rank
+start_daemon()
+{
+	PARGRESQL_SHMEM=$shmem PARGRESQL_RINGS=$1 $mpirun -np $nodes par_inis_daemon >$tmp/daemon.log 2>&1 &
+	daemon=$!
+	tries=0
+	i=0
+	while [ $i -lt $nodes ]; do
+		if [ -e /dev/shm/`printf $shmem $i | sed 's,^/,,'` ]; then
+			i=`expr $i + 1`
+		elif [ $tries -lt 60 ]; then
+			tries=`expr $tries + 1`
+			sleep 1
+		else
+			echo "par_inis_daemon has not started, see $tmp/daemon.log"
+			exit 2
+		fi
+	done
+}
+
+# Runs every test of $2, or of $tests, writing its output to
+# results/<test><suffix>.out
+run_tests()
+{
+	suffix=$1
+	for t in ${2:-$tests}; do
+		printf "%s ... " "$t$suffix"
+		./par_regress <$srcdir/sql/$t.sql >results/$t$suffix.out 2>&1
+		if diff $srcdir/expected/$t.out results/$t$suffix.out >/dev/null; then
+			echo ok
+		else
+			diff -C3 $srcdir/expected/$t.out results/$t$suffix.out >>regression.diffs
+			echo FAILED
+			failed=1
+		fi
+	done
+}
+
+trap stop_all 0
+trap 'exit 2' 1 2 15
+
+rm -rf $tmp results regression.diffs par_libpq.conf
+mkdir -p $tmp results
+
+# A postmaster for every rank, which opens the shared memory of the rank
+i=0
+while [ $i -lt $nodes ]; do
+	initdb -D $tmp/data$i --no-locale >$tmp/initdb$i.log 2>&1 || {
+		echo "initdb has failed, see $tmp/initdb$i.log"
+		exit 2
+	}
+	# par_PQrebalance commits by PREPARE TRANSACTION
+	PARGRESQL_SHMEM=`printf $shmem $i` pg_ctl -D $tmp/data$i \
+		-o "-p `expr $port + $i` -c max_prepared_transactions=2" \
+		-l $tmp/postmaster$i.log -w start >/dev/null || {
+		echo "the postmaster has not started, see $tmp/postmaster$i.log"
+		exit 2
+	}
+	echo "port=`expr $port + $i` dbname=postgres options='-c enable_pargresql=on'" >>par_libpq.conf
+	i=`expr $i + 1`
+done
+
+for rings in on off; do
+	start_daemon $rings
+	run_tests "-rings-$rings"
+	stop_daemon
+done
+
+# Both ranks on the database of rank 0, as one fragment: the sessions of
+# rank 1 go to the same postmaster and choose the shared memory of their
+# rank themselves
+pg_ctl -D $tmp/data0 -m fast -w stop >/dev/null
+pg_ctl -D $tmp/data1 -m fast -w stop >/dev/null
+PARGRESQL_SHMEM=`printf $shmem 0` pg_ctl -D $tmp/data0 \
+	-o "-p $port -c max_prepared_transactions=2 -c pargresql_scan_workers=$nodes" \
+	-l $tmp/postmaster0.log -w start >/dev/null || {
+	echo "the postmaster has not started, see $tmp/postmaster0.log"
+	exit 2
+}
+rm -f par_libpq.conf
+i=0
+while [ $i -lt $nodes ]; do
+	echo "port=$port dbname=postgres options='-c enable_pargresql=on -c pargresql_shmem=`printf $shmem $i`'" >>par_libpq.conf
+	i=`expr $i + 1`
+done
+
+for rings in on off; do
+	start_daemon $rings
+	run_tests "-coop-rings-$rings" "$cooptests"
+	stop_daemon
+done
+
+if [ $failed -ne 0 ]; then
+	echo "The differences are in regression.diffs."
+	exit 1
+fi
+exit 0
@@ -0,0 +1,35 @@
+--
+-- The virtual buckets of the hash fragmentation
+--
+SELECT pargresql_hash_bucket(0) AS zero, pargresql_hash_bucket(1023) AS last,
+	pargresql_hash_bucket(1024) AS wrapped, pargresql_hash_bucket(-1) AS negative;
+
+-- Until a map is recorded, bucket b belongs to fragment b % 2
+SELECT pargresql_hash_fragment(1024) AS even, pargresql_hash_fragment(1025) AS odd;
+
+CREATE TABLE par_b (a int, b text) WITH (fragattr = 'a');
+INSERT INTO par_b SELECT i, 'row' FROM generate_series(1, 100) i;
+INSERT INTO par_b VALUES (NULL, 'null');
+
+SELECT count(*), count(a), sum(a) FROM par_b;
+SELECT b, count(*) FROM par_b GROUP BY b ORDER BY b;
+
+-- Node 0 has the rows of its buckets, and the NULL, which has no bucket
+SET enable_pargresql = off;
+SELECT count(*) FROM par_b WHERE a IS NULL;
+SELECT bool_and(pargresql_hash_fragment(hashint4(a)) = 0) AS own FROM par_b WHERE a IS NOT NULL;
+SET enable_pargresql = on;
+
+-- Every node updates and deletes the rows of its own buckets, and the
+-- rows stay where they are
+UPDATE par_b SET b = 'updated' WHERE a % 10 = 0;
+DELETE FROM par_b WHERE a % 3 = 0;
+SELECT count(*), count(a), sum(a) FROM par_b;
+SELECT b, count(*) FROM par_b GROUP BY b ORDER BY b;
+SET enable_pargresql = off;
+SELECT count(*) FROM par_b WHERE a IS NULL;
+SELECT bool_and(pargresql_hash_fragment(hashint4(a)) = 0) AS own FROM par_b WHERE a IS NOT NULL;
+SELECT b, count(*), sum(a) FROM par_b WHERE a IS NOT NULL GROUP BY b ORDER BY b;
+SET enable_pargresql = on;
+
+DROP TABLE par_b;
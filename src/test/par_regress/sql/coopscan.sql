@@ -0,0 +1,38 @@
+--
+-- Cooperative scans: the two ranks share one fragment, and every block
+-- of a sequential scan is read by one of them
+--
+CREATE TABLE par_c1 (a int, b int) WITH (fragattr = 'a');
+CREATE TABLE par_c2 (b int) WITH (fragattr = 'b');
+INSERT INTO par_c1 SELECT i, i % 10 FROM generate_series(1, 20000) i;
+INSERT INTO par_c2 SELECT i FROM generate_series(1, 4) i;
+
+SELECT count(*), sum(a) FROM par_c1;
+SELECT b, count(*) FROM par_c1 GROUP BY b ORDER BY b;
+SELECT count(*) FROM par_c1 WHERE a % 1000 = 0;
+SELECT a FROM par_c1 WHERE a > 19997 ORDER BY a;
+
+-- The NestLoop rescans its inner SeqScan for every outer row, and every
+-- rank reads its own blocks of par_c1 again. The keys 1 and 2 hash to
+-- rank 0 and the keys 3 and 4 to rank 1, so both rescan twice.
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET seq_page_cost = 0;
+SELECT count(*), sum(i.a) FROM par_c2 o JOIN par_c1 i ON i.b = o.b;
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET seq_page_cost;
+
+-- Another session on the same ranks counts its commands from the start
+-- again, but its dispensers are its own
+\session 1
+SELECT count(*), sum(a) FROM par_c1;
+SELECT count(*), sum(i.a) FROM par_c2 o JOIN par_c1 i ON i.b = o.b;
+\session 0
+SELECT count(*), sum(a) FROM par_c1;
+\session 1
+SELECT b, count(*) FROM par_c1 GROUP BY b ORDER BY b;
+\session 0
+
+DROP TABLE par_c1;
+DROP TABLE par_c2;
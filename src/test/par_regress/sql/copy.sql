@@ -0,0 +1,80 @@
+--
+-- COPY FROM STDIN: node 0 reads the data and routes every row to its
+-- node, the other nodes read an empty stream
+--
+CREATE TABLE par_ch (a int, b text) WITH (fragattr = 'a');
+CREATE TABLE par_cr (d int, b text)
+	WITH (fragattr = 'd', fragmethod = 'range', fragbounds = '10');
+
+COPY par_ch FROM STDIN CSV;
+1,r1
+2,r2
+3,r3
+4,r4
+5,r5
+6,r6
+7,r7
+8,r8
+9,r9
+10,r10
+11,r11
+12,r12
+13,r13
+14,r14
+15,r15
+16,r16
+17,r17
+18,r18
+19,r19
+20,r20
+,null
+\.
+COPY par_cr FROM STDIN CSV;
+1,r1
+2,r2
+3,r3
+4,r4
+5,r5
+6,r6
+7,r7
+8,r8
+9,r9
+10,r10
+11,r11
+12,r12
+13,r13
+14,r14
+15,r15
+16,r16
+17,r17
+18,r18
+19,r19
+20,r20
+\.
+
+SELECT count(*), count(a), sum(a), count(DISTINCT b) FROM par_ch;
+SELECT count(*), sum(d), count(DISTINCT b) FROM par_cr;
+SELECT d, b FROM par_cr WHERE d BETWEEN 9 AND 11 ORDER BY d;
+
+-- Node 0 has all the rows of its buckets and the NULL, and nothing else,
+-- and the range below the first bound
+SET enable_pargresql = off;
+SELECT count(*) FROM par_ch WHERE a IS NULL;
+SELECT bool_and(pargresql_hash_fragment(hashint4(a)) = 0) AS own,
+	count(a) = (SELECT count(*) FROM generate_series(1, 20) i
+		WHERE pargresql_hash_fragment(hashint4(i)) = 0) AS complete
+	FROM par_ch;
+SELECT count(*), min(d), max(d) FROM par_cr;
+SET enable_pargresql = on;
+
+-- A second COPY in the session: 0 stays on node 0, 21 goes to node 1
+COPY par_cr FROM STDIN CSV;
+0,zero
+21,r21
+\.
+SELECT count(*), min(d), max(d) FROM par_cr;
+SET enable_pargresql = off;
+SELECT count(*), min(d), max(d) FROM par_cr;
+SET enable_pargresql = on;
+
+DROP TABLE par_ch, par_cr;
@@ -0,0 +1,45 @@
+--
+-- The exchange of the tuples between the nodes
+--
+CREATE TABLE par_t (a int, b text) WITH (fragattr = 'a');
+CREATE TABLE par_u (c int, d int) WITH (fragattr = 'c');
+
+-- Every node keeps the rows of its own fragment
+INSERT INTO par_t SELECT i, repeat('x', i % 200) FROM generate_series(1, 10000) i;
+INSERT INTO par_u SELECT i, i % 100 FROM generate_series(1, 1000) i;
+
+-- All the rows go to node 0: the narrow ones fill the frames by their
+-- number, the wide ones by their size
+SELECT count(*), sum(a) FROM (SELECT a FROM par_t ORDER BY a OFFSET 0) s;
+SELECT count(*), sum(length(b)) FROM (SELECT a, b FROM par_t ORDER BY a OFFSET 0) s;
+
+-- ORDER BY ... LIMIT
+SELECT a, length(b) FROM par_t ORDER BY a LIMIT 3;
+SELECT a FROM par_t ORDER BY a DESC LIMIT 2 OFFSET 1;
+
+-- The join redistributes par_u by d
+SELECT count(*), sum(t.a) FROM par_t t JOIN par_u u ON t.a = u.d;
+
+-- and both of its sides here
+SELECT count(*) FROM par_u u1 JOIN par_u u2 ON u1.d = u2.d;
+
+-- Both sides are fragmented by the join key: every node joins its own
+-- rows, and nothing is exchanged
+SELECT count(*), sum(t.a) FROM par_t t JOIN par_u u ON t.a = u.c;
+
+-- par_v is small, as its statistics say, so it is cheaper to send all of
+-- it to every node than to redistribute par_u
+CREATE TABLE par_v (e int, f int) WITH (fragattr = 'e');
+INSERT INTO par_v SELECT i, i * 10 FROM generate_series(1, 10) i;
+ANALYZE par_v;
+SELECT count(*), sum(u.c) FROM par_u u JOIN par_v v ON u.d = v.f;
+SELECT count(*), count(v.e), sum(u.c) FROM par_u u LEFT JOIN par_v v ON u.d = v.f;
+DROP TABLE par_v;
+
+-- A grouping by the column the rows are not fragmented by
+SELECT d, count(*) FROM par_u GROUP BY d ORDER BY d LIMIT 3;
+
+-- No rows at all: every node sends just the end of its stream
+SELECT a FROM par_t WHERE a < 0;
+
+DROP TABLE par_t, par_u;
@@ -0,0 +1,53 @@
+--
+-- Range and list fragmentation
+--
+CREATE TABLE par_bad (a int) WITH (fragattr = 'a', fragmethod = 'round-robin');
+
+CREATE TABLE par_plain (a int);
+CREATE TABLE par_hash (a int) WITH (fragattr = 'a');
+CREATE TABLE par_list (region text, n int)
+	WITH (fragattr = 'region', fragmethod = 'list', fragbounds = 'eu, ru; us');
+CREATE TABLE par_range (d int, n int)
+	WITH (fragattr = 'd', fragmethod = 'range', fragbounds = '10');
+CREATE TABLE par_wide (d int)
+	WITH (fragattr = 'd', fragmethod = 'range', fragbounds = '10;20');
+CREATE TABLE par_dup (region text)
+	WITH (fragattr = 'region', fragmethod = 'list', fragbounds = 'eu;ru,eu');
+CREATE TABLE par_nobounds (d int)
+	WITH (fragattr = 'd', fragmethod = 'range');
+
+-- Only the fragmented relations can be written
+INSERT INTO par_plain VALUES (1);
+
+-- The bounds are checked against the number of nodes when used
+INSERT INTO par_wide VALUES (1);
+INSERT INTO par_dup VALUES ('eu');
+INSERT INTO par_nobounds VALUES (1);
+
+INSERT INTO par_hash SELECT i FROM generate_series(1, 10) i;
+INSERT INTO par_list VALUES ('eu', 1), ('ru', 2), ('us', 3), ('cn', 4), (NULL, 5);
+INSERT INTO par_range SELECT i, i FROM generate_series(1, 20) i;
+
+SELECT region, n FROM par_list ORDER BY n;
+SELECT n FROM par_list WHERE region = 'us';
+SELECT n FROM par_list WHERE region IS NULL;
+SELECT count(*), sum(n) FROM par_range WHERE d >= 10;
+
+-- Without the parallel processing every node reads its own rows, and the
+-- client shows the ones of node 0: the values not listed and the NULLs
+-- are there, and the range below the first bound
+SET enable_pargresql = off;
+SELECT region, n FROM par_list ORDER BY n;
+SELECT count(*), min(d), max(d) FROM par_range;
+SET enable_pargresql = on;
+
+-- Every node updates and deletes the rows of its own fragment
+UPDATE par_list SET n = n + 10 WHERE region = 'us';
+DELETE FROM par_list WHERE region IS NULL;
+SELECT region, n FROM par_list ORDER BY n;
+
+-- The joins redistribute par_list and par_range
+SELECT count(*) FROM par_hash h JOIN par_list l ON h.a = l.n;
+SELECT count(*), sum(r.n) FROM par_range r JOIN par_hash h ON r.d = h.a;
+
+DROP TABLE par_plain, par_hash, par_list, par_range, par_wide, par_dup, par_nobounds;
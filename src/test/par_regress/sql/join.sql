@@ -0,0 +1,48 @@
+--
+-- The hash joins over the redistributed outer side
+--
+CREATE TABLE par_f1 (a int, b int) WITH (fragattr = 'a');
+CREATE TABLE par_f2 (a int, c int) WITH (fragattr = 'a');
+INSERT INTO par_f1 SELECT i, i * 3 FROM generate_series(1, 10000) i;
+INSERT INTO par_f2 SELECT i, 1 FROM generate_series(1, 6000) i;
+INSERT INTO par_f2 SELECT i, 2 FROM generate_series(1, 300) i;
+
+-- par_f1 goes to the fragments of its b, where the filters of the
+-- hash tables of par_f2 drop most of it before it is sent
+SET enable_mergejoin = off;
+SET pargresql_join_filters = on;
+SELECT count(*), sum(f1.a), sum(f2.c) FROM par_f1 f1 JOIN par_f2 f2 ON f1.b = f2.a;
+SELECT count(*), sum(a) FROM par_f1 WHERE b IN (SELECT a FROM par_f2);
+SET pargresql_join_filters = off;
+SELECT count(*), sum(f1.a), sum(f2.c) FROM par_f1 f1 JOIN par_f2 f2 ON f1.b = f2.a;
+SELECT count(*), sum(a) FROM par_f1 WHERE b IN (SELECT a FROM par_f2);
+RESET pargresql_join_filters;
+
+-- The keys 0 and 1 make 80% of par_h1, but par_h2 has no key 1. The
+-- statistics of par_h1 make them hot: their rows are spread over the
+-- nodes, and the rows of par_h2 with the key 0 are broadcast to meet
+-- them. par_h1n has the same rows, but no statistics, and its joins
+-- are the ones without the hot keys.
+CREATE TABLE par_h1 (a int, k int) WITH (fragattr = 'a');
+CREATE TABLE par_h1n (a int, k int) WITH (fragattr = 'a');
+CREATE TABLE par_h2 (a int, k int) WITH (fragattr = 'a');
+INSERT INTO par_h1 SELECT i, CASE WHEN i % 5 = 0 THEN i WHEN i % 5 < 3 THEN 0 ELSE 1 END
+	FROM generate_series(1, 4000) i;
+INSERT INTO par_h1n SELECT * FROM par_h1;
+INSERT INTO par_h2 SELECT i, i * 2 - 2 FROM generate_series(1, 6000) i;
+INSERT INTO par_h2 VALUES (6001, 0);
+ANALYZE par_h1;
+
+SELECT count(*), sum(h1.a), sum(h2.a) FROM par_h1 h1 JOIN par_h2 h2 ON h1.k = h2.k;
+SELECT count(*), sum(h1.a), sum(h2.a) FROM par_h1n h1 JOIN par_h2 h2 ON h1.k = h2.k;
+
+-- Every row of par_h1 goes to one node, so the unmatched ones, those
+-- of the key 1 as well, come out once
+SELECT count(*), count(h2.a), sum(h1.a), sum(h2.a)
+	FROM par_h1 h1 LEFT JOIN par_h2 h2 ON h1.k = h2.k;
+SELECT count(*), count(h2.a), sum(h1.a), sum(h2.a)
+	FROM par_h1n h1 LEFT JOIN par_h2 h2 ON h1.k = h2.k;
+RESET enable_mergejoin;
+
+DROP TABLE par_f1, par_f2;
+DROP TABLE par_h1, par_h1n, par_h2;
@@ -0,0 +1,24 @@
+--
+-- LIMIT and OFFSET: the OFFSET is of the whole result,
+-- not of the rows of every node
+--
+CREATE TABLE par_l (a int, b text) WITH (fragattr = 'a');
+INSERT INTO par_l SELECT i, 'row' FROM generate_series(1, 10000) i;
+
+SELECT a FROM par_l ORDER BY a LIMIT 3;
+SELECT a FROM par_l ORDER BY a LIMIT 3 OFFSET 9997;
+SELECT a FROM par_l ORDER BY a LIMIT ALL OFFSET 9998;
+
+-- Without an order, node 0 stops the other nodes once it has enough
+SELECT b FROM par_l LIMIT 5 OFFSET 9998;
+SELECT b FROM par_l OFFSET 9999;
+SELECT b FROM par_l LIMIT 0;
+SELECT count(*) FROM (SELECT a FROM par_l LIMIT 10) s;
+
+-- The count is not known when the plan is made
+PREPARE par_limit(int8, int8) AS
+	SELECT a FROM par_l ORDER BY a LIMIT $1 OFFSET $2;
+EXECUTE par_limit(2, 10);
+DEALLOCATE par_limit;
+
+DROP TABLE par_l;
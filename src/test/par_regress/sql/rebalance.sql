@@ -0,0 +1,46 @@
+--
+-- Moving the virtual buckets between the fragments
+--
+-- The rows are placed as if the cluster had had one fragment: every
+-- bucket is recorded in fragment 0 on both nodes
+SET enable_pargresql = off;
+INSERT INTO pg_par_bucket SELECT b, 0 FROM generate_series(0, 1023) b;
+SET enable_pargresql = on;
+
+CREATE TABLE par_r (a int, b text) WITH (fragattr = 'a');
+INSERT INTO par_r SELECT i, 'row' FROM generate_series(1, 1000) i;
+INSERT INTO par_r VALUES (NULL, 'null');
+SELECT count(*), count(a), sum(a) FROM par_r;
+
+SET enable_pargresql = off;
+SELECT count(*) FROM par_r;
+SET enable_pargresql = on;
+
+-- The moved buckets cannot be committed by a plain COMMIT
+BEGIN;
+SELECT pargresql_rebalance(0, 1);
+COMMIT;
+ROLLBACK;
+SELECT count(*), count(a), sum(a) FROM par_r;
+
+-- Half of the buckets go to fragment 1, a few at a time
+\rebalance 0 300
+\rebalance 0 300
+\rebalance 0 300
+SELECT count(*), count(a), sum(a) FROM par_r;
+
+-- Node 0 has the rows of its buckets, and the NULL, and nothing else
+SET enable_pargresql = off;
+SELECT count(*) FROM pg_par_bucket WHERE fragment = 1;
+SELECT count(*) FROM par_r WHERE a IS NULL;
+SELECT bool_and(pargresql_hash_fragment(hashint4(a)) = 0) AS own,
+	count(a) = (SELECT count(*) FROM generate_series(1, 1000) i
+		WHERE pargresql_hash_fragment(hashint4(i)) = 0) AS complete
+	FROM par_r;
+SET enable_pargresql = on;
+
+-- Back to the map of the fresh cluster
+DROP TABLE par_r;
+SET enable_pargresql = off;
+DELETE FROM pg_par_bucket;
+SET enable_pargresql = on;
@@ -0,0 +1,38 @@
+--
+-- DISTINCT and the set operations: the equal rows meet on one node
+--
+CREATE TABLE par_s1 (a int, b int) WITH (fragattr = 'a');
+CREATE TABLE par_s2 (a int, b int) WITH (fragattr = 'a');
+CREATE INDEX par_s1_b ON par_s1 (b);
+INSERT INTO par_s1 SELECT i, i % 10 FROM generate_series(1, 100) i;
+INSERT INTO par_s2 SELECT i, i % 7 FROM generate_series(1, 50) i;
+
+-- The index gives the input of the Unique in order, there is no Sort
+-- to put the exchange under
+SET enable_sort = off;
+SET enable_hashagg = off;
+SELECT count(*), sum(b) FROM (SELECT DISTINCT b FROM par_s1) s;
+RESET enable_sort;
+
+-- Sorted INTERSECT and EXCEPT
+SELECT b FROM par_s1 INTERSECT SELECT b FROM par_s2 ORDER BY b;
+SELECT b FROM par_s1 EXCEPT SELECT b FROM par_s2 ORDER BY b;
+SELECT count(*), sum(b) FROM (SELECT b FROM par_s1 INTERSECT ALL SELECT b FROM par_s2) s;
+SELECT count(*), sum(b) FROM (SELECT b FROM par_s1 EXCEPT ALL SELECT b FROM par_s2) s;
+RESET enable_hashagg;
+
+-- The same, hashed
+SELECT b FROM par_s1 INTERSECT SELECT b FROM par_s2 ORDER BY b;
+SELECT b FROM par_s1 EXCEPT SELECT b FROM par_s2 ORDER BY b;
+SELECT count(*), sum(b) FROM (SELECT b FROM par_s1 INTERSECT ALL SELECT b FROM par_s2) s;
+SELECT count(*), sum(b) FROM (SELECT b FROM par_s1 EXCEPT ALL SELECT b FROM par_s2) s;
+
+-- DISTINCT and UNION
+SELECT DISTINCT b FROM par_s1 ORDER BY b;
+SELECT count(*), sum(b) FROM (SELECT b FROM par_s1 UNION SELECT b FROM par_s2) s;
+
+-- UNION ALL of two fragmented relations: every branch is read where it is
+SELECT count(*), sum(a) FROM (SELECT a FROM par_s1 UNION ALL SELECT a FROM par_s2) s;
+SELECT a FROM (SELECT a FROM par_s1 UNION ALL SELECT a FROM par_s2) s ORDER BY a LIMIT 3;
+
+DROP TABLE par_s1, par_s2;
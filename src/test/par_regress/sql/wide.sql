@@ -0,0 +1,19 @@
+--
+-- The rows wider than a frame, which go in several messages
+--
+CREATE TABLE par_w (a int, b text) WITH (fragattr = 'a');
+
+-- Out of line and not compressed, so the rows are sent as wide as they are
+ALTER TABLE par_w ALTER b SET STORAGE EXTERNAL;
+
+INSERT INTO par_w SELECT i, repeat(chr(64 + i), 10000 * i) FROM generate_series(1, 4) i;
+INSERT INTO par_w SELECT i, 'narrow' FROM generate_series(5, 600) i;
+
+-- Every row goes to node 0, the wide ones between the narrow ones
+SELECT count(*), sum(length(b)) FROM (SELECT a, b FROM par_w ORDER BY a OFFSET 0) s;
+SELECT a, length(b), md5(b) FROM (SELECT a, b FROM par_w ORDER BY a OFFSET 0) s WHERE a <= 4;
+
+-- The grouping redistributes the wide values
+SELECT length(b), count(*), min(md5(b)) FROM par_w GROUP BY b ORDER BY 1;
+
+DROP TABLE par_w;
@@ -0,0 +1,22 @@
+--
+-- Window functions over the partitions exchanged by their key
+--
+CREATE TABLE par_w (d int, c int) WITH (fragattr = 'c');
+CREATE INDEX par_w_d_c ON par_w (d, c);
+INSERT INTO par_w SELECT i % 5, i FROM generate_series(1, 100) i;
+
+-- The index gives the input in window order: the exchange by d is
+-- sorted again on every node, its streams are not merged
+SET enable_sort = off;
+SELECT count(*), sum(rn), sum(rn * c), sum(CASE WHEN rn = 1 THEN c END) AS firsts
+	FROM (SELECT c, row_number() OVER (PARTITION BY d ORDER BY c) AS rn FROM par_w) s;
+RESET enable_sort;
+
+-- The exchange under the Sort of the window
+SELECT count(*), sum(rn), sum(rn * c), sum(CASE WHEN rn = 1 THEN c END) AS firsts
+	FROM (SELECT c, row_number() OVER (PARTITION BY d ORDER BY c) AS rn FROM par_w) s;
+SELECT d, c, rn
+	FROM (SELECT d, c, row_number() OVER (PARTITION BY d ORDER BY c) AS rn FROM par_w) s
+	WHERE c > 95 ORDER BY c;
+
+DROP TABLE par_w;